@@ -0,0 +1,58 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_ALIGNMENT_H_
+#define MXCORE_ALIGNMENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mx {
+namespace core {
+
+// Assumed size of a cache line, used to pad data shared between threads.
+const size_t kCacheLineSize = 64;
+
+inline bool IsPowerOfTwo(const size_t value) {
+  return (value != 0) && ((value & (value - 1)) == 0);
+}
+
+// Rounds address up to the next multiple of alignment, which has to be a power
+// of two.
+inline uintptr_t AlignUp(const uintptr_t address, const size_t alignment) {
+  uintptr_t mask = alignment - 1;
+  return (address + mask) & ~mask;
+}
+
+inline bool IsAligned(const void* pointer, const size_t alignment) {
+  return (reinterpret_cast<uintptr_t>(pointer) & (alignment - 1)) == 0;
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_ALIGNMENT_H_
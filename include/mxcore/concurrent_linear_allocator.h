@@ -0,0 +1,81 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_CONCURRENT_LINEAR_ALLOCATOR_H_
+#define MXCORE_CONCURRENT_LINEAR_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace mx {
+namespace core {
+
+// Thread-safe variant of LinearAllocator. Any number of threads may allocate
+// from the same chunk of memory at the same time; the marker is advanced with
+// an atomic fetch-and-add, so no locks are involved. Rewind() has the same
+// semantics as in LinearAllocator but must only be called while no other thread
+// is allocating, e.g. at frame boundaries.
+class ConcurrentLinearAllocator {
+ public:
+  ConcurrentLinearAllocator(void* base, const size_t size);
+
+  // Allocates size bytes from the memory pool. Returns NULL if the pool is
+  // exhausted. Safe to call concurrently.
+  void* Allocate(const size_t size);
+
+  // Allocates size bytes so that the address offset bytes into the allocation
+  // is a multiple of alignment. Uses a compare-and-swap loop instead of a
+  // single fetch-and-add, which is still lock-free but slightly slower under
+  // contention.
+  void* Allocate(const size_t size, const size_t alignment,
+                 const size_t offset = 0);
+
+  // Resets the marker to an arbitrary position within the pool's boundaries.
+  // Not safe to call while other threads are allocating.
+  void Rewind(void* to);
+
+  // Returns the next free address. Once the pool is exhausted, this is the end
+  // of the pool.
+  void* marker() const;
+  size_t size() const { return size_; }
+  size_t bytes_allocated() const;
+
+ private:
+  ConcurrentLinearAllocator(const ConcurrentLinearAllocator& other);
+  ConcurrentLinearAllocator& operator=(const ConcurrentLinearAllocator& other);
+
+  const size_t size_;
+  uint8_t* base_;
+  uint8_t* end_;
+  std::atomic<uintptr_t> marker_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_CONCURRENT_LINEAR_ALLOCATOR_H_
@@ -0,0 +1,82 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_FIBER_H_
+#define MXCORE_FIBER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ucontext.h>
+
+namespace mx {
+namespace core {
+
+// An execution context with its own stack, switched to explicitly. Built on
+// ucontext, so it is only available on POSIX systems.
+class Fiber {
+ public:
+  typedef void (*Function)(void* argument);
+
+  // Creates an empty fiber. Switching away from it saves the current context,
+  // which is how a thread's own stack is turned into a fiber.
+  Fiber();
+  ~Fiber();
+
+  // Makes the fiber call function(argument) on the given stack the next time
+  // it is switched to, discarding whatever it ran before. function must never
+  // return; it has to switch to another fiber instead. Must not be called
+  // while the fiber is running.
+  void Reset(void* stack, const size_t stack_size, Function function,
+             void* argument);
+
+  // Saves the calling context in from and continues with to.
+  static void Switch(Fiber* from, Fiber* to);
+
+ private:
+  Fiber(const Fiber& other);
+  Fiber& operator=(const Fiber& other);
+
+  static void Start(uint32_t fiber_low, uint32_t fiber_high);
+
+  // Tells the address sanitizer that a switch to the calling fiber is done.
+  static void FinishSwitch(void* fake_stack);
+
+  ucontext_t context_;
+  Function function_;
+  void* argument_;
+  // NULL for a thread's own stack until the address sanitizer reports it.
+  void* stack_;
+  size_t stack_size_;
+  // Fiber handle of the thread sanitizer, if it is enabled.
+  void* sanitizer_fiber_;
+  bool owns_sanitizer_fiber_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_FIBER_H_
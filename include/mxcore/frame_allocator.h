@@ -0,0 +1,110 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_FRAME_ALLOCATOR_H_
+#define MXCORE_FRAME_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mxcore/aligned_memory.h"
+#include "mxcore/linear_allocator.h"
+#include "mxcore/thread_index.h"
+
+namespace mx {
+namespace core {
+
+// Owns frame_count sets of linear arenas with one arena per thread index in
+// every set. Threads allocate from the arena of their CurrentThreadIndex() in
+// the current set, so no synchronization is necessary. BeginFrame() moves on
+// to the oldest set and rewinds it, which means that memory allocated during
+// frame K stays valid until frame K + frame_count begins. Use two sets for
+// double buffering and three for triple buffering. If a BlockAllocator is
+// given, arenas grow beyond arena_size instead of failing once they are
+// exhausted.
+class FrameAllocator {
+ public:
+  // Reserves frame_count * thread_count arenas of arena_size bytes each for
+  // the thread indices below thread_count. Thread indices are dense, so these
+  // serve the first thread_count threads alive at the same time. Up to
+  // kMaxThreads threads may allocate; the arenas of higher indices start out
+  // empty and grow in blocks of arena_size from block_allocator, or from the
+  // heap if none is given.
+  FrameAllocator(const size_t arena_size, const uint32_t thread_count,
+                 const uint32_t frame_count = 2,
+                 BlockAllocator* block_allocator = NULL);
+  ~FrameAllocator();
+
+  // Advances to the next frame and rewinds the arenas it reuses. Must not be
+  // called while any thread allocates from this allocator.
+  void BeginFrame();
+
+  // Returns the calling thread's arena for the current frame.
+  LinearAllocator& allocator() { return arena(slot()); }
+
+  void* Allocate(const size_t size) {
+    return allocator().Allocate(size);
+  }
+
+  void* Allocate(const size_t size, const size_t alignment) {
+    return allocator().Allocate(size, alignment);
+  }
+
+  // Returns the arena of thread slot in the current frame. slot is in
+  // [0, kMaxThreads).
+  LinearAllocator& arena(const uint32_t slot) {
+    return arenas_[frame_index_ * kMaxThreads + slot];
+  }
+
+  // The calling thread's arena slot, which is its thread index. A thread
+  // inherits the arena of the exited thread that held its index before.
+  uint32_t slot() const { return CurrentThreadIndex(); }
+
+  uint64_t frame() const { return frame_; }
+  uint32_t frame_count() const { return frame_count_; }
+  uint32_t thread_count() const { return thread_count_; }
+  size_t arena_size() const { return arena_size_; }
+
+ private:
+  FrameAllocator(const FrameAllocator& other);
+  FrameAllocator& operator=(const FrameAllocator& other);
+
+  const size_t arena_size_;
+  const uint32_t thread_count_;
+  const uint32_t frame_count_;
+  uint32_t frame_index_;
+  uint64_t frame_;
+  AlignedMemory<64> memory_;
+  // Supplies the arenas of thread indices above thread_count if no block
+  // allocator is given.
+  HeapBlockAllocator heap_block_allocator_;
+  LinearAllocator* arenas_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_FRAME_ALLOCATOR_H_
@@ -0,0 +1,89 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_HEAP_PROFILE_H_
+#define MXCORE_HEAP_PROFILE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+#include "mxcore/memory_tracker.h"
+
+namespace mx {
+namespace core {
+
+// A copy of the per call site allocation statistics collected by
+// MemoryTracker at one point in time. Sites are identified by file name and
+// line, so allocations made from a header included in several translation
+// units are merged into one entry.
+class HeapSnapshot {
+ public:
+  enum SortOrder {
+    kSortByLiveBytes,
+    kSortByLiveCount,
+    kSortByPeakBytes,
+    kSortByTotalCount,
+    kSortByTotalBytes,
+    kSortByAllocationRate
+  };
+
+  HeapSnapshot() : time_(0.0) {}
+
+  // Replaces the contents with the current state of the tracker. Allocation
+  // rates are averaged over the lifetime of the process.
+  void Capture();
+
+  // Returns the changes from before to after. Live values become differences,
+  // total values the number of allocations made in between and allocation
+  // rates are calculated over the time between both snapshots. Peak values
+  // are taken from after, they can't be attributed to the interval.
+  static HeapSnapshot Diff(const HeapSnapshot& before,
+                           const HeapSnapshot& after);
+
+  // Sorts call sites by descending cost.
+  void Sort(const SortOrder order);
+
+  // Prints the first max_sites call sites as a table.
+  void Print(FILE* file, const size_t max_sites) const;
+
+  void WriteCsv(FILE* file) const;
+  void WriteJson(FILE* file) const;
+
+  const std::vector<CallSiteStatistics>& sites() const { return sites_; }
+
+  // Seconds since the process started tracking, at the time of the capture.
+  double time() const { return time_; }
+
+ private:
+  std::vector<CallSiteStatistics> sites_;
+  double time_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_HEAP_PROFILE_H_
@@ -0,0 +1,172 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_INTRUSIVE_POINTER_H_
+#define MXCORE_INTRUSIVE_POINTER_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace mx {
+namespace core {
+
+// Base class for objects shared through IntrusivePointer. The reference count
+// is stored in the object itself, so sharing a pointer only touches the
+// pointee and the pointer being written. The count is atomic, which makes it
+// safe to copy and release pointers to the same object from several threads.
+//
+// The destructor isn't virtual: IntrusivePointer<T> deletes the object as a T,
+// so T must either be the most derived type or declare a virtual destructor.
+class RefCounted {
+ public:
+  RefCounted() : reference_count_(0) {}
+
+  void AddReference() const {
+    reference_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Returns true if the last reference has been released. Acquire-release
+  // ordering makes all writes through other references visible to the thread
+  // deleting the object.
+  bool RemoveReference() const {
+    assert(reference_count_.load(std::memory_order_relaxed) > 0);
+    return reference_count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  uint32_t reference_count() const {
+    return reference_count_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  // Copies get a count of their own.
+  RefCounted(const RefCounted&) : reference_count_(0) {}
+  RefCounted& operator=(const RefCounted&) { return *this; }
+
+  ~RefCounted() {}
+
+ private:
+  mutable std::atomic<uint32_t> reference_count_;
+};
+
+// Reference counted pointer for classes deriving from RefCounted. Unlike
+// SmartPointer, copies only increment the counter in the pointee and moves
+// don't touch it at all. Different IntrusivePointer instances may be used from
+// different threads, but a single instance must not be written concurrently.
+template <class T>
+class IntrusivePointer {
+ public:
+  IntrusivePointer() : pointer_(NULL) {}
+
+  explicit IntrusivePointer(T* pointer) : pointer_(pointer) {
+    if (pointer_ != NULL) {
+      pointer_->AddReference();
+    }
+  }
+
+  IntrusivePointer(const IntrusivePointer<T>& other)
+      : pointer_(other.pointer_) {
+    if (pointer_ != NULL) {
+      pointer_->AddReference();
+    }
+  }
+
+  IntrusivePointer(IntrusivePointer<T>&& other) : pointer_(other.pointer_) {
+    other.pointer_ = NULL;
+  }
+
+  ~IntrusivePointer() {
+    Release();
+  }
+
+  IntrusivePointer<T>& operator=(const IntrusivePointer<T>& other) {
+    // Adding the new reference first handles self assignment.
+    T* pointer = other.pointer_;
+    if (pointer != NULL) {
+      pointer->AddReference();
+    }
+    Release();
+    pointer_ = pointer;
+    return *this;
+  }
+
+  IntrusivePointer<T>& operator=(IntrusivePointer<T>&& other) {
+    if (&other != this) {
+      Release();
+      pointer_ = other.pointer_;
+      other.pointer_ = NULL;
+    }
+    return *this;
+  }
+
+  T& operator*() const {
+    return *pointer_;
+  }
+
+  T* operator->() const {
+    return pointer_;
+  }
+
+  bool operator==(const IntrusivePointer<T>& other) const {
+    return (other.pointer_ == pointer_);
+  }
+
+  bool operator!=(const IntrusivePointer<T>& other) const {
+    return !(other == *this);
+  }
+
+  // Releases the current pointee and takes ownership of pointer.
+  void Reset(T* pointer = NULL) {
+    IntrusivePointer<T>(pointer).Swap(*this);
+  }
+
+  void Swap(IntrusivePointer<T>& other) {
+    T* pointer = pointer_;
+    pointer_ = other.pointer_;
+    other.pointer_ = pointer;
+  }
+
+  T* get() const {
+    return pointer_;
+  }
+
+ private:
+  void Release() {
+    if (pointer_ != NULL && pointer_->RemoveReference()) {
+      delete pointer_;
+    }
+    pointer_ = NULL;
+  }
+
+  T* pointer_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_INTRUSIVE_POINTER_H_
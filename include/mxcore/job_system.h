@@ -0,0 +1,246 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_JOB_SYSTEM_H_
+#define MXCORE_JOB_SYSTEM_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "mxcore/aligned_memory.h"
+#include "mxcore/alignment.h"
+#include "mxcore/fiber.h"
+#include "mxcore/linear_allocator.h"
+
+namespace mx {
+namespace core {
+
+class JobCounter;
+class JobSystem;
+struct JobFiber;
+
+typedef void (*JobFunction)(JobSystem* system, void* data);
+
+// Bytes of argument data stored in a job.
+const size_t kJobDataSize = 40;
+
+// A function and a copy of its arguments. Jobs are allocated from the arena
+// of the worker creating them and fill exactly one cache line, so workers
+// running neighbouring jobs never share a line.
+struct alignas(kCacheLineSize) Job {
+  JobFunction function_;
+  JobCounter* counter_;
+  // Links jobs waiting for the same counter.
+  Job* next_;
+  uint8_t data_[kJobDataSize];
+};
+
+// Counts unfinished jobs. Creating a job with a counter increments it,
+// finishing the job decrements it. Waiting for a counter to drop to zero
+// joins all jobs created with it; jobs queued with RunAfter() and fibers
+// suspended in Wait() continue once it does.
+class JobCounter {
+ public:
+  JobCounter() : value_(0), waiting_(NULL), fibers_(NULL) { lock_.clear(); }
+  ~JobCounter() { assert(value() == 0); }
+
+  uint32_t value() const { return value_.load(std::memory_order_acquire); }
+
+ private:
+  friend class JobSystem;
+
+  JobCounter(const JobCounter& other);
+  JobCounter& operator=(const JobCounter& other);
+
+  void Lock() {
+    while (lock_.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+
+  void Unlock() { lock_.clear(std::memory_order_release); }
+
+  std::atomic<uint32_t> value_;
+  // Protects waiting_, fibers_ and the final decrement.
+  std::atomic_flag lock_;
+  Job* waiting_;
+  JobFiber* fibers_;
+};
+
+struct JobStatistics {
+  // Jobs run by the worker.
+  uint64_t executed_;
+  // Jobs taken from other workers' deques.
+  uint64_t stolen_;
+  // Steal attempts, including those finding an empty deque.
+  uint64_t steal_attempts_;
+  // Jobs run right away because the worker's deque was full.
+  uint64_t overflows_;
+  // Times the worker went to sleep for lack of work.
+  uint64_t sleeps_;
+  // Waits that suspended their fiber instead of running other jobs on top.
+  uint64_t suspends_;
+};
+
+// Work-stealing scheduler with one worker per thread. Every worker owns a
+// deque of runnable jobs; it pops jobs from its own deque in LIFO order and,
+// when that is empty, steals the oldest job of a random other worker. The
+// thread creating the system is worker 0.
+//
+// By default, a worker waiting for a counter runs other jobs on top of the
+// waiting one until the counter drops to zero, so deep dependency trees nest
+// deeply on the thread's stack and a waiting job only continues once all jobs
+// run on top of it are done. In fiber mode, the waiting job's fiber is
+// suspended instead and the worker continues with a fresh fiber from a pool;
+// the suspended fiber resumes as soon as the counter drops to zero. Fibers
+// stay on the worker that suspended them, so thread-local data stays valid
+// across a wait. Once the pool is empty, waits fall back to running jobs on
+// top. Fiber stacks have no guard pages; deep recursion inside a job has to
+// fit into fiber_stack_size.
+//
+// Jobs, counters and Wait() must only be used from the threads of the
+// system, i.e. the creating thread and jobs running on the workers.
+class JobSystem {
+ public:
+  // Starts worker_count - 1 threads, or one worker per hardware thread if
+  // worker_count is 0. The worker count is capped at kMaxThreads, since every
+  // worker may take a thread index. Each worker allocates jobs from an arena
+  // of arena_size bytes, which only grows from the heap once exhausted, and
+  // queues up to deque_capacity jobs, which has to be a power of two. A
+  // fiber_count above 0 enables fiber mode with a pool of that many fibers,
+  // whose stacks are carved out of one block.
+  explicit JobSystem(const uint32_t worker_count = 0,
+                     const size_t arena_size = 256 * 1024,
+                     const uint32_t deque_capacity = 4096,
+                     const uint32_t fiber_count = 0,
+                     const size_t fiber_stack_size = 64 * 1024);
+  ~JobSystem();
+
+  // Creates a job calling function with a copy of size bytes of data. If
+  // counter isn't NULL, it is incremented and decremented again once the job
+  // finishes.
+  Job* CreateJob(JobFunction function, const void* data, const size_t size,
+                 JobCounter* counter = NULL);
+
+  template <typename T>
+  Job* CreateJob(JobFunction function, const T& data,
+                 JobCounter* counter = NULL) {
+    static_assert(sizeof(T) <= kJobDataSize, "job data too large");
+    return CreateJob(function, &data, sizeof(T), counter);
+  }
+
+  // Queues job on the calling worker's deque. Runs it right away if the
+  // deque is full.
+  void Run(Job* job);
+
+  // Runs job once dependency drops to zero.
+  void RunAfter(JobCounter* dependency, Job* job);
+
+  // Returns once counter drops to zero. Runs queued jobs meanwhile, or, in
+  // fiber mode, suspends the calling fiber.
+  void Wait(JobCounter* counter);
+
+  // Rewinds all job arenas. Must only be called by worker 0 while no jobs are
+  // pending.
+  void Reset();
+
+  // Returns the index of the calling worker.
+  uint32_t current_worker() const;
+
+  uint32_t worker_count() const { return worker_count_; }
+  uint32_t fiber_count() const { return fiber_count_; }
+  bool fiber_mode() const { return fiber_count_ > 0; }
+
+  // Number of pooled fibers not running or suspended at the moment.
+  uint32_t free_fiber_count() const;
+
+  // Sums the statistics of all workers, or returns those of a single one.
+  JobStatistics statistics() const;
+  JobStatistics statistics(const uint32_t worker) const;
+  void ResetStatistics();
+
+  const LinearAllocator& arena(const uint32_t worker) const;
+
+ private:
+  struct Worker;
+
+  JobSystem(const JobSystem& other);
+  JobSystem& operator=(const JobSystem& other);
+
+  void WorkerMain(Worker* worker);
+  static void FiberMain(void* argument);
+  // Runs jobs and resumes ready fibers until the system stops.
+  void Schedule(Worker* worker);
+  Worker* GetCurrentWorker() const;
+  Job* FindJob(Worker* worker);
+  void Execute(Worker* worker, Job* job);
+  void Finish(JobCounter* counter);
+  void Sleep(Worker* worker);
+  void WakeWorkers();
+
+  JobFiber* AcquireFiber(Worker* worker);
+  void SwitchTo(Worker* worker, JobFiber* fiber);
+  // Completes the switch to the calling fiber by parking or releasing the
+  // fiber that switched to it.
+  void AfterSwitch(Worker* worker);
+  void MakeReady(JobFiber* fiber);
+  JobFiber* PopReady(Worker* worker);
+
+  static thread_local Worker* current_worker_;
+
+  const uint32_t worker_count_;
+  const uint32_t fiber_count_;
+  const size_t fiber_stack_size_;
+  AlignedMemory<kCacheLineSize> arena_memory_;
+  AlignedMemory<kCacheLineSize> worker_memory_;
+  Worker* workers_;
+  std::vector<std::thread> threads_;
+  HeapBlockAllocator block_allocator_;
+
+  AlignedMemory<kCacheLineSize> stack_memory_;
+  JobFiber* fibers_;
+  mutable std::mutex fiber_pool_mutex_;
+  std::vector<JobFiber*> fiber_pool_;
+
+  // Workers without work sleep on wake_condition_ until wake_epoch_ changes.
+  std::atomic<uint32_t> sleeping_;
+  std::atomic<bool> stopping_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_condition_;
+  uint64_t wake_epoch_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_JOB_SYSTEM_H_
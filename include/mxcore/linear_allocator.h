@@ -28,33 +28,125 @@
 #ifndef MXCORE_LINEAR_ALLOCATOR_H_
 #define MXCORE_LINEAR_ALLOCATOR_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace mx {
 namespace core {
 
+// Supplies additional memory blocks to a growing LinearAllocator.
+class BlockAllocator {
+ public:
+  virtual ~BlockAllocator() {}
+
+  virtual void* AllocateBlock(const size_t size) = 0;
+  virtual void FreeBlock(void* block, const size_t size) = 0;
+};
+
+// Takes blocks from the heap, using the tracked allocation macros.
+class HeapBlockAllocator : public BlockAllocator {
+ public:
+  void* AllocateBlock(const size_t size);
+  void FreeBlock(void* block, const size_t size);
+};
+
 // Linear memory allocator. Takes a given chunk of memory and increments a marker
 // pointer that indicates the next free memory address upon every allocation.
 // Memory isn't freed specifically, instead the Rewind() function is used to
 // roll back the marker to a new memory address.
+//
+// A growing allocator chains additional blocks from a BlockAllocator once the
+// current block is exhausted. Rewinding to a marker in an earlier block moves
+// the blocks after it to a spare list, from which they are reused before new
+// blocks are requested.
 class LinearAllocator {
  public:
    LinearAllocator(void* base, const size_t size);
 
-  // Allocates size bytes from the memory pool.
+  // Creates a growing allocator that starts out with base and size (which may
+  // be NULL and 0) and requests blocks of at least block_size bytes from
+  // block_allocator afterwards.
+   LinearAllocator(void* base, const size_t size,
+                   BlockAllocator* block_allocator, const size_t block_size);
+
+   ~LinearAllocator();
+
+  // Allocates size bytes from the memory pool. Returns NULL if a fixed size
+  // pool is exhausted.
    void* Allocate(const size_t size);
 
+  // Allocates size bytes so that the address offset bytes into the allocation
+  // is a multiple of alignment. The offset allows placing a header in front of
+  // an aligned object. alignment has to be a power of two.
+   void* Allocate(const size_t size, const size_t alignment,
+                  const size_t offset = 0);
+
   // Resets the marker to an arbitrary position within the pool's boundaries.
+  // For growing allocators, this may be a position in any block allocated
+  // before the current marker.
    void Rewind(void* to);
 
+  // Forgets the high water mark collected so far.
+   void ResetHighWaterMark();
+
    void* marker() const { return marker_; }
-   size_t size() const { return size_; }
+
+  // Returns the capacity of a fixed size pool. Growing pools have no fixed
+  // limit and return the largest representable size.
+   size_t size() const;
+
+   bool growing() const { return block_allocator_ != NULL; }
+
+  // Number of bytes between the start of the pool and the marker, including
+  // alignment padding but not the unused ends of exhausted blocks.
+   size_t bytes_allocated() const {
+     return previous_bytes_allocated_ + (marker_ - base_);
+   }
+
+  // Highest value of bytes_allocated() since construction or the last call to
+  // ResetHighWaterMark(). Use it to size the initial block.
+   size_t high_water_mark() const;
+
+   uint32_t block_count() const { return block_count_; }
+   uint32_t spare_block_count() const { return spare_block_count_; }
 
  private:
+  // Header in front of every chained block.
+  struct Block {
+    Block* previous_;
+    size_t size_;
+    size_t previous_bytes_allocated_;
+  };
+
+  LinearAllocator(const LinearAllocator& other);
+  LinearAllocator& operator=(const LinearAllocator& other);
+
+  // Continues in a new block large enough for the given allocation.
+   void* Grow(const size_t size, const size_t alignment, const size_t offset);
+
+  // Moves the current block to the spare list and continues in the previous
+  // one.
+   void ReleaseBlock();
+
+   void UpdateHighWaterMark();
+
+   static uint8_t* GetBlockData(Block* block);
+
   const size_t size_;
   uint8_t* base_;
   uint8_t* marker_;
   uint8_t* end_;
+
+  BlockAllocator* block_allocator_;
+  const size_t block_size_;
+  uint8_t* initial_base_;
+  uint8_t* initial_end_;
+  Block* current_block_;
+  Block* spare_blocks_;
+  size_t previous_bytes_allocated_;
+  size_t high_water_mark_;
+  uint32_t block_count_;
+  uint32_t spare_block_count_;
 };
 
 }  // namespace core
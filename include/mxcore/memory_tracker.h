@@ -29,8 +29,16 @@
 #define MXCORE_MEMORY_TRACKER_H_
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
-#include <tr1/unordered_map>
+#include <stdlib.h>
+#include <vector>
+
+// Memory tracking is active in debug builds. Define MX_MEMORY_TRACKING to
+// enable it in optimized builds as well.
+#if defined(_DEBUG) || defined(MX_MEMORY_TRACKING)
+  #define MX_MEMORY_TRACKING_ENABLED 1
+#endif
 
 namespace mx {
 namespace core {
@@ -50,70 +58,141 @@ struct Allocation {
 
 }  // namespace internal
 
+// Aggregated statistics of all allocations made at the same file and line.
+// Live values are signed so that differences between snapshots can be
+// expressed.
+struct CallSiteStatistics {
+  const char* file_;
+  uint32_t line_;
+  int64_t live_bytes_;
+  int64_t live_count_;
+  int64_t peak_bytes_;
+  uint64_t total_count_;
+  uint64_t total_bytes_;
+  double allocation_rate_;
+};
+
+// Allocations are grouped into power-of-two size classes: class 0 holds sizes
+// up to one byte, class n sizes in (2^(n-1), 2^n]. The last class collects
+// everything larger.
+const uint32_t kSizeClassCount = 32;
+
+// Lifetimes of freed allocations are counted in power-of-two buckets of
+// frames: bucket 0 for allocations freed in the frame they were made, bucket
+// n for lifetimes in [2^(n-1), 2^n) frames. The last bucket collects
+// everything longer.
+const uint32_t kLifetimeBucketCount = 16;
+
+struct SizeClassStatistics {
+  uint64_t live_count_;
+  uint64_t live_bytes_;
+  uint64_t total_count_;
+  uint64_t total_bytes_;
+  uint64_t lifetimes_[kLifetimeBucketCount];
+};
+
+struct MemoryHistogram {
+  SizeClassStatistics size_classes_[kSizeClassCount];
+};
+
 // Stores all allocations and allows to generate a report of allocated memory.
-// Use the macros below instead of new or malloc to enable tracking. Memory
-// tracking is only active if _DEBUG is defined.
+// Use the macros below instead of new or malloc to enable tracking.
+//
+// The tracker is thread-safe. Allocations are distributed over a number of
+// shards by their address, each with its own lock and an open addressing hash
+// table, so threads rarely contend. Each shard starts out with a table in
+// static storage, so tracking an allocation doesn't allocate memory until
+// more than a few ten thousand allocations are live. Beyond that, shards add
+// spill tables from the raw heap, which makes lookups slower; call Reserve()
+// up front to avoid them.
+//
+// Allocations are also aggregated per call site. Report() prints the sites
+// holding the most memory; use HeapSnapshot to sort, compare and export them.
+//
+// A histogram of live and cumulative allocations per size class, along with
+// the lifetimes of freed allocations in frames, shows which allocations are
+// candidates for pools, scope stacks or frame arenas. Call NextFrame() once
+// per frame for lifetimes to be meaningful.
 class MemoryTracker {
  public:
   static void* Add(const internal::Allocation& allocation);
   static bool Remove(void* pointer);
   static void Report();
 
-  static size_t bytes_allocated() { return bytes_allocated_; }
-  
+  // Prints every single live allocation.
+  static void ReportAllocations();
+
+  // Returns the current statistics of every call site seen so far. Allocation
+  // rates are left at zero.
+  static void GetCallSites(std::vector<CallSiteStatistics>* sites);
+
+  // Sums up the size class histogram of all shards.
+  static void GetHistogram(MemoryHistogram* histogram);
+
+  // Prints the size class histogram.
+  static void ReportHistogram();
+
+  // Advances the frame counter used to measure allocation lifetimes.
+  static void NextFrame();
+  static uint32_t frame();
+
+  static uint32_t GetSizeClass(const size_t size);
+  static uint32_t GetLifetimeBucket(const uint32_t frames);
+
+  // Makes room for at least count live allocations and merges spill tables.
+  // Not meant to be called while other threads allocate, as it briefly
+  // blocks every shard.
+  static void Reserve(const size_t count);
+
+  static size_t bytes_allocated();
+  static size_t allocation_count();
+
   template <class T>
-  static T* Delete(T* pointer) {
+  static void Delete(T* pointer) {
     delete pointer;
-    return pointer;
   }
 
   template <class T>
-  static T* DeleteArray(T* array) {
+  static void DeleteArray(T* array) {
     delete[] array;
-    return array;
   }
 
   template <class T>
-  static T* Free(T* pointer) {
+  static void Free(T* pointer) {
     free(pointer);
-    return pointer;
   }
-
- private:
-  typedef std::tr1::unordered_map<void*, internal::Allocation> AllocationMap;
-  typedef std::tr1::unordered_map<void*,
-          internal::Allocation>::value_type AllocationTuple;
-  typedef std::tr1::unordered_map<void*,
-          internal::Allocation>::iterator AllocationIterator;
-
-  static size_t bytes_allocated_;
-  static AllocationMap allocations_;
 };
 
 }  // namespace core
 }  // namespace mx
 
-#ifdef _DEBUG
+// The release macros remove the allocation from the tracker before the memory
+// is returned, otherwise another thread could get the same address and add it
+// while it's still tracked.
+#ifdef MX_MEMORY_TRACKING_ENABLED
   #define mxnew(type, constructor) reinterpret_cast< type *>( \
       mx::core::MemoryTracker::Add(mx::core::internal::Allocation(new type constructor, \
                                                                   __FILE__, \
                                                                   __LINE__, \
                                                                   sizeof( type ))))
-  #define mxdelete(pointer) { if (!mx::core::MemoryTracker::Remove( \
-              mx::core::MemoryTracker::Delete((pointer)))) assert(false && #pointer); }
+  #define mxdelete(pointer) { if (!mx::core::MemoryTracker::Remove((pointer))) { \
+              assert(false && #pointer); } \
+              mx::core::MemoryTracker::Delete((pointer)); }
 
   #define mxnew_array(type, size) reinterpret_cast< type *>( \
       mx::core::MemoryTracker::Add(mx::core::internal::Allocation(new type [ size ], \
                                                                   __FILE__, \
                                                                   __LINE__, \
                                                                   sizeof( type ) * (size))))
-  #define mxdelete_array(pointer) { if (!mx::core::MemoryTracker::Remove( \
-              mx::core::MemoryTracker::DeleteArray((pointer)))) assert(false && #pointer); }
+  #define mxdelete_array(pointer) { if (!mx::core::MemoryTracker::Remove((pointer))) { \
+              assert(false && #pointer); } \
+              mx::core::MemoryTracker::DeleteArray((pointer)); }
   
   #define mxalloc(size) mx::core::MemoryTracker::Add(mx::core::internal::Allocation( \
           malloc((size)), __FILE__, __LINE__, (size)))
-  #define mxfree(pointer) { if (!mx::core::MemoryTracker::Remove( \
-              mx::core::MemoryTracker::Free((pointer)))) assert(false && #pointer); }
+  #define mxfree(pointer) { if (!mx::core::MemoryTracker::Remove((pointer))) { \
+              assert(false && #pointer); } \
+              mx::core::MemoryTracker::Free((pointer)); }
 #else
   #define mxnew(type, constructor) new type constructor
   #define mxdelete(pointer) delete pointer
@@ -0,0 +1,175 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_MPMC_QUEUE_H_
+#define MXCORE_MPMC_QUEUE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include "mxcore/alignment.h"
+
+namespace mx {
+namespace core {
+
+// Bounded lock-free queue for any number of producers and consumers, after
+// Dmitry Vyukov's design. Every cell carries a sequence number telling
+// whether it is ready for the producer or the consumer of a given position,
+// so a push or pop is one compare-and-swap on a position plus one store to
+// the cell. The queue works in memory provided by the caller, e.g. from
+// AlignedMemory, and never allocates. T has to be default constructible and
+// assignable.
+template <typename T>
+class MpmcQueue {
+ public:
+  // Bytes of memory needed for capacity elements.
+  static size_t memory_size(const uint32_t capacity) {
+    return sizeof(Cell) * capacity;
+  }
+
+  // memory has to hold memory_size(capacity) bytes aligned for T. capacity
+  // has to be a power of two.
+  MpmcQueue(void* memory, const uint32_t capacity);
+  ~MpmcQueue();
+
+  // Returns false if the queue is full.
+  bool Push(const T& value);
+
+  // Returns false if the queue is empty.
+  bool Pop(T* value);
+
+  // Number of queued elements. Only a snapshot while other threads use the
+  // queue.
+  uint32_t size() const;
+  uint32_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence_;
+    T value_;
+  };
+
+  MpmcQueue(const MpmcQueue& other);
+  MpmcQueue& operator=(const MpmcQueue& other);
+
+  Cell* const cells_;
+  const uint32_t mask_;
+  // Producers and consumers each get a cache line of their own.
+  alignas(kCacheLineSize) std::atomic<size_t> push_position_;
+  alignas(kCacheLineSize) std::atomic<size_t> pop_position_;
+};
+
+template <typename T>
+MpmcQueue<T>::MpmcQueue(void* memory, const uint32_t capacity)
+    : cells_(reinterpret_cast<Cell*>(memory)),
+      mask_(capacity - 1),
+      push_position_(0),
+      pop_position_(0) {
+  assert(IsPowerOfTwo(capacity));
+  assert(IsAligned(memory, alignof(Cell)));
+  for (uint32_t i = 0; i < capacity; ++i) {
+    new(&cells_[i]) Cell();
+    cells_[i].sequence_.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+MpmcQueue<T>::~MpmcQueue() {
+  for (uint32_t i = 0; i <= mask_; ++i) {
+    cells_[i].~Cell();
+  }
+}
+
+template <typename T>
+bool MpmcQueue<T>::Push(const T& value) {
+  size_t position = push_position_.load(std::memory_order_relaxed);
+  Cell* cell;
+  for (;;) {
+    cell = &cells_[position & mask_];
+    const size_t sequence = cell->sequence_.load(std::memory_order_acquire);
+    const intptr_t difference = static_cast<intptr_t>(sequence) -
+                                static_cast<intptr_t>(position);
+    if (difference == 0) {
+      // The cell is free for this position; claim it.
+      if (push_position_.compare_exchange_weak(position, position + 1,
+                                               std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The consumer of the previous round hasn't taken the cell yet.
+      return false;
+    } else {
+      position = push_position_.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->value_ = value;
+  cell->sequence_.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool MpmcQueue<T>::Pop(T* value) {
+  size_t position = pop_position_.load(std::memory_order_relaxed);
+  Cell* cell;
+  for (;;) {
+    cell = &cells_[position & mask_];
+    const size_t sequence = cell->sequence_.load(std::memory_order_acquire);
+    const intptr_t difference = static_cast<intptr_t>(sequence) -
+                                static_cast<intptr_t>(position + 1);
+    if (difference == 0) {
+      if (pop_position_.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // No producer has filled the cell for this position yet.
+      return false;
+    } else {
+      position = pop_position_.load(std::memory_order_relaxed);
+    }
+  }
+
+  *value = cell->value_;
+  // Hands the cell to the producer of the next round.
+  cell->sequence_.store(position + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+uint32_t MpmcQueue<T>::size() const {
+  const size_t pushed = push_position_.load(std::memory_order_relaxed);
+  const size_t popped = pop_position_.load(std::memory_order_relaxed);
+  return (pushed > popped) ? static_cast<uint32_t>(pushed - popped) : 0;
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_MPMC_QUEUE_H_
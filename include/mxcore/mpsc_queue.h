@@ -0,0 +1,136 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_MPSC_QUEUE_H_
+#define MXCORE_MPSC_QUEUE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include "mxcore/alignment.h"
+
+namespace mx {
+namespace core {
+
+// Link embedded in the elements of an MpscQueue.
+struct MpscNode {
+  std::atomic<MpscNode*> next_;
+};
+
+// Unbounded intrusive queue for any number of producers and one consumer,
+// after Dmitry Vyukov's design. Elements derive from MpscNode and are linked
+// in place, so the queue never allocates; an element must stay alive and
+// must not be pushed again until it is popped. Push() is a single atomic
+// exchange and wait-free. Pop() is lock-free but may report an empty queue
+// while a producer is between its exchange and linking its element.
+template <typename T>
+class MpscQueue {
+ public:
+  MpscQueue();
+
+  // Safe to call from any thread.
+  void Push(T* element);
+
+  // Returns NULL if the queue is empty. Must only be called by the consumer.
+  T* Pop();
+
+  // True if nothing is queued. Must only be called by the consumer.
+  bool empty() const;
+
+ private:
+  MpscQueue(const MpscQueue& other);
+  MpscQueue& operator=(const MpscQueue& other);
+
+  void PushNode(MpscNode* node);
+
+  // Written by the producers.
+  alignas(kCacheLineSize) std::atomic<MpscNode*> head_;
+  // Owned by the consumer.
+  alignas(kCacheLineSize) MpscNode* tail_;
+  // Placeholder that keeps the list from ever being empty.
+  MpscNode stub_;
+};
+
+template <typename T>
+MpscQueue<T>::MpscQueue() : head_(&stub_), tail_(&stub_) {
+  stub_.next_.store(NULL, std::memory_order_relaxed);
+}
+
+template <typename T>
+void MpscQueue<T>::Push(T* element) {
+  PushNode(static_cast<MpscNode*>(element));
+}
+
+template <typename T>
+T* MpscQueue<T>::Pop() {
+  MpscNode* tail = tail_;
+  MpscNode* next = tail->next_.load(std::memory_order_acquire);
+  if (tail == &stub_) {
+    if (next == NULL) {
+      return NULL;
+    }
+    tail_ = tail = next;
+    next = next->next_.load(std::memory_order_acquire);
+  }
+
+  if (next != NULL) {
+    tail_ = next;
+    return static_cast<T*>(tail);
+  }
+
+  // tail is the last linked element. If a producer already swapped in a
+  // newer one but hasn't linked it yet, report the queue as empty for now.
+  if (tail != head_.load(std::memory_order_acquire)) {
+    return NULL;
+  }
+
+  // Puts the stub behind tail, so that tail can be handed out.
+  PushNode(&stub_);
+  next = tail->next_.load(std::memory_order_acquire);
+  if (next != NULL) {
+    tail_ = next;
+    return static_cast<T*>(tail);
+  }
+  return NULL;
+}
+
+template <typename T>
+bool MpscQueue<T>::empty() const {
+  return tail_ == &stub_ &&
+         stub_.next_.load(std::memory_order_acquire) == NULL;
+}
+
+template <typename T>
+void MpscQueue<T>::PushNode(MpscNode* node) {
+  node->next_.store(NULL, std::memory_order_relaxed);
+  MpscNode* previous = head_.exchange(node, std::memory_order_acq_rel);
+  previous->next_.store(node, std::memory_order_release);
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_MPSC_QUEUE_H_
@@ -0,0 +1,328 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_PARALLEL_H_
+#define MXCORE_PARALLEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include "mxcore/job_system.h"
+#include "mxcore/scope_stack.h"
+
+namespace mx {
+namespace core {
+
+// Elements below which a range isn't split unless the caller asks for a
+// smaller grain size.
+const size_t kMinGrainSize = 1024;
+
+// Ranges created per worker when the grain size is chosen automatically.
+// More ranges than workers let stealing even out uneven work.
+const size_t kRangesPerWorker = 8;
+
+// Returns grain if it isn't 0. Otherwise splits count elements into
+// kRangesPerWorker ranges per worker of at least kMinGrainSize elements, or
+// keeps them in one range if there is a single worker.
+inline size_t SelectGrainSize(const JobSystem& system, const size_t count,
+                              const size_t grain) {
+  if (grain > 0) {
+    return grain;
+  }
+  if (system.worker_count() == 1) {
+    return (count > 0) ? count : 1;
+  }
+  const size_t size = count / (system.worker_count() * kRangesPerWorker);
+  return (size > kMinGrainSize) ? size : kMinGrainSize;
+}
+
+// Calls body(first, last) for disjoint ranges covering [first, last) of at
+// most grain elements, in parallel, and returns once all calls returned.
+// The jobs are allocated from the calling worker's arena, so a frame running
+// many loops should call JobSystem::Reset() at its end.
+template <typename Body>
+void ParallelFor(JobSystem* system, const size_t first, const size_t last,
+                 const Body& body, const size_t grain = 0);
+
+// Reduces [first, last): body(first, last) returns the value of a range,
+// combine(a, b) merges the values of two adjacent ranges. Values are always
+// combined in the same tree for a given grain size, so the result doesn't
+// depend on scheduling even if combine isn't associative, e.g. for floats.
+template <typename T, typename Body, typename Combine>
+T ParallelReduce(JobSystem* system, const size_t first, const size_t last,
+                 const T& identity, const Body& body, const Combine& combine,
+                 const size_t grain = 0);
+
+// Writes the inclusive scan of count elements of input under op to output,
+// which may equal input. op has to be associative. Unless everything fits
+// into one range, the ranges are summed up and scanned in two passes; the
+// range totals are allocated from scope.
+template <typename T, typename Op>
+void ParallelScan(JobSystem* system, const T* input, T* output,
+                  const size_t count, const T& identity, const Op& op,
+                  ScopeStack& scope, const size_t grain = 0);
+
+// Copies the elements of input for which predicate(element) is true to
+// output, keeping their order, and returns their number. output must not
+// overlap input. With more than one range, counts the elements of each
+// range in a first pass and copies them in a second one, so predicate is
+// called twice per element. The range counts are allocated from scope.
+template <typename T, typename Predicate>
+size_t ParallelCompact(JobSystem* system, const T* input, const size_t count,
+                       T* output, const Predicate& predicate,
+                       ScopeStack& scope, const size_t grain = 0);
+
+namespace internal {
+
+template <typename Body>
+struct ForRange {
+  const Body* body_;
+  size_t first_;
+  size_t last_;
+  size_t grain_;
+};
+
+// Hands the upper halves of the range to other workers and keeps splitting
+// the lower one.
+template <typename Body>
+void RunForRange(JobSystem* system, void* data) {
+  ForRange<Body> range = *reinterpret_cast<ForRange<Body>*>(data);
+  JobCounter counter;
+  while (range.last_ - range.first_ > range.grain_) {
+    const size_t middle = range.first_ + (range.last_ - range.first_) / 2;
+    ForRange<Body> upper = { range.body_, middle, range.last_, range.grain_ };
+    system->Run(system->CreateJob(RunForRange<Body>, upper, &counter));
+    range.last_ = middle;
+  }
+  (*range.body_)(range.first_, range.last_);
+  system->Wait(&counter);
+}
+
+template <typename T, typename Body, typename Combine>
+struct ReduceContext {
+  const T* identity_;
+  const Body* body_;
+  const Combine* combine_;
+  size_t grain_;
+};
+
+template <typename T, typename Body, typename Combine>
+struct ReduceRange {
+  const ReduceContext<T, Body, Combine>* context_;
+  T* result_;
+  size_t first_;
+  size_t last_;
+};
+
+template <typename T, typename Body, typename Combine>
+void RunReduceRange(JobSystem* system, void* data) {
+  const ReduceRange<T, Body, Combine>& range =
+      *reinterpret_cast<ReduceRange<T, Body, Combine>*>(data);
+  const ReduceContext<T, Body, Combine>& context = *range.context_;
+  if (range.last_ - range.first_ <= context.grain_) {
+    *range.result_ = (*context.body_)(range.first_, range.last_);
+    return;
+  }
+
+  const size_t middle = range.first_ + (range.last_ - range.first_) / 2;
+  T lower_result(*context.identity_);
+  T upper_result(*context.identity_);
+  ReduceRange<T, Body, Combine> lower = {
+    &context, &lower_result, range.first_, middle
+  };
+  ReduceRange<T, Body, Combine> upper = {
+    &context, &upper_result, middle, range.last_
+  };
+  JobCounter counter;
+  system->Run(system->CreateJob(RunReduceRange<T, Body, Combine>, upper,
+                                &counter));
+  RunReduceRange<T, Body, Combine>(system, &lower);
+  system->Wait(&counter);
+  *range.result_ = (*context.combine_)(lower_result, upper_result);
+}
+
+// Number of grain-sized ranges covering count elements.
+inline size_t RangeCount(const size_t count, const size_t grain) {
+  return (count + grain - 1) / grain;
+}
+
+}  // namespace internal
+
+template <typename Body>
+void ParallelFor(JobSystem* system, const size_t first, const size_t last,
+                 const Body& body, const size_t grain) {
+  if (first >= last) {
+    return;
+  }
+
+  const size_t size = SelectGrainSize(*system, last - first, grain);
+  if (last - first <= size) {
+    body(first, last);
+    return;
+  }
+
+  internal::ForRange<Body> range = { &body, first, last, size };
+  internal::RunForRange<Body>(system, &range);
+}
+
+template <typename T, typename Body, typename Combine>
+T ParallelReduce(JobSystem* system, const size_t first, const size_t last,
+                 const T& identity, const Body& body, const Combine& combine,
+                 const size_t grain) {
+  if (first >= last) {
+    return identity;
+  }
+
+  const internal::ReduceContext<T, Body, Combine> context = {
+    &identity, &body, &combine,
+    SelectGrainSize(*system, last - first, grain)
+  };
+  T result(identity);
+  internal::ReduceRange<T, Body, Combine> range = {
+    &context, &result, first, last
+  };
+  internal::RunReduceRange<T, Body, Combine>(system, &range);
+  return result;
+}
+
+template <typename T, typename Op>
+void ParallelScan(JobSystem* system, const T* input, T* output,
+                  const size_t count, const T& identity, const Op& op,
+                  ScopeStack& scope, const size_t grain) {
+  if (count == 0) {
+    return;
+  }
+
+  const size_t size = SelectGrainSize(*system, count, grain);
+  const size_t range_count = internal::RangeCount(count, size);
+  if (range_count == 1) {
+    T running(identity);
+    for (size_t i = 0; i < count; ++i) {
+      running = op(running, input[i]);
+      output[i] = running;
+    }
+    return;
+  }
+
+  T* totals = reinterpret_cast<T*>(
+      scope.NewRaw(sizeof(T) * range_count, alignof(T)));
+
+  ParallelFor(system, 0, range_count, [&](size_t first, size_t last) {
+    for (size_t range = first; range < last; ++range) {
+      const size_t end = (range + 1) * size < count ? (range + 1) * size :
+                                                      count;
+      T total(identity);
+      for (size_t i = range * size; i < end; ++i) {
+        total = op(total, input[i]);
+      }
+      new(&totals[range]) T(total);
+    }
+  }, 1);
+
+  // Turns the totals into the exclusive prefix of every range.
+  T prefix(identity);
+  for (size_t range = 0; range < range_count; ++range) {
+    const T total(totals[range]);
+    totals[range] = prefix;
+    prefix = op(prefix, total);
+  }
+
+  ParallelFor(system, 0, range_count, [&](size_t first, size_t last) {
+    for (size_t range = first; range < last; ++range) {
+      const size_t end = (range + 1) * size < count ? (range + 1) * size :
+                                                      count;
+      T running(totals[range]);
+      for (size_t i = range * size; i < end; ++i) {
+        running = op(running, input[i]);
+        output[i] = running;
+      }
+    }
+  }, 1);
+}
+
+template <typename T, typename Predicate>
+size_t ParallelCompact(JobSystem* system, const T* input, const size_t count,
+                       T* output, const Predicate& predicate,
+                       ScopeStack& scope, const size_t grain) {
+  if (count == 0) {
+    return 0;
+  }
+
+  const size_t size = SelectGrainSize(*system, count, grain);
+  const size_t range_count = internal::RangeCount(count, size);
+  if (range_count == 1) {
+    T* destination = output;
+    for (size_t i = 0; i < count; ++i) {
+      if (predicate(input[i])) {
+        *destination++ = input[i];
+      }
+    }
+    return destination - output;
+  }
+
+  size_t* offsets = reinterpret_cast<size_t*>(
+      scope.NewRaw(sizeof(size_t) * range_count, alignof(size_t)));
+
+  ParallelFor(system, 0, range_count, [&](size_t first, size_t last) {
+    for (size_t range = first; range < last; ++range) {
+      const size_t end = (range + 1) * size < count ? (range + 1) * size :
+                                                      count;
+      size_t kept = 0;
+      for (size_t i = range * size; i < end; ++i) {
+        kept += predicate(input[i]) ? 1 : 0;
+      }
+      offsets[range] = kept;
+    }
+  }, 1);
+
+  size_t total = 0;
+  for (size_t range = 0; range < range_count; ++range) {
+    const size_t kept = offsets[range];
+    offsets[range] = total;
+    total += kept;
+  }
+
+  ParallelFor(system, 0, range_count, [&](size_t first, size_t last) {
+    for (size_t range = first; range < last; ++range) {
+      const size_t end = (range + 1) * size < count ? (range + 1) * size :
+                                                      count;
+      T* destination = output + offsets[range];
+      for (size_t i = range * size; i < end; ++i) {
+        if (predicate(input[i])) {
+          *destination++ = input[i];
+        }
+      }
+    }
+  }, 1);
+
+  return total;
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_PARALLEL_H_
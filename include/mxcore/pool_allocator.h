@@ -0,0 +1,176 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_POOL_ALLOCATOR_H_
+#define MXCORE_POOL_ALLOCATOR_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <new>
+#include "mxcore/aligned_memory.h"
+#include "mxcore/alignment.h"
+#include "mxcore/memory_tracker.h"
+
+namespace mx {
+namespace core {
+
+// Hands out blocks of a fixed size in O(1). Free blocks are kept in an
+// intrusive singly linked list, so the pool needs no memory besides the blocks
+// themselves. Memory is requested a page of blocks_per_page blocks at a time
+// and only returned to the heap when the pool is destroyed. Pages start on a
+// cache line; pass kCacheLineSize as alignment to put every block on a cache
+// line of its own.
+//
+// The pool isn't thread-safe unless it's created with thread caches. Then every
+// thread allocates from and frees to a small private free list, which is
+// refilled from or drained to the shared list in batches under a lock.
+//
+// Pages come from the untracked heap. Use mxpoolnew and mxpooldelete to make
+// pooled objects show up in MemoryTracker reports.
+class FixedBlockPool {
+ public:
+  FixedBlockPool(const size_t block_size, const size_t alignment,
+                 const uint32_t blocks_per_page,
+                 const bool thread_caches = false);
+  ~FixedBlockPool();
+
+  void* Allocate();
+  void Free(void* pointer);
+
+  // Size of a block including alignment padding.
+  size_t block_size() const { return block_size_; }
+  uint32_t blocks_per_page() const { return blocks_per_page_; }
+  uint32_t page_count() const { return page_count_; }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next_;
+  };
+
+  struct Page {
+    Page* next_;
+  };
+
+  // A thread's private free list, padded to avoid false sharing.
+  struct ThreadCache {
+    FreeBlock* head_;
+    uint32_t count_;
+    uint8_t padding_[kCacheLineSize - sizeof(FreeBlock*) - sizeof(uint32_t)];
+  };
+
+  FixedBlockPool(const FixedBlockPool& other);
+  FixedBlockPool& operator=(const FixedBlockPool& other);
+
+  // Allocates a page and puts all of its blocks on the shared free list.
+  void AddPage();
+
+  void Refill(ThreadCache& cache);
+  void Drain(ThreadCache& cache);
+
+  const size_t block_size_;
+  const uint32_t blocks_per_page_;
+  FreeBlock* free_list_;
+  Page* pages_;
+  uint32_t page_count_;
+  const size_t page_alignment_;
+  ThreadCache* thread_caches_;
+  AlignedMemory<kCacheLineSize>* thread_cache_memory_;
+  std::mutex mutex_;
+};
+
+// Typed interface to a FixedBlockPool.
+template <class T>
+class PoolAllocator {
+ public:
+  explicit PoolAllocator(const uint32_t objects_per_page = 256,
+                         const bool thread_caches = false,
+                         const size_t alignment = alignof(T))
+      : pool_(sizeof(T), alignment, objects_per_page, thread_caches) {}
+
+  // Returns uninitialized memory for one T.
+  void* Allocate() { return pool_.Allocate(); }
+
+  // Returns memory to the pool without calling the destructor.
+  void Free(T* pointer) { pool_.Free(pointer); }
+
+  // Destructs the object and returns its memory to the pool.
+  T* Delete(T* pointer) {
+    pointer->~T();
+    pool_.Free(pointer);
+    return pointer;
+  }
+
+  FixedBlockPool& pool() { return pool_; }
+
+ private:
+  FixedBlockPool pool_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  #define mxpoolnew(pool, type, constructor) reinterpret_cast< type *>( \
+      mx::core::MemoryTracker::Add(mx::core::internal::Allocation( \
+          new((pool).Allocate()) type constructor, __FILE__, __LINE__, \
+          sizeof( type ))))
+  #define mxpooldelete(pool, pointer) { if (!mx::core::MemoryTracker::Remove( \
+              (pointer))) { assert(false && #pointer); } \
+              (pool).Delete((pointer)); }
+#else
+  #define mxpoolnew(pool, type, constructor) new((pool).Allocate()) type constructor
+  #define mxpooldelete(pool, pointer) (pool).Delete((pointer))
+#endif
+
+namespace mx {
+namespace core {
+
+// SmartPointer deleter returning objects created with mxpoolnew to their
+// pool.
+template <class T>
+class PoolDeleter {
+ public:
+  PoolDeleter() : pool_(NULL) {}
+  explicit PoolDeleter(PoolAllocator<T>* pool) : pool_(pool) {}
+
+  void operator()(T* pointer) const {
+    assert(pool_ != NULL);
+    mxpooldelete(*pool_, pointer);
+  }
+
+  PoolAllocator<T>* pool() const { return pool_; }
+
+ private:
+  PoolAllocator<T>* pool_;
+};
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_POOL_ALLOCATOR_H_
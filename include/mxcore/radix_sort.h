@@ -0,0 +1,111 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_RADIX_SORT_H_
+#define MXCORE_RADIX_SORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+namespace mx {
+namespace core {
+
+// Digit histograms used by RadixSort(). They take about 96 KB, too much for
+// the stack of a fiber or worker thread, so callers keep them around along
+// with their scratch buffer.
+struct RadixSortHistograms {
+  static const uint32_t kDigitBits = 11;
+  static const uint32_t kDigits = (64 + kDigitBits - 1) / kDigitBits;
+  static const uint32_t kBuckets = 1 << kDigitBits;
+
+  size_t counts_[kDigits][kBuckets];
+};
+
+// Sorts items by a 64 bit key using a stable least significant digit radix
+// sort with 11 bit digits, which takes six passes for full 64 bit keys.
+// key_of(item) returns the key of an item. The result ends up in items;
+// scratch has to hold count items as well.
+//
+// Histograms for all digits are built in a single pass. Digits that are equal
+// for all items are skipped, so sorting keys that only use a few bits costs
+// only a few passes.
+template <class T, class KeyOf>
+void RadixSort(T* items, T* scratch, const size_t count, KeyOf key_of,
+               RadixSortHistograms* histograms) {
+  const uint32_t kDigitBits = RadixSortHistograms::kDigitBits;
+  const uint32_t kDigits = RadixSortHistograms::kDigits;
+  const uint32_t kBuckets = RadixSortHistograms::kBuckets;
+
+  memset(histograms->counts_, 0, sizeof(histograms->counts_));
+
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t key = key_of(items[i]);
+    for (uint32_t digit = 0; digit < kDigits; ++digit) {
+      ++histograms->counts_[digit][(key >> (digit * kDigitBits)) &
+                                   (kBuckets - 1)];
+    }
+  }
+
+  T* source = items;
+  T* destination = scratch;
+
+  for (uint32_t digit = 0; digit < kDigits; ++digit) {
+    size_t* histogram = histograms->counts_[digit];
+    const uint32_t shift = digit * kDigitBits;
+
+    if (count == 0 ||
+        histogram[(key_of(source[0]) >> shift) & (kBuckets - 1)] == count) {
+      continue;
+    }
+
+    // Turn the histogram into bucket offsets.
+    size_t offset = 0;
+    for (uint32_t bucket = 0; bucket < kBuckets; ++bucket) {
+      size_t bucket_count = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucket_count;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t bucket = (key_of(source[i]) >> shift) & (kBuckets - 1);
+      destination[histogram[bucket]++] = source[i];
+    }
+
+    std::swap(source, destination);
+  }
+
+  if (source != items) {
+    std::copy(source, source + count, items);
+  }
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_RADIX_SORT_H_
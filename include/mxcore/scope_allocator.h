@@ -64,7 +64,8 @@ class scope_allocator {
   size_type max_size() const { return scope_.size() / sizeof(value_type); }
   
   pointer allocate(size_type n, const void* q = NULL) {
-    return reinterpret_cast<pointer>(scope_.NewRaw(n * sizeof(value_type)));
+    return reinterpret_cast<pointer>(scope_.NewRaw(n * sizeof(value_type),
+                                                   alignof(value_type)));
   }
   
   void construct(pointer p, const value_type& v) { new(p) value_type(v); }
@@ -72,10 +72,11 @@ class ScopeStack {
   }
 
   // Allocates and constructs an object and adds a call to the desctructor to
-  // the front of the finalizer chain.
+  // the front of the finalizer chain. The object is aligned to alignment bytes,
+  // the finalizer is placed directly in front of it.
   template <class T>
-   T* NewWithFinalizer() {
-    Finalizer* finalizer = AllocateWithFinalizer(sizeof(T));
+   T* NewWithFinalizer(const size_t alignment = alignof(T)) {
+    Finalizer* finalizer = AllocateWithFinalizer(sizeof(T), alignment);
     T* result = new(GetObjectFromFinalizer(finalizer)) T;
 
     finalizer->function_ = &CallDestructor<T>;
@@ -89,8 +90,8 @@ class ScopeStack {
   // finalizer list. Use this for structs and objects that don't need to clean
   // up.
   template <class T>
-   T* NewObject() const {
-    return new(allocator_.Allocate(sizeof(T))) T;
+   T* NewObject(const size_t alignment = alignof(T)) const {
+    return new(allocator_.Allocate(sizeof(T), alignment)) T;
   }
 
   // Allocate a chunk of raw memory from the underlying linear allocator.
@@ -98,6 +99,11 @@ class ScopeStack {
     return allocator_.Allocate(size);
   }
 
+  // Allocate a chunk of raw memory aligned to alignment bytes.
+   void* NewRaw(const size_t size, const size_t alignment) const {
+    return allocator_.Allocate(size, alignment);
+  }
+
    size_t size() const { return allocator_.size(); }
 
  private:
@@ -108,9 +114,15 @@ class ScopeStack {
   }
 
   // To ensure a proper teardown, a Finalizer object is prepended to the actual
-  // object. Allocates enough memory for object and finalizer.
-   Finalizer* AllocateWithFinalizer(const size_t size) const {
-    return reinterpret_cast<Finalizer*>(allocator_.Allocate(size + sizeof(Finalizer)));
+  // object. Allocates enough memory for object and finalizer and pads the
+  // allocation so that the object, not the finalizer, ends up aligned.
+   Finalizer* AllocateWithFinalizer(const size_t size,
+                                    const size_t alignment) const {
+    size_t finalizer_alignment = alignof(Finalizer);
+    return reinterpret_cast<Finalizer*>(allocator_.Allocate(
+        size + sizeof(Finalizer),
+        alignment > finalizer_alignment ? alignment : finalizer_alignment,
+        sizeof(Finalizer)));
   }
 
   LinearAllocator& allocator_;
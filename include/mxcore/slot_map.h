@@ -0,0 +1,203 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_SLOT_MAP_H_
+#define MXCORE_SLOT_MAP_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace mx {
+namespace core {
+
+// Container handing out 32 bit handles to its elements instead of pointers.
+// A handle holds the index of a slot in its low kIndexBits bits and the
+// generation of the slot in the remaining bits. Erasing an element bumps the
+// generation of its slot, so handles to erased elements are detected by
+// Get() instead of aliasing the next element stored in the slot.
+//
+// The elements are packed at the front of one array in no particular order,
+// so iterating over them never touches holes. Erasing moves the last element
+// into the hole, which keeps inserting and erasing O(1) but means pointers
+// to elements are only valid until the next call to Insert() or Erase();
+// store handles instead. Free slots are reused in the order they were freed,
+// and a slot is retired once its generation runs out, so a stale handle never
+// matches a live element.
+//
+// Handle 0 is never returned and can be used as a null handle.
+template <typename T>
+class SlotMap {
+ public:
+  typedef uint32_t Handle;
+
+  static const uint32_t kIndexBits = 20;
+  static const uint32_t kGenerationBits = 32 - kIndexBits;
+  static const uint32_t kMaxSlots = 1 << kIndexBits;
+  static const Handle kNullHandle = 0;
+
+  SlotMap() : free_head_(kNoSlot), free_tail_(kNoSlot) {}
+
+  void Reserve(const size_t capacity) {
+    values_.reserve(capacity);
+    dense_slots_.reserve(capacity);
+    slots_.reserve(capacity);
+  }
+
+  // Returns kNullHandle if all slots are in use or retired.
+  Handle Insert(const T& value);
+
+  // Returns false if the handle doesn't refer to an element.
+  bool Erase(const Handle handle);
+
+  // Erases all elements. Existing handles stay invalid.
+  void Clear();
+
+  // Returns NULL if the handle doesn't refer to an element.
+  T* Get(const Handle handle) {
+    const uint32_t index = handle & (kMaxSlots - 1);
+    if (index >= slots_.size() ||
+        slots_[index].generation_ != (handle >> kIndexBits)) {
+      return NULL;
+    }
+    return &values_[slots_[index].dense_];
+  }
+  const T* Get(const Handle handle) const {
+    return const_cast<SlotMap*>(this)->Get(handle);
+  }
+
+  bool Contains(const Handle handle) const { return Get(handle) != NULL; }
+
+  size_t size() const { return values_.size(); }
+  bool empty() const { return values_.empty(); }
+
+  // The packed elements, e.g. for iterating over all of them.
+  T* data() { return values_.empty() ? NULL : &values_[0]; }
+  const T* data() const { return values_.empty() ? NULL : &values_[0]; }
+
+  // Returns the handle of the element at a position of data().
+  Handle handle(const size_t position) const {
+    const uint32_t index = dense_slots_[position];
+    return MakeHandle(index, slots_[index].generation_);
+  }
+
+ private:
+  static const uint32_t kNoSlot = 0xffffffff;
+  static const uint32_t kMaxGeneration = (1 << kGenerationBits) - 1;
+  // Set in the generation of free and retired slots, so no handle matches
+  // them.
+  static const uint32_t kFree = 0x80000000;
+
+  // Live slots hold the position of their element in values_, free slots
+  // the next free slot.
+  struct Slot {
+    uint32_t dense_;
+    uint32_t generation_;
+  };
+
+  static Handle MakeHandle(const uint32_t index, const uint32_t generation) {
+    return (generation << kIndexBits) | index;
+  }
+
+  std::vector<T> values_;
+  // The slot of every element in values_.
+  std::vector<uint32_t> dense_slots_;
+  std::vector<Slot> slots_;
+  uint32_t free_head_;
+  uint32_t free_tail_;
+};
+
+template <typename T>
+typename SlotMap<T>::Handle SlotMap<T>::Insert(const T& value) {
+  uint32_t index = free_head_;
+  if (index != kNoSlot) {
+    free_head_ = slots_[index].dense_;
+    if (free_head_ == kNoSlot) {
+      free_tail_ = kNoSlot;
+    }
+    slots_[index].generation_ &= ~kFree;
+  } else if (slots_.size() < kMaxSlots) {
+    // Generations start at 1, so no handle is 0.
+    index = static_cast<uint32_t>(slots_.size());
+    const Slot slot = {0, 1};
+    slots_.push_back(slot);
+  } else {
+    return kNullHandle;
+  }
+
+  Slot& slot = slots_[index];
+  slot.dense_ = static_cast<uint32_t>(values_.size());
+  values_.push_back(value);
+  dense_slots_.push_back(index);
+  return MakeHandle(index, slot.generation_);
+}
+
+template <typename T>
+bool SlotMap<T>::Erase(const Handle handle) {
+  if (Get(handle) == NULL) {
+    return false;
+  }
+
+  const uint32_t index = handle & (kMaxSlots - 1);
+  Slot& slot = slots_[index];
+  const uint32_t last = static_cast<uint32_t>(values_.size()) - 1;
+  if (slot.dense_ != last) {
+    values_[slot.dense_] = std::move(values_[last]);
+    dense_slots_[slot.dense_] = dense_slots_[last];
+    slots_[dense_slots_[last]].dense_ = slot.dense_;
+  }
+  values_.pop_back();
+  dense_slots_.pop_back();
+
+  if (slot.generation_ == kMaxGeneration) {
+    slot.generation_ = kFree;
+    return true;
+  }
+  slot.generation_ = (slot.generation_ + 1) | kFree;
+  slot.dense_ = kNoSlot;
+  if (free_tail_ == kNoSlot) {
+    free_head_ = index;
+  } else {
+    slots_[free_tail_].dense_ = index;
+  }
+  free_tail_ = index;
+  return true;
+}
+
+template <typename T>
+void SlotMap<T>::Clear() {
+  while (!values_.empty()) {
+    Erase(handle(values_.size() - 1));
+  }
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_SLOT_MAP_H_
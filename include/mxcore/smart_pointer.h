@@ -28,34 +28,76 @@
 #ifndef MXCORE_SMART_POINTER_H_
 #define MXCORE_SMART_POINTER_H_
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mxcore/memory_tracker.h"
+
 namespace mx {
 namespace core {
 
+template <class T, class Deleter> class WeakPointer;
+
+// Deletes pointees created with new.
+template <class T>
+struct DefaultDeleter {
+  void operator()(T* pointer) const {
+    delete pointer;
+  }
+};
+
+// Deletes pointees created with mxnew, so they are removed from the
+// MemoryTracker.
+template <class T>
+struct TrackedDeleter {
+  void operator()(T* pointer) const {
+    mxdelete(pointer);
+  }
+};
+
 // Smart pointer class. Keeps track of all references to a pointer and deletes
 // the pointee after the last SmartPointer referencing falls out of scope. This
 // implementation uses a doubly-linked list, which means that additional pointer
 // operations are necessary when adding / removing references. The advantage is
 // that we don't need RTTI or a base class for all classes using smart pointers.
-template <class T>
-class SmartPointer {
+//
+// The last reference releases the pointee through a Deleter, which makes it
+// possible to own objects that don't come from new, e.g. TrackedDeleter for
+// mxnew and PoolDeleter for mxpoolnew. Stateless deleters take up no space.
+// Moving a SmartPointer only patches the neighbours in the list to point to
+// the new location.
+//
+// WeakPointers are members of the same list, marked by a tag in the lowest bit
+// of their pointer. A SmartPointer leaving the list only has to look further
+// than its neighbours if both of them are weak.
+template <class T, class Deleter = DefaultDeleter<T> >
+class SmartPointer : private Deleter {
  public:
   SmartPointer()
       : pointer_(NULL),
         next_(this),
         previous_(this) {}
 
-  explicit SmartPointer(T* pointer)
-      : pointer_(pointer),
+  explicit SmartPointer(T* pointer, const Deleter& deleter = Deleter())
+      : Deleter(deleter),
+        pointer_(pointer),
         next_(this),
         previous_(this) {}
 
-  SmartPointer(SmartPointer<T>& other)
-      : pointer_(NULL),
+  SmartPointer(const SmartPointer<T, Deleter>& other)
+      : Deleter(other),
+        pointer_(NULL),
         next_(this),
         previous_(this) {
-    if (&other != this) {
-      AddReference(other);
-    }
+    AddReference(other);
+  }
+
+  SmartPointer(SmartPointer<T, Deleter>&& other) noexcept
+      : Deleter(other),
+        pointer_(NULL),
+        next_(this),
+        previous_(this) {
+    TakeOver(other);
   }
 
   ~SmartPointer() {
@@ -70,56 +112,234 @@ class SmartPointer {
     return pointer_;
   }
 
-  SmartPointer<T>& operator=(const SmartPointer<T>& other) const {
-    if (&other != this) {
+  SmartPointer<T, Deleter>& operator=(const SmartPointer<T, Deleter>& other) {
+    if (&other != this && other.pointer_ != pointer_) {
       RemoveReference();
+      deleter() = other.deleter();
       AddReference(other);
     }
 
     return *this;
   }
 
-  bool operator==(const SmartPointer<T>& other) const {
+  SmartPointer<T, Deleter>& operator=(SmartPointer<T, Deleter>&& other)
+      noexcept {
+    if (&other != this) {
+      RemoveReference();
+      deleter() = other.deleter();
+      TakeOver(other);
+    }
+
+    return *this;
+  }
+
+  bool operator==(const SmartPointer<T, Deleter>& other) const {
     return (other.pointer_ == pointer_);
   }
 
-  bool operator!=(const SmartPointer<T>& other) const {
+  bool operator!=(const SmartPointer<T, Deleter>& other) const {
     return !(other == *this);
   }
 
+  T* get() const {
+    return pointer_;
+  }
+
+  Deleter& deleter() {
+    return *this;
+  }
+
+  const Deleter& deleter() const {
+    return *this;
+  }
+
  private:
-  // Adds an additional reference to the pointer. New references are inserted at
-  // the back of the list. This is the equivalent of increasing the reference
-  // count in other smart pointer implementations.
-  void AddReference(SmartPointer<T>& other) {
+  friend class WeakPointer<T, Deleter>;
+
+  static const uintptr_t kWeakTag = 1;
+
+  bool weak() const {
+    return (reinterpret_cast<uintptr_t>(pointer_) & kWeakTag) != 0;
+  }
+
+  // Adds an additional reference to the pointer. New references are inserted
+  // into the list right after other. This is the equivalent of increasing the
+  // reference count in other smart pointer implementations. The links are
+  // mutable, so other can be const.
+  void AddReference(const SmartPointer<T, Deleter>& other) {
     if (other.pointer_ != NULL) {
       pointer_ = other.pointer_;
-      other.previous_ = this;
-      other.next_ = next_;
-      next_->previous_ = &other;
-      next_ = &other;
+      previous_ = const_cast<SmartPointer<T, Deleter>*>(&other);
+      next_ = other.next_;
+      other.next_->previous_ = this;
+      other.next_ = this;
     }
   }
 
+  // Takes the place of other in the list, leaving other empty.
+  void TakeOver(SmartPointer<T, Deleter>& other) {
+    pointer_ = other.pointer_;
+    if (other.next_ != &other) {
+      next_ = other.next_;
+      previous_ = other.previous_;
+      next_->previous_ = this;
+      previous_->next_ = this;
+      other.next_ = &other;
+      other.previous_ = &other;
+    }
+    other.pointer_ = NULL;
+  }
+
   // Removes a reference from the list. pointer_ is set to NULL at the end of the
   // method to ensure only the last reference actually deletes the memory
-  // pointed to by pointer_.
+  // pointed to by pointer_. If only weak references remain, they are expired
+  // before deleting.
   void RemoveReference() {
     if (!(next_ == this && previous_ == this)) {
-      previous_->next_ = next_;
-      next_->previous_ = previous_;
+      SmartPointer<T, Deleter>* next = next_;
+      SmartPointer<T, Deleter>* previous = previous_;
+      previous->next_ = next;
+      next->previous_ = previous;
       next_ = this;
       previous_ = this;
-    } else if (pointer_ != NULL) {
-      delete pointer_;
+
+      if (previous->weak() && next->weak()) {
+        ReleaseWeak(next);
+      }
+    } else if (pointer_ != NULL && !weak()) {
+      deleter()(pointer_);
     }
 
     pointer_ = NULL;
   }
 
+  // Called after leaving a list with weak references on both sides. If this
+  // was the last strong reference, expires all weak references in the list
+  // starting at first and deletes the object.
+  void ReleaseWeak(SmartPointer<T, Deleter>* first) {
+    if (weak()) {
+      return;
+    }
+
+    SmartPointer<T, Deleter>* link = first;
+    do {
+      if (!link->weak()) {
+        return;
+      }
+      link = link->next_;
+    } while (link != first);
+
+    do {
+      SmartPointer<T, Deleter>* next = link->next_;
+      link->pointer_ = NULL;
+      link->next_ = link;
+      link->previous_ = link;
+      link = next;
+    } while (link != first);
+    deleter()(pointer_);
+  }
+
   T* pointer_;
-  SmartPointer<T>* next_;
-  SmartPointer<T>* previous_;
+  mutable SmartPointer<T, Deleter>* next_;
+  mutable SmartPointer<T, Deleter>* previous_;
+};
+
+// Non-owning reference to an object owned by SmartPointers. A WeakPointer
+// doesn't keep the object alive; it is expired when the last SmartPointer
+// releases the object and can be promoted to a SmartPointer with Lock() while
+// the object lives. Like SmartPointer, it isn't thread-safe.
+//
+// Weak references are kept in the list of the owning SmartPointers and use the
+// lowest pointer bit as a tag, so the object can't be at an odd address. This
+// holds for anything allocated by new, mxnew or the pools.
+template <class T, class Deleter = DefaultDeleter<T> >
+class WeakPointer {
+ public:
+  WeakPointer() {}
+
+  WeakPointer(const SmartPointer<T, Deleter>& strong) {
+    Assign(strong);
+  }
+
+  WeakPointer(const WeakPointer<T, Deleter>& other) {
+    link_.deleter() = other.link_.deleter();
+    link_.AddReference(other.link_);
+  }
+
+  WeakPointer(WeakPointer<T, Deleter>&& other) noexcept {
+    link_.deleter() = other.link_.deleter();
+    link_.TakeOver(other.link_);
+  }
+
+  // The link never owns the object, so its destructor only leaves the list.
+  ~WeakPointer() {}
+
+  WeakPointer<T, Deleter>& operator=(const SmartPointer<T, Deleter>& strong) {
+    Reset();
+    Assign(strong);
+    return *this;
+  }
+
+  WeakPointer<T, Deleter>& operator=(const WeakPointer<T, Deleter>& other) {
+    if (&other != this) {
+      Reset();
+      link_.deleter() = other.link_.deleter();
+      link_.AddReference(other.link_);
+    }
+    return *this;
+  }
+
+  WeakPointer<T, Deleter>& operator=(WeakPointer<T, Deleter>&& other)
+      noexcept {
+    if (&other != this) {
+      Reset();
+      link_.deleter() = other.link_.deleter();
+      link_.TakeOver(other.link_);
+    }
+    return *this;
+  }
+
+  // Returns a SmartPointer sharing ownership of the object, or an empty
+  // SmartPointer if the object has been deleted.
+  SmartPointer<T, Deleter> Lock() const {
+    SmartPointer<T, Deleter> strong;
+    if (!expired()) {
+      strong.deleter() = link_.deleter();
+      strong.AddReference(link_);
+      strong.pointer_ = Untag(link_.pointer_);
+    }
+    return strong;
+  }
+
+  bool expired() const {
+    return link_.pointer_ == NULL;
+  }
+
+  void Reset() {
+    link_.RemoveReference();
+  }
+
+ private:
+  static T* Tag(T* pointer) {
+    return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(pointer) |
+                                SmartPointer<T, Deleter>::kWeakTag);
+  }
+
+  static T* Untag(T* pointer) {
+    return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(pointer) &
+                                ~SmartPointer<T, Deleter>::kWeakTag);
+  }
+
+  void Assign(const SmartPointer<T, Deleter>& strong) {
+    if (strong.pointer_ != NULL) {
+      assert(!strong.weak());
+      link_.deleter() = strong.deleter();
+      link_.AddReference(strong);
+      link_.pointer_ = Tag(link_.pointer_);
+    }
+  }
+
+  SmartPointer<T, Deleter> link_;
 };
 
 }  // namespace core
@@ -0,0 +1,149 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_SPSC_QUEUE_H_
+#define MXCORE_SPSC_QUEUE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include "mxcore/alignment.h"
+
+namespace mx {
+namespace core {
+
+// Bounded wait-free ring buffer for exactly one producer and one consumer
+// thread. Each side owns a cache line with its index and a cached copy of
+// the other side's index, and only reads the other side's line when the
+// cached copy says the ring is full or empty. The queue works in memory
+// provided by the caller, e.g. from AlignedMemory, and never allocates. T
+// has to be default constructible and assignable.
+template <typename T>
+class SpscQueue {
+ public:
+  // Bytes of memory needed for capacity elements.
+  static size_t memory_size(const uint32_t capacity) {
+    return sizeof(T) * capacity;
+  }
+
+  // memory has to hold memory_size(capacity) bytes aligned for T. capacity
+  // has to be a power of two.
+  SpscQueue(void* memory, const uint32_t capacity);
+  ~SpscQueue();
+
+  // Returns false if the queue is full. Must only be called by the producer.
+  bool Push(const T& value);
+
+  // Returns false if the queue is empty. Must only be called by the
+  // consumer.
+  bool Pop(T* value);
+
+  // Number of queued elements. Only a snapshot while the queue is in use.
+  uint32_t size() const;
+  uint32_t capacity() const { return mask_ + 1; }
+
+ private:
+  SpscQueue(const SpscQueue& other);
+  SpscQueue& operator=(const SpscQueue& other);
+
+  T* const values_;
+  const uint32_t mask_;
+
+  // Written by the producer.
+  alignas(kCacheLineSize) std::atomic<size_t> tail_;
+  size_t cached_head_;
+
+  // Written by the consumer.
+  alignas(kCacheLineSize) std::atomic<size_t> head_;
+  size_t cached_tail_;
+};
+
+template <typename T>
+SpscQueue<T>::SpscQueue(void* memory, const uint32_t capacity)
+    : values_(reinterpret_cast<T*>(memory)),
+      mask_(capacity - 1),
+      tail_(0),
+      cached_head_(0),
+      head_(0),
+      cached_tail_(0) {
+  assert(IsPowerOfTwo(capacity));
+  assert(IsAligned(memory, alignof(T)));
+  for (uint32_t i = 0; i < capacity; ++i) {
+    new(&values_[i]) T();
+  }
+}
+
+template <typename T>
+SpscQueue<T>::~SpscQueue() {
+  for (uint32_t i = 0; i <= mask_; ++i) {
+    values_[i].~T();
+  }
+}
+
+template <typename T>
+bool SpscQueue<T>::Push(const T& value) {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail - cached_head_ > mask_) {
+    cached_head_ = head_.load(std::memory_order_acquire);
+    if (tail - cached_head_ > mask_) {
+      return false;
+    }
+  }
+
+  values_[tail & mask_] = value;
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::Pop(T* value) {
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (head == cached_tail_) {
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    if (head == cached_tail_) {
+      return false;
+    }
+  }
+
+  *value = values_[head & mask_];
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+uint32_t SpscQueue<T>::size() const {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  const size_t head = head_.load(std::memory_order_relaxed);
+  return (tail > head) ? static_cast<uint32_t>(tail - head) : 0;
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_SPSC_QUEUE_H_
@@ -0,0 +1,160 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MXCORE_WORK_STEALING_DEQUE_H_
+#define MXCORE_WORK_STEALING_DEQUE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "mxcore/alignment.h"
+
+namespace mx {
+namespace core {
+
+// Chase-Lev deque of pointers with a fixed capacity. The owning thread pushes
+// and pops at the bottom without contention, other threads steal from the
+// top. Follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Le et al., 2013), with sequentially consistent operations in place of the
+// paper's fences. The deque does not grow; Push() fails once it is full.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  // capacity has to be a power of two.
+  explicit WorkStealingDeque(const uint32_t capacity);
+  ~WorkStealingDeque();
+
+  // Adds item at the bottom. Returns false if the deque is full. Must only
+  // be called by the owner.
+  bool Push(T* item);
+
+  // Removes the item at the bottom. Returns NULL if the deque is empty. Must
+  // only be called by the owner.
+  T* Pop();
+
+  // Removes the item at the top. Returns NULL if the deque is empty or
+  // another thread took the item first. Safe to call from any thread.
+  T* Steal();
+
+  // Number of queued items. Only a snapshot while other threads steal.
+  uint32_t size() const;
+  uint32_t capacity() const { return mask_ + 1; }
+
+ private:
+  WorkStealingDeque(const WorkStealingDeque& other);
+  WorkStealingDeque& operator=(const WorkStealingDeque& other);
+
+  // Thieves write top_, the owner writes bottom_; keeping them on separate
+  // cache lines stops pushes from invalidating the thieves' line.
+  alignas(kCacheLineSize) std::atomic<int64_t> top_;
+  alignas(kCacheLineSize) std::atomic<int64_t> bottom_;
+  std::atomic<T*>* items_;
+  const uint32_t mask_;
+};
+
+template <typename T>
+WorkStealingDeque<T>::WorkStealingDeque(const uint32_t capacity)
+    : top_(0),
+      bottom_(0),
+      items_(new std::atomic<T*>[capacity]),
+      mask_(capacity - 1) {
+  assert(IsPowerOfTwo(capacity));
+}
+
+template <typename T>
+WorkStealingDeque<T>::~WorkStealingDeque() {
+  delete[] items_;
+}
+
+template <typename T>
+bool WorkStealingDeque<T>::Push(T* item) {
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+  const int64_t top = top_.load(std::memory_order_acquire);
+  if (bottom - top > static_cast<int64_t>(mask_)) {
+    return false;
+  }
+
+  items_[bottom & mask_].store(item, std::memory_order_relaxed);
+  // Publishes the item, and whatever it points to, to stealing threads.
+  bottom_.store(bottom + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+T* WorkStealingDeque<T>::Pop() {
+  // Reserves the bottom item before looking at top_, so that a concurrent
+  // Steal() either sees the reservation or is seen here.
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(bottom, std::memory_order_seq_cst);
+  int64_t top = top_.load(std::memory_order_seq_cst);
+
+  if (top > bottom) {
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return NULL;
+  }
+
+  T* item = items_[bottom & mask_].load(std::memory_order_relaxed);
+  if (top == bottom) {
+    // The last item; races with thieves for it.
+    if (!top_.compare_exchange_strong(top, top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      item = NULL;
+    }
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return item;
+}
+
+template <typename T>
+T* WorkStealingDeque<T>::Steal() {
+  int64_t top = top_.load(std::memory_order_seq_cst);
+  const int64_t bottom = bottom_.load(std::memory_order_seq_cst);
+  if (top >= bottom) {
+    return NULL;
+  }
+
+  T* item = items_[top & mask_].load(std::memory_order_relaxed);
+  if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed)) {
+    return NULL;
+  }
+  return item;
+}
+
+template <typename T>
+uint32_t WorkStealingDeque<T>::size() const {
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+  const int64_t top = top_.load(std::memory_order_relaxed);
+  return (bottom > top) ? static_cast<uint32_t>(bottom - top) : 0;
+}
+
+}  // namespace core
+}  // namespace mx
+
+#endif  // MXCORE_WORK_STEALING_DEQUE_H_
@@ -0,0 +1,78 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_BUFFER_H_
+#define SHADE_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mx {
+namespace shade {
+
+// How often the contents of a buffer change. This decides where a
+// BufferManager keeps the buffer on the device.
+enum BufferUsage {
+  // Uploaded once and drawn many times, e.g. level geometry.
+  kStaticUsage,
+  // Changes every few frames and is drawn several times per frame, e.g.
+  // skinned meshes. Uploaded at most once per frame.
+  kDynamicUsage,
+  // Changes every time it is drawn, e.g. particles or debug lines.
+  kStreamUsage
+};
+
+// A range of client memory holding vertex or index data. start_ and size_
+// count elements, not bytes.
+template <class T>
+class Buffer {
+ public:
+  Buffer() : data_(NULL), start_(0), size_(0), usage_(kStaticUsage) {}
+  Buffer(T* data, size_t start, size_t size, BufferUsage usage = kStaticUsage)
+      : data_(data),
+        start_(start),
+        size_(size),
+        usage_(usage) {}
+
+  T* data_;
+  size_t start_;
+  size_t size_;
+  BufferUsage usage_;
+};
+
+// Reference to a buffer created by ShadingSystem::CreateVertexBuffer() or
+// CreateIndexBuffer(). Handles of destroyed buffers are detected rather than
+// reused, so a block referencing one is never drawn with another buffer.
+typedef uint32_t BufferHandle;
+
+// Handle of no buffer, e.g. for blocks without normals or indices.
+const BufferHandle kNullBuffer = 0;
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_BUFFER_H_
@@ -0,0 +1,101 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_BUFFER_DEVICE_CPU_H_
+#define SHADE_BUFFER_DEVICE_CPU_H_
+
+#include <stdint.h>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "shade/buffer_manager.h"
+
+namespace mx {
+namespace shade {
+
+// Keeps device buffers in system memory, for running a BufferManager without
+// a GPU. The GPU is simulated by signaling fences a number of frames after
+// they were inserted. Mapping memory that belongs to a frame whose fence
+// hasn't been signaled yet is counted as a hazard.
+class BufferDeviceCpu : public BufferDevice {
+ public:
+  BufferDeviceCpu();
+  virtual ~BufferDeviceCpu() {}
+
+  uint32_t CreateBuffer(const size_t size, const BufferUsage usage);
+  void DestroyBuffer(const uint32_t buffer);
+  void Write(const uint32_t buffer, const size_t offset, const void* data,
+             const size_t size);
+  void* Map(const uint32_t buffer, const size_t offset, const size_t size);
+  void Unmap(const uint32_t buffer, const size_t offset, const size_t size);
+  FenceHandle InsertFence();
+  bool IsSignaled(const FenceHandle fence);
+  void Wait(const FenceHandle fence);
+  void DestroyFence(const FenceHandle fence) {}
+
+  // Returns the contents of a buffer, or NULL if it doesn't exist.
+  const uint8_t* data(const uint32_t buffer) const;
+  size_t size(const uint32_t buffer) const;
+
+  uint32_t buffer_count() const {
+    return static_cast<uint32_t>(buffers_.size());
+  }
+
+  // Number of fences inserted after a fence before it's signaled. 0 signals
+  // fences immediately.
+  uint32_t latency() const { return latency_; }
+  void set_latency(const uint32_t latency) { latency_ = latency; }
+
+  uint32_t waits() const { return waits_; }
+  uint32_t hazards() const { return hazards_; }
+
+ private:
+  // A mapped range, which the GPU reads until the fence is signaled.
+  struct Range {
+    uint32_t buffer_;
+    size_t offset_;
+    size_t size_;
+    FenceHandle fence_;
+  };
+
+  BufferDeviceCpu(const BufferDeviceCpu& other);
+  BufferDeviceCpu& operator=(const BufferDeviceCpu& other);
+
+  std::unordered_map<uint32_t, std::vector<uint8_t> > buffers_;
+  uint32_t next_buffer_;
+  std::deque<Range> ranges_;
+  FenceHandle last_fence_;
+  FenceHandle signaled_fence_;
+  uint32_t latency_;
+  uint32_t waits_;
+  uint32_t hazards_;
+};
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_BUFFER_DEVICE_CPU_H_
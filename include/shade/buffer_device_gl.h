@@ -0,0 +1,66 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_BUFFER_DEVICE_GL_H_
+#define SHADE_BUFFER_DEVICE_GL_H_
+
+#define GL3_PROTOTYPES 1
+#include <GL3/gl3.h>
+#include "shade/buffer_manager.h"
+
+namespace mx {
+namespace shade {
+
+// Keeps device buffers in OpenGL 3.2 buffer objects. Buffer ids are the names
+// of the buffer objects. OpenGL 3.2 can't keep buffers mapped while drawing,
+// so every upload maps its range of the ring without synchronization and
+// unmaps it again. The fences of the BufferManager keep this safe.
+class BufferDeviceGL : public BufferDevice {
+ public:
+  BufferDeviceGL() {}
+  virtual ~BufferDeviceGL() {}
+
+  uint32_t CreateBuffer(const size_t size, const BufferUsage usage);
+  void DestroyBuffer(const uint32_t buffer);
+  void Write(const uint32_t buffer, const size_t offset, const void* data,
+             const size_t size);
+  void* Map(const uint32_t buffer, const size_t offset, const size_t size);
+  void Unmap(const uint32_t buffer, const size_t offset, const size_t size);
+  FenceHandle InsertFence();
+  bool IsSignaled(const FenceHandle fence);
+  void Wait(const FenceHandle fence);
+  void DestroyFence(const FenceHandle fence);
+
+ private:
+  BufferDeviceGL(const BufferDeviceGL& other);
+  BufferDeviceGL& operator=(const BufferDeviceGL& other);
+};
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_BUFFER_DEVICE_GL_H_
@@ -0,0 +1,234 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_BUFFER_MANAGER_H_
+#define SHADE_BUFFER_MANAGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "shade/buffer.h"
+
+namespace mx {
+namespace shade {
+
+// Identifies a device fence. 0 is never a valid fence.
+typedef uint64_t FenceHandle;
+
+// The device side of a BufferManager. Buffers are identified by ids, where 0
+// is never a valid id. Implementations don't synchronize with the GPU on
+// their own; the BufferManager uses fences to make sure memory isn't written
+// while it's still read.
+class BufferDevice {
+ public:
+  virtual ~BufferDevice() {}
+
+  virtual uint32_t CreateBuffer(const size_t size, const BufferUsage usage) = 0;
+  virtual void DestroyBuffer(const uint32_t buffer) = 0;
+
+  // Copies data into a buffer created with kStaticUsage.
+  virtual void Write(const uint32_t buffer, const size_t offset,
+                     const void* data, const size_t size) = 0;
+
+  // Returns a write-only pointer to a range of a buffer created with
+  // kStreamUsage. The range must not be in use by the GPU.
+  virtual void* Map(const uint32_t buffer, const size_t offset,
+                    const size_t size) = 0;
+  virtual void Unmap(const uint32_t buffer, const size_t offset,
+                     const size_t size) = 0;
+
+  // Fences are signaled once the GPU has executed all commands issued before
+  // the fence was inserted.
+  virtual FenceHandle InsertFence() = 0;
+  virtual bool IsSignaled(const FenceHandle fence) = 0;
+  virtual void Wait(const FenceHandle fence) = 0;
+  virtual void DestroyFence(const FenceHandle fence) = 0;
+};
+
+// Where the contents of a buffer live on the device.
+struct DeviceBuffer {
+  uint32_t buffer_;
+  size_t offset_;
+  size_t size_;
+};
+
+// Work done by a BufferManager since BeginFrame().
+struct BufferStatistics {
+  uint32_t uploads_;
+  size_t upload_bytes_;
+  uint32_t cache_hits_;
+  // Number of times the CPU had to wait for the GPU.
+  uint32_t waits_;
+};
+
+// Keeps client buffers on the device, keyed by the address of the Buffer
+// object or a key chosen by the caller, so they are only uploaded when needed.
+//
+// Static buffers are uploaded on first use and sub-allocated from large device
+// blocks with a first fit free list. Buffers larger than a block get a block
+// of their own. Call Update() after changing their contents and Release()
+// before destroying them.
+//
+// Dynamic and stream buffers are copied into an upload ring, which is written
+// through mapped pointers. Dynamic buffers are copied at most once per frame,
+// stream buffers every time they are acquired. Every frame ends with a fence,
+// and the ring space used by a frame is only reused once its fence has been
+// signaled. BeginFrame() also waits until less than max_frames_in_flight
+// frames are queued on the GPU.
+//
+// A BufferManager is used by the thread that dispatches the render queue and
+// isn't thread-safe.
+class BufferManager {
+ public:
+  // All device memory is aligned to this many bytes.
+  static const size_t kAlignment = 16;
+
+  explicit BufferManager(BufferDevice* device,
+                         const size_t block_size = 4 * 1024 * 1024,
+                         const size_t ring_size = 4 * 1024 * 1024,
+                         const uint32_t max_frames_in_flight = 3);
+  ~BufferManager();
+
+  void BeginFrame();
+  void EndFrame();
+
+  // Returns the device copy of a buffer, uploading it if needed. Returns NULL
+  // if a dynamic or stream buffer doesn't fit into the ring next to the data
+  // of the current frame. For stream buffers, the result is only valid until
+  // the next call.
+  template <class T>
+  const DeviceBuffer* Acquire(const Buffer<T>* buffer) {
+    return Acquire(AddressKey(buffer), *buffer);
+  }
+
+  // Like above, but identifies the buffer by key instead of its address, so
+  // the Buffer object may move, e.g. when it's referenced by a handle. Keys
+  // must not be addresses of other buffers passed to the manager.
+  template <class T>
+  const DeviceBuffer* Acquire(const uint64_t key, const Buffer<T>& buffer) {
+    return Acquire(key, buffer.data_ + buffer.start_,
+                   buffer.size_ * sizeof(T), buffer.usage_);
+  }
+
+  // Uploads the contents of a static buffer again. Other buffers are
+  // uploaded the next time they are acquired.
+  template <class T>
+  void Update(const Buffer<T>* buffer) {
+    Update(AddressKey(buffer), *buffer);
+  }
+  template <class T>
+  void Update(const uint64_t key, const Buffer<T>& buffer) {
+    Update(key, buffer.data_ + buffer.start_, buffer.size_ * sizeof(T));
+  }
+
+  // Frees the device memory of a buffer.
+  template <class T>
+  void Release(const Buffer<T>* buffer) {
+    Release(AddressKey(buffer));
+  }
+  void Release(const uint64_t key);
+
+  // Frees all device memory. Must be called while the device is still alive
+  // if it's destroyed before the manager.
+  void Clear();
+
+  const BufferStatistics& statistics() const { return statistics_; }
+
+  uint32_t block_count() const {
+    return static_cast<uint32_t>(blocks_.size());
+  }
+  size_t ring_size() const { return ring_size_; }
+  size_t ring_used() const { return ring_used_; }
+  uint32_t frames_in_flight() const {
+    return static_cast<uint32_t>(frames_.size());
+  }
+
+ private:
+  // A device buffer static buffers are sub-allocated from. Maps the offsets
+  // of free ranges to their sizes.
+  struct Block {
+    uint32_t buffer_;
+    size_t size_;
+    size_t free_size_;
+    std::map<size_t, size_t> free_;
+  };
+
+  struct Entry {
+    DeviceBuffer location_;
+    BufferUsage usage_;
+    // Frame in which a dynamic buffer was last copied into the ring.
+    uint64_t frame_;
+  };
+
+  // Ring space used by a frame queued on the GPU.
+  struct RingFrame {
+    FenceHandle fence_;
+    size_t size_;
+  };
+
+  BufferManager(const BufferManager& other);
+  BufferManager& operator=(const BufferManager& other);
+
+  static uint64_t AddressKey(const void* buffer) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(buffer));
+  }
+
+  const DeviceBuffer* Acquire(const uint64_t key, const void* data,
+                              const size_t size, const BufferUsage usage);
+  void Update(const uint64_t key, const void* data, const size_t size);
+
+  bool AllocateStatic(const size_t size, DeviceBuffer* location);
+  void FreeStatic(const DeviceBuffer& location);
+  bool Stream(const void* data, const size_t size, DeviceBuffer* location);
+  void RetireFrame(const bool wait);
+
+  BufferDevice* device_;
+  const size_t block_size_;
+  const size_t ring_size_;
+  const uint32_t max_frames_in_flight_;
+
+  std::unordered_map<uint64_t, Entry> entries_;
+  std::vector<Block> blocks_;
+
+  uint32_t ring_buffer_;
+  size_t ring_head_;
+  size_t ring_used_;
+  size_t frame_size_;
+  std::deque<RingFrame> frames_;
+  DeviceBuffer stream_location_;
+
+  uint64_t frame_;
+  BufferStatistics statistics_;
+};
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_BUFFER_MANAGER_H_
@@ -29,67 +29,336 @@
 #define SHADE_SHADING_SYSTEM_H_
 
 #include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
+#include "mxcore/aligned_memory.h"
+#include "mxcore/alignment.h"
+#include "mxcore/frame_allocator.h"
+#include "mxcore/linear_allocator.h"
+#include "mxcore/slot_map.h"
+#include "shade/buffer.h"
+#include "shade/state_cache.h"
 
 namespace mx {
 namespace shade {
 
-template <class T>
-class Buffer {
- public:
-  Buffer() : data_(NULL), start_(0), size_(0) {}
-  Buffer(T* data, size_t start, size_t size) 
-      : data_(data),
-        start_(start),
-        size_(size) {}
-
-  T* data_;
-  size_t start_;
-  size_t size_;
-};
-
-struct RenderState {
-  float diffuse_color_[3];
-  float ambient_light_[6];
+// Per-object data of a render block. Blocks drawn as instances of the same
+// draw pass theirs to the backend in a packed per-instance stream.
+struct DrawConstants {
+  // Row-major 3x4 matrix transforming the block to world space.
+  float transform_[12];
+  float color_[4];
 };
 
 // A render block encapsulates the vertices and state used to draw a piece of
-// geometry.
+// geometry. The buffers and the state are handles returned by the
+// ShadingSystem, which keeps blocks small and lets the buffers move.
+// Blocks are drawn ordered by layer first, so the layer can be used for passes
+// like the sky box, the world and the HUD. depth_ is the distance to the
+// camera, normalized to [0, 1]. Blocks without constants are drawn with an
+// identity transform and a white color. The constants are copied when the
+// block is submitted, so they may live on the stack.
 struct RenderBlock {
-  RenderBlock() : vertex_buffer_(NULL), index_buffer_(NULL), state_(NULL) {}
-  RenderBlock(Buffer<float>* vertex_buffer,
-              Buffer<float>* normal_buffer,
-              Buffer<uint32_t>* index_buffer,
-              RenderState* state)
+  RenderBlock()
+      : vertex_buffer_(kNullBuffer),
+        normal_buffer_(kNullBuffer),
+        index_buffer_(kNullBuffer),
+        state_(kDefaultState),
+        layer_(0),
+        depth_(0.0f),
+        constants_(NULL) {}
+  RenderBlock(BufferHandle vertex_buffer,
+              BufferHandle normal_buffer,
+              BufferHandle index_buffer,
+              StateHandle state,
+              uint8_t layer = 0,
+              float depth = 0.0f,
+              const DrawConstants* constants = NULL)
       : vertex_buffer_(vertex_buffer),
         normal_buffer_(normal_buffer),
         index_buffer_(index_buffer),
-        state_(state) {}
+        state_(state),
+        layer_(layer),
+        depth_(depth),
+        constants_(constants) {}
+
+  BufferHandle vertex_buffer_;
+  BufferHandle normal_buffer_;
+  BufferHandle index_buffer_;
+  StateHandle state_;
+  uint8_t layer_;
+  float depth_;
+  const DrawConstants* constants_;
+};
 
-  Buffer<float>* vertex_buffer_;
-  Buffer<float>* normal_buffer_;
-  Buffer<uint32_t>* index_buffer_;
-  RenderState* state_;
+// Entry of the render queue, ordered by the sort key. index_ refers to the
+// block in the submission arenas of the frame.
+struct RenderItem {
+  uint64_t key_;
+  uint32_t index_;
+  uint32_t sequence_;
 };
 
+// Work done by EndFrame() in the last frame. blocks_ is the number of draws
+// without batching, draws_ the number of draws issued. Skipped binds are
+// blocks whose state or geometry was already bound on the device. Stale
+// blocks weren't drawn, as one of their buffers was destroyed before the frame
+// was dispatched.
+struct FrameStatistics {
+  uint32_t blocks_;
+  uint32_t stale_blocks_;
+  uint32_t draws_;
+  uint32_t shader_binds_;
+  uint32_t state_binds_;
+  uint32_t state_binds_skipped_;
+  uint32_t geometry_binds_;
+  uint32_t geometry_binds_skipped_;
+};
+
+struct SubmissionBucket;
+struct FramePacket;
+
 // A render API abstraction layer. Takes render blocks (render state + geometry)
 // and queues them up. When all render blocks forming the current frame have
 // been buffered, the shading system passes the abstract render states on to the
 // native API.
+//
+// Every block gets a 64 bit sort key when it is submitted. Before dispatching,
+// the queue is radix sorted by these keys, so blocks sharing a shader, state
+// and buffers are drawn one after another. From the most significant bit:
+//
+//   layer (4) | translucent (1) | shader (12) | state (16) | buffer (16) |
+//   depth (15)
+//
+// Opaque blocks are ordered front to back within a state. For translucent
+// blocks, the depth moves right after the translucency bit and is inverted,
+// so they are drawn back to front.
+//
+// Render() may be called from several threads at once. Every thread appends to
+// its own bucket, indexed by its CurrentThreadIndex() and allocated from the
+// thread's arena in a FrameAllocator. The blocks and copies of their constants
+// are stored in the arena, so submitting doesn't touch the heap and the whole
+// frame is released at once when the arena is rewound. Blocks are stored in
+// chunks as a structure of arrays: the sort keys, the sequence numbers, 24
+// byte batch records holding the buffers, state, depth and layer, and a column
+// of constants that is only allocated once a block in the chunk has
+// constants. The buckets are merged into a queue of 16 byte items holding the
+// sort key and the index of the block, so sorting moves little memory and
+// dispatching only reads the batch records and the constants it needs.
+// Merging follows the thread indices of the submitting threads, so blocks with
+// equal keys may be drawn in a different order every frame. In deterministic
+// mode, they are ordered by the sequence number passed to Render() instead.
+//
+// EndFrame() sorts the queue and walks it, calling the backend hooks below.
+// The shading system tracks which state is bound on the device, so
+// BindShader(), ApplyState() and BindGeometry() are only called when the
+// shader, the state or the buffers differ from what is bound. States are
+// interned, so equal states always share a handle. The bound state is kept
+// across frames until InvalidateDeviceState() is called.
+//
+// Buffers are owned by the shading system and stored in slot maps, so blocks
+// refer to them by 32 bit handles. The descriptors are packed, and moving the
+// memory of a buffer only means updating its descriptor, not every block
+// referring to it. Blocks whose buffers are destroyed before their frame has
+// been dispatched are skipped, so a buffer can be destroyed at any time.
+// The sort key uses the slot of the vertex buffer, which is stable while the
+// buffer exists.
+//
+// Consecutive blocks in the sorted queue that share state, layer and buffers
+// are batched into one instanced draw of up to max_instances() blocks. Their
+// constants are packed into instance_data(), which holds the constants of
+// all blocks of the frame in queue order.
+//
+// If max_frames_in_flight is not 0, the queue is sorted and dispatched on a
+// render thread, so the next frame can be built while the last one is drawn.
+// EndFrame() hands the submissions of the frame to the render thread in a
+// frame packet and only waits if max_frames_in_flight frames are already
+// queued or being dispatched. Blocks stay valid until their frame has been
+// dispatched, as the submission arenas are kept for max_frames_in_flight + 1
+// frames. Results like statistics() and render_items() describe the last
+// dispatched frame; call Flush() before reading them.
 class ShadingSystem {
  public:
-  ShadingSystem() {}
-  virtual ~ShadingSystem() {}
+  // thread_count is the number of threads expected to submit render blocks.
+  // Each of them gets an arena of arena_size bytes, which grows if needed.
+  // Up to core::kMaxThreads threads may submit; the arenas of any beyond
+  // thread_count start out empty.
+  explicit ShadingSystem(const uint32_t thread_count = 8,
+                         const size_t arena_size = 64 * 1024,
+                         const uint32_t max_frames_in_flight = 0);
+  // Backends must call StopRenderThread() in their destructor, since the
+  // render thread calls their hooks.
+  virtual ~ShadingSystem();
 
   virtual void Initialize();
-  virtual void ReInitialize() {}
+  virtual void ReInitialize() { InvalidateDeviceState(); }
   void BeginFrame();
-  void Render(const RenderBlock& rb);
-  virtual void EndFrame() = 0;
+  // Queues a render block. Thread-safe between BeginFrame() and EndFrame().
+  // sequence should identify the block uniquely in deterministic mode, e.g.
+  // the index of the object in the scene.
+  void Render(const RenderBlock& rb, const uint32_t sequence = 0);
+  // Allocates memory from the calling thread's arena that stays valid until
+  // the frame has been dispatched, e.g. for stream buffers rebuilt every
+  // frame. Thread-safe like Render().
+  void* AllocateFrameMemory(const size_t size, const size_t alignment = 16) {
+    return frame_allocator_.Allocate(size, alignment);
+  }
+  virtual void EndFrame();
   virtual void Dispose() {}
 
+  // Waits until the render thread has dispatched all frames handed to it.
+  void Flush();
+  // Flushes and stops the render thread. The next frame starts it again.
+  void StopRenderThread();
+
+  uint32_t max_frames_in_flight() const { return max_frames_in_flight_; }
+  // Number of frames queued on or being dispatched by the render thread.
+  uint32_t frames_in_flight() const;
+
+  // Returns the handle of a state equal to the given one. Must not be called
+  // while render blocks are submitted, but may be called while the render
+  // thread dispatches.
+  StateHandle InternState(const RenderState& state) {
+    return state_cache_.Intern(state);
+  }
+
+  const StateCache& state_cache() const { return state_cache_; }
+
+  // Vertex buffers hold vertices or normals. Creating and destroying buffers
+  // isn't thread-safe and waits while the render thread dispatches a frame.
+  // Returns kNullBuffer if there are too many buffers.
+  BufferHandle CreateVertexBuffer(const Buffer<float>& buffer);
+  BufferHandle CreateIndexBuffer(const Buffer<uint32_t>& buffer);
+  void DestroyVertexBuffer(const BufferHandle buffer);
+  void DestroyIndexBuffer(const BufferHandle buffer);
+
+  // Return NULL for destroyed buffers. The pointers are only valid until the
+  // next buffer is created or destroyed. A buffer must not be changed while a
+  // frame drawing it is in flight.
+  Buffer<float>* GetVertexBuffer(const BufferHandle buffer) {
+    return vertex_buffers_.Get(buffer);
+  }
+  const Buffer<float>* GetVertexBuffer(const BufferHandle buffer) const {
+    return vertex_buffers_.Get(buffer);
+  }
+  Buffer<uint32_t>* GetIndexBuffer(const BufferHandle buffer) {
+    return index_buffers_.Get(buffer);
+  }
+  const Buffer<uint32_t>* GetIndexBuffer(const BufferHandle buffer) const {
+    return index_buffers_.Get(buffer);
+  }
+
+  uint32_t vertex_buffer_count() const {
+    return static_cast<uint32_t>(vertex_buffers_.size());
+  }
+  uint32_t index_buffer_count() const {
+    return static_cast<uint32_t>(index_buffers_.size());
+  }
+
+  // Forgets what is bound on the device, e.g. after it has been reset. The
+  // next frame dispatched binds everything again.
+  void InvalidateDeviceState() { device_state_lost_ = true; }
+
+  FrameStatistics statistics() const;
+
+  // 1 draws every block on its own.
+  uint32_t max_instances() const { return max_instances_; }
+  void set_max_instances(const uint32_t max_instances) {
+    max_instances_ = max_instances > 0 ? max_instances : 1;
+  }
+
+  const std::vector<DrawConstants>& instance_data() const;
+  const std::vector<RenderItem>& render_items() const;
+  // Returns the block at a position of render_items(). Its constants point
+  // into the submission arena.
+  RenderBlock GetQueuedBlock(const size_t position) const;
+
+  bool deterministic() const { return deterministic_; }
+  void set_deterministic(const bool deterministic) {
+    deterministic_ = deterministic;
+  }
+
+  uint64_t ComputeSortKey(const RenderBlock& render_block) const;
+
  protected:
-  std::vector<RenderBlock> render_queue_;
+  // Called on the render thread before the first and after the last frame it
+  // dispatches, e.g. to make a context current.
+  virtual void BeginRenderThread() {}
+  virtual void EndRenderThread() {}
+
+  // Called by the dispatching thread before BeginDispatch() for every buffer
+  // destroyed since the last frame, e.g. to free its device memory.
+  virtual void ReleaseVertexBuffer(const BufferHandle buffer) {}
+  virtual void ReleaseIndexBuffer(const BufferHandle buffer) {}
+
+  // Backend hooks, called by EndFrame() or the render thread in this order.
+  virtual void BeginDispatch() {}
+  virtual void BindShader(const uint32_t shader) = 0;
+  virtual void ApplyState(const RenderState& state) = 0;
+  virtual void BindGeometry(const RenderBlock& render_block) = 0;
+  // Draws instance_count instances of the geometry of render_block, which is
+  // the first block of the batch.
+  virtual void Draw(const RenderBlock& render_block,
+                    const DrawConstants* instances,
+                    const uint32_t instance_count) = 0;
+  virtual void Present() {}
+
+ private:
+  // Replays recorded command streams through the hooks of other backends.
+  friend class ShadingSystemRecording;
+
+  ShadingSystem(const ShadingSystem& other);
+  ShadingSystem& operator=(const ShadingSystem& other);
+
+  // Takes over the submissions of the current frame.
+  void CapturePacket(FramePacket* packet);
+  // Merges the submissions of all threads and sorts them by their keys.
+  void SortRenderQueue(FramePacket* packet);
+  void Dispatch(FramePacket* packet);
+  void RunRenderThread();
+
+  const uint32_t max_frames_in_flight_;
+  core::HeapBlockAllocator block_allocator_;
+  core::FrameAllocator frame_allocator_;
+  core::AlignedMemory<core::kCacheLineSize> bucket_memory_;
+  SubmissionBucket* buckets_;
+  bool deterministic_;
+  uint32_t max_instances_;
+  StateCache state_cache_;
+
+  // Held while creating or destroying buffers and while dispatching, so the
+  // dispatching thread can look buffers up without locking every time.
+  std::mutex buffer_mutex_;
+  core::SlotMap<Buffer<float> > vertex_buffers_;
+  core::SlotMap<Buffer<uint32_t> > index_buffers_;
+  // Buffers destroyed since the last frame was dispatched.
+  std::vector<BufferHandle> released_vertex_buffers_;
+  std::vector<BufferHandle> released_index_buffers_;
+
+  // Frame packets, used round robin. last_packet_ is the last one
+  // dispatched.
+  std::vector<FramePacket*> packets_;
+  const FramePacket* last_packet_;
+
+  // Device state, only used by the thread dispatching.
+  bool device_state_valid_;
+  StateHandle bound_state_;
+  uint32_t bound_shader_;
+  std::atomic<bool> device_state_lost_;
+
+  // Hands frames to the render thread. The counters and statistics_ are
+  // guarded by mutex_.
+  std::thread render_thread_;
+  mutable std::mutex mutex_;
+  std::condition_variable frame_queued_;
+  std::condition_variable frame_dispatched_;
+  uint64_t queued_frames_;
+  uint64_t dispatched_frames_;
+  bool stopping_;
+  FrameStatistics statistics_;
 };
 
 }  // namespace shade
@@ -31,6 +31,8 @@
 #define GL3_PROTOTYPES 1
 #include <GL3/gl3.h>
 #include <SDL.h>
+#include "shade/buffer_device_gl.h"
+#include "shade/buffer_manager.h"
 #include "shade/shading_system.h"
 
 namespace mx {
@@ -38,17 +40,47 @@ namespace shade {
 
 class ShadingSystemGL : public ShadingSystem {
  public:
-  ShadingSystemGL() : shader_handle_(0) {}
-  virtual ~ShadingSystemGL() {}
+  explicit ShadingSystemGL(const uint32_t max_frames_in_flight = 0)
+      : ShadingSystem(8, 64 * 1024, max_frames_in_flight),
+        shader_handle_(0),
+        vertex_array_(0),
+        instance_buffer_(0),
+        state_buffer_(0),
+        buffer_manager_(&buffer_device_),
+        index_offset_(0),
+        index_count_(0) {}
+  virtual ~ShadingSystemGL() { StopRenderThread(); }
 
   void Initialize();
-  void EndFrame();
   void Dispose();
 
+ protected:
+  void BeginRenderThread();
+  void EndRenderThread();
+  void ReleaseVertexBuffer(const BufferHandle buffer);
+  void ReleaseIndexBuffer(const BufferHandle buffer);
+  void BeginDispatch();
+  void BindShader(const uint32_t shader);
+  void ApplyState(const RenderState& state);
+  void BindGeometry(const RenderBlock& render_block);
+  void Draw(const RenderBlock& render_block, const DrawConstants* instances,
+            const uint32_t instance_count);
+  void Present();
+
  private:
   SDL_Window* window_;
   SDL_GLContext gl_context_;
   GLuint shader_handle_;
+  GLuint vertex_array_;
+  // Uniform buffer holding the constants of the instances of a draw.
+  GLuint instance_buffer_;
+  // Uniform buffer holding the render state applied by ApplyState().
+  GLuint state_buffer_;
+  BufferDeviceGL buffer_device_;
+  BufferManager buffer_manager_;
+  // Location of the indices bound by BindGeometry().
+  size_t index_offset_;
+  size_t index_count_;
 };
 
 
@@ -0,0 +1,82 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_SHADING_SYSTEM_NULL_H_
+#define SHADE_SHADING_SYSTEM_NULL_H_
+
+#include "shade/shading_system.h"
+
+namespace mx {
+namespace shade {
+
+// Calls made to the backend during the last frame.
+struct DispatchStatistics {
+  uint32_t shader_binds_;
+  uint32_t state_changes_;
+  uint32_t geometry_binds_;
+  uint32_t draws_;
+  uint32_t instances_;
+};
+
+// Backend without a device. Runs the complete queue processing path, but only
+// counts the calls a device would receive. Used to test and measure the CPU
+// cost of rendering on machines without a GPU or window system. The counters
+// are updated by the dispatching thread, so read them after Flush() when
+// using a render thread.
+class ShadingSystemNull : public ShadingSystem {
+ public:
+  explicit ShadingSystemNull(const uint32_t thread_count = 8,
+                             const size_t arena_size = 64 * 1024,
+                             const uint32_t max_frames_in_flight = 0);
+  virtual ~ShadingSystemNull() { StopRenderThread(); }
+
+  // Doesn't initialize SDL.
+  void Initialize() {}
+
+  const DispatchStatistics& dispatch_statistics() const {
+    return dispatch_statistics_;
+  }
+  uint32_t frames() const { return frames_; }
+
+ protected:
+  void BeginDispatch();
+  void BindShader(const uint32_t shader);
+  void ApplyState(const RenderState& state);
+  void BindGeometry(const RenderBlock& render_block);
+  void Draw(const RenderBlock& render_block, const DrawConstants* instances,
+            const uint32_t instance_count);
+  void Present();
+
+ private:
+  DispatchStatistics dispatch_statistics_;
+  uint32_t frames_;
+};
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_SHADING_SYSTEM_NULL_H_
@@ -0,0 +1,107 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_SHADING_SYSTEM_RECORDING_H_
+#define SHADE_SHADING_SYSTEM_RECORDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "shade/shading_system.h"
+
+namespace mx {
+namespace shade {
+
+// Backend recording the calls it receives into a binary command stream
+// instead of drawing. Streams can be saved to compare them against golden
+// files and replayed through another backend, which times the backend without
+// the cost of submitting and sorting.
+//
+// Pointers and handles aren't meaningful outside of the process, so states
+// and the constants of every instance are recorded by value and buffers by
+// ids numbered in order of first use in every frame. Replaying creates the
+// buffers in the target for the duration of the replay.
+// Values are stored in native byte order.
+class ShadingSystemRecording : public ShadingSystem {
+ public:
+  explicit ShadingSystemRecording(const uint32_t thread_count = 8,
+                                  const size_t arena_size = 64 * 1024);
+  virtual ~ShadingSystemRecording() { StopRenderThread(); }
+
+  // Doesn't initialize SDL.
+  void Initialize() {}
+
+  const std::vector<uint8_t>& stream() const { return stream_; }
+  void ClearStream() { stream_.clear(); }
+
+  // Returns false if the file couldn't be written or read. Reading replaces
+  // the current stream.
+  bool WriteToFile(const char* path) const;
+  bool ReadFromFile(const char* path);
+
+  // Calls the backend hooks of target for every command in the stream.
+  // Returns false if the stream is malformed.
+  static bool Replay(const uint8_t* stream, const size_t size,
+                     ShadingSystem* target);
+
+ protected:
+  void BeginDispatch();
+  void BindShader(const uint32_t shader);
+  void ApplyState(const RenderState& state);
+  void BindGeometry(const RenderBlock& render_block);
+  void Draw(const RenderBlock& render_block, const DrawConstants* instances,
+            const uint32_t instance_count);
+  void Present();
+
+ private:
+  enum Command {
+    kBeginDispatch = 1,
+    kBindShader,
+    kApplyState,
+    kBindGeometry,
+    kDraw,
+    kPresent
+  };
+
+  template <class T>
+  void Write(const T& value) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+    stream_.insert(stream_.end(), data, data + sizeof(value));
+  }
+
+  template <class T>
+  void WriteBuffer(const Buffer<T>* buffer);
+
+  std::vector<uint8_t> stream_;
+  std::unordered_map<const void*, uint32_t> buffer_ids_;
+};
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_SHADING_SYSTEM_RECORDING_H_
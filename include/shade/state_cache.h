@@ -0,0 +1,93 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHADE_STATE_CACHE_H_
+#define SHADE_STATE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+
+namespace mx {
+namespace shade {
+
+struct RenderState {
+  float diffuse_color_[3];
+  float ambient_light_[6];
+  // Identifies the shader program. Only the lowest 12 bits are used for
+  // sorting.
+  uint32_t shader_;
+  // Translucent geometry is drawn after opaque geometry, back to front.
+  bool translucent_;
+};
+
+// Compact reference to a render state interned in a StateCache. Equal states
+// share the same handle, so comparing handles is enough to detect redundant
+// state changes.
+typedef uint32_t StateHandle;
+
+// Handle of the default state, which has all members set to zero.
+const StateHandle kDefaultState = 0;
+
+// Stores every distinct render state once. States are hashed by value, so
+// interning a state that is already known returns the existing handle.
+// States are stored in chunks and never move, so a thread may Get() a state
+// whose handle it was passed while another thread calls Intern(). Intern()
+// itself isn't thread-safe.
+class StateCache {
+ public:
+  static const uint32_t kChunkBits = 10;
+  static const uint32_t kChunkSize = 1 << kChunkBits;
+  static const uint32_t kMaxChunks = 1024;
+
+  StateCache();
+  ~StateCache();
+
+  StateHandle Intern(const RenderState& state);
+
+  const RenderState& Get(const StateHandle handle) const {
+    return chunks_[handle >> kChunkBits][handle & (kChunkSize - 1)];
+  }
+
+  uint32_t size() const { return size_; }
+
+  static bool Equal(const RenderState& a, const RenderState& b);
+  static uint64_t Hash(const RenderState& state);
+
+ private:
+  StateCache(const StateCache& other);
+  StateCache& operator=(const StateCache& other);
+
+  RenderState* chunks_[kMaxChunks];
+  uint32_t size_;
+  std::unordered_multimap<uint64_t, StateHandle> handles_;
+};
+
+}  // namespace shade
+}  // namespace mx
+
+#endif  // SHADE_STATE_CACHE_H_
@@ -0,0 +1,89 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include "mxcore/alignment.h"
+#include "mxcore/concurrent_linear_allocator.h"
+
+namespace mx {
+namespace core {
+
+ConcurrentLinearAllocator::ConcurrentLinearAllocator(void* base,
+                                                     const size_t size)
+    : size_(size),
+      base_(reinterpret_cast<uint8_t*>(base)),
+      end_(reinterpret_cast<uint8_t*>(base) + size),
+      marker_(reinterpret_cast<uintptr_t>(base)) {}
+
+void* ConcurrentLinearAllocator::Allocate(const size_t size) {
+  // Failed allocations still advance the marker past the end, which makes all
+  // subsequent allocations fail as well until the allocator is rewound.
+  uintptr_t result = marker_.fetch_add(size, std::memory_order_relaxed);
+
+  if (result + size > reinterpret_cast<uintptr_t>(end_)) {
+    return NULL;
+  }
+
+  return reinterpret_cast<void*>(result);
+}
+
+void* ConcurrentLinearAllocator::Allocate(const size_t size,
+                                          const size_t alignment,
+                                          const size_t offset) {
+  assert(IsPowerOfTwo(alignment));
+  uintptr_t end = reinterpret_cast<uintptr_t>(end_);
+  uintptr_t marker = marker_.load(std::memory_order_relaxed);
+  uintptr_t result;
+
+  do {
+    result = AlignUp(marker + offset, alignment) - offset;
+    if (result + size > end) {
+      return NULL;
+    }
+  } while (!marker_.compare_exchange_weak(marker, result + size,
+                                          std::memory_order_relaxed));
+
+  return reinterpret_cast<void*>(result);
+}
+
+void ConcurrentLinearAllocator::Rewind(void* to) {
+  assert((to >= base_) && (to <= end_));
+  marker_.store(reinterpret_cast<uintptr_t>(to), std::memory_order_relaxed);
+}
+
+void* ConcurrentLinearAllocator::marker() const {
+  uintptr_t marker = marker_.load(std::memory_order_relaxed);
+  uintptr_t end = reinterpret_cast<uintptr_t>(end_);
+  return reinterpret_cast<void*>(marker < end ? marker : end);
+}
+
+size_t ConcurrentLinearAllocator::bytes_allocated() const {
+  return reinterpret_cast<uint8_t*>(marker()) - base_;
+}
+
+}  // namespace core
+}  // namespace mx
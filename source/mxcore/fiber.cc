@@ -0,0 +1,165 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include "mxcore/fiber.h"
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define MXCORE_ADDRESS_SANITIZER 1
+#endif
+#if __has_feature(thread_sanitizer)
+#define MXCORE_THREAD_SANITIZER 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define MXCORE_ADDRESS_SANITIZER 1
+#endif
+#if defined(__SANITIZE_THREAD__)
+#define MXCORE_THREAD_SANITIZER 1
+#endif
+
+#if defined(MXCORE_ADDRESS_SANITIZER)
+extern "C" {
+void __sanitizer_start_switch_fiber(void** fake_stack_save, const void* bottom,
+                                    size_t size);
+void __sanitizer_finish_switch_fiber(void* fake_stack_save,
+                                     const void** bottom_old,
+                                     size_t* size_old);
+}
+#endif
+
+#if defined(MXCORE_THREAD_SANITIZER)
+extern "C" {
+void* __tsan_get_current_fiber();
+void* __tsan_create_fiber(unsigned flags);
+void __tsan_destroy_fiber(void* fiber);
+void __tsan_switch_to_fiber(void* fiber, unsigned flags);
+}
+#endif
+
+namespace mx {
+namespace core {
+
+namespace {
+
+#if defined(MXCORE_ADDRESS_SANITIZER)
+// The fiber the calling thread switched away from last.
+thread_local Fiber* previous_fiber = NULL;
+#endif
+
+}  // namespace
+
+Fiber::Fiber()
+    : function_(NULL),
+      argument_(NULL),
+      stack_(NULL),
+      stack_size_(0),
+      sanitizer_fiber_(NULL),
+      owns_sanitizer_fiber_(false) {
+}
+
+Fiber::~Fiber() {
+#if defined(MXCORE_THREAD_SANITIZER)
+  if (owns_sanitizer_fiber_) {
+    __tsan_destroy_fiber(sanitizer_fiber_);
+  }
+#endif
+}
+
+void Fiber::Reset(void* stack, const size_t stack_size, Function function,
+                  void* argument) {
+  function_ = function;
+  argument_ = argument;
+  stack_ = stack;
+  stack_size_ = stack_size;
+
+  const int result = getcontext(&context_);
+  assert(result == 0);
+  (void)result;
+  context_.uc_stack.ss_sp = stack;
+  context_.uc_stack.ss_size = stack_size;
+  context_.uc_link = NULL;
+
+  // makecontext() only passes int arguments, so the pointer is split.
+  const uint64_t address = reinterpret_cast<uintptr_t>(this);
+  makecontext(&context_, reinterpret_cast<void (*)()>(&Fiber::Start), 2,
+              static_cast<uint32_t>(address),
+              static_cast<uint32_t>(address >> 32));
+
+#if defined(MXCORE_THREAD_SANITIZER)
+  if (!owns_sanitizer_fiber_) {
+    sanitizer_fiber_ = __tsan_create_fiber(0);
+    owns_sanitizer_fiber_ = true;
+  }
+#endif
+}
+
+void Fiber::Switch(Fiber* from, Fiber* to) {
+#if defined(MXCORE_THREAD_SANITIZER)
+  if (from->sanitizer_fiber_ == NULL) {
+    from->sanitizer_fiber_ = __tsan_get_current_fiber();
+  }
+  __tsan_switch_to_fiber(to->sanitizer_fiber_, 0);
+#endif
+#if defined(MXCORE_ADDRESS_SANITIZER)
+  void* fake_stack = NULL;
+  previous_fiber = from;
+  __sanitizer_start_switch_fiber(&fake_stack, to->stack_, to->stack_size_);
+#endif
+  const int result = swapcontext(&from->context_, &to->context_);
+  assert(result == 0);
+  (void)result;
+#if defined(MXCORE_ADDRESS_SANITIZER)
+  FinishSwitch(fake_stack);
+#endif
+}
+
+void Fiber::FinishSwitch(void* fake_stack) {
+#if defined(MXCORE_ADDRESS_SANITIZER)
+  // Learns the bounds of a thread's own stack the first time it is left.
+  const void* bottom;
+  size_t size;
+  __sanitizer_finish_switch_fiber(fake_stack, &bottom, &size);
+  if (previous_fiber->stack_ == NULL) {
+    previous_fiber->stack_ = const_cast<void*>(bottom);
+    previous_fiber->stack_size_ = size;
+  }
+#endif
+}
+
+void Fiber::Start(uint32_t fiber_low, uint32_t fiber_high) {
+  const uint64_t address = (static_cast<uint64_t>(fiber_high) << 32) |
+                           fiber_low;
+  Fiber* fiber = reinterpret_cast<Fiber*>(static_cast<uintptr_t>(address));
+  FinishSwitch(NULL);
+  fiber->function_(fiber->argument_);
+  assert(false && "fiber function returned");
+}
+
+}  // namespace core
+}  // namespace mx
@@ -0,0 +1,92 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <new>
+#include "mxcore/frame_allocator.h"
+
+namespace mx {
+namespace core {
+
+FrameAllocator::FrameAllocator(const size_t arena_size,
+                               const uint32_t thread_count,
+                               const uint32_t frame_count,
+                               BlockAllocator* block_allocator)
+    : arena_size_(arena_size),
+      thread_count_(thread_count),
+      frame_count_(frame_count),
+      frame_index_(0),
+      frame_(0),
+      memory_(arena_size * thread_count * frame_count) {
+  assert(thread_count > 0 && thread_count <= kMaxThreads);
+  assert(frame_count > 0);
+
+  const uint32_t arena_count = kMaxThreads * frame_count_;
+  arenas_ = reinterpret_cast<LinearAllocator*>(
+      mxalloc(sizeof(LinearAllocator) * arena_count));
+
+  uint8_t* base = reinterpret_cast<uint8_t*>(memory_.pointer());
+  for (uint32_t frame = 0; frame < frame_count_; ++frame) {
+    for (uint32_t slot = 0; slot < kMaxThreads; ++slot) {
+      LinearAllocator* arena = &arenas_[frame * kMaxThreads + slot];
+      if (slot >= thread_count_) {
+        new(arena) LinearAllocator(NULL, 0, block_allocator != NULL ?
+                                   block_allocator : &heap_block_allocator_,
+                                   arena_size_);
+      } else if (block_allocator != NULL) {
+        new(arena) LinearAllocator(base, arena_size_, block_allocator,
+                                   arena_size_);
+        base += arena_size_;
+      } else {
+        new(arena) LinearAllocator(base, arena_size_);
+        base += arena_size_;
+      }
+    }
+  }
+}
+
+FrameAllocator::~FrameAllocator() {
+  const uint32_t arena_count = kMaxThreads * frame_count_;
+  for (uint32_t i = 0; i < arena_count; ++i) {
+    arenas_[i].~LinearAllocator();
+  }
+  mxfree(arenas_);
+}
+
+void FrameAllocator::BeginFrame() {
+  frame_index_ = (frame_index_ + 1) % frame_count_;
+  ++frame_;
+
+  uint8_t* base = reinterpret_cast<uint8_t*>(memory_.pointer()) +
+                  frame_index_ * thread_count_ * arena_size_;
+  for (uint32_t i = 0; i < kMaxThreads; ++i) {
+    arena(i).Rewind(i < thread_count_ ? base + i * arena_size_ : NULL);
+  }
+}
+
+}  // namespace core
+}  // namespace mx
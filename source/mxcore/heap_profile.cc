@@ -0,0 +1,268 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "mxcore/heap_profile.h"
+
+namespace mx {
+namespace core {
+
+namespace {
+
+// Orders sites by file name and line for merging and matching.
+bool SiteLess(const CallSiteStatistics& a, const CallSiteStatistics& b) {
+  int compare = strcmp(a.file_, b.file_);
+  return (compare < 0) || (compare == 0 && a.line_ < b.line_);
+}
+
+bool SameSite(const CallSiteStatistics& a, const CallSiteStatistics& b) {
+  return a.line_ == b.line_ && strcmp(a.file_, b.file_) == 0;
+}
+
+// Sorts by site and merges entries with equal file names but different string
+// addresses. The peaks of the merged entries may have been reached at
+// different times, so the merged peak is the largest of them, but at least
+// the merged live bytes.
+void Normalize(std::vector<CallSiteStatistics>* sites) {
+  std::sort(sites->begin(), sites->end(), SiteLess);
+
+  size_t last = 0;
+  for (size_t i = 1; i < sites->size(); ++i) {
+    CallSiteStatistics& target = (*sites)[last];
+    const CallSiteStatistics& site = (*sites)[i];
+    if (SameSite(target, site)) {
+      target.live_bytes_ += site.live_bytes_;
+      target.live_count_ += site.live_count_;
+      target.peak_bytes_ = std::max(target.peak_bytes_, site.peak_bytes_);
+      target.total_count_ += site.total_count_;
+      target.total_bytes_ += site.total_bytes_;
+      target.allocation_rate_ += site.allocation_rate_;
+      target.peak_bytes_ = std::max(target.peak_bytes_, target.live_bytes_);
+    } else {
+      (*sites)[++last] = site;
+    }
+  }
+
+  if (!sites->empty()) {
+    sites->resize(last + 1);
+  }
+}
+
+double GetTime() {
+  static const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs at static initialization, so times are measured from process start.
+const double kStartTime = GetTime();
+
+template <class T>
+struct Descending {
+  explicit Descending(T CallSiteStatistics::*member) : member_(member) {}
+  bool operator()(const CallSiteStatistics& a,
+                  const CallSiteStatistics& b) const {
+    return a.*member_ > b.*member_;
+  }
+  T CallSiteStatistics::*member_;
+};
+
+// Quotes in CSV fields are escaped by doubling them.
+void WriteCsvString(FILE* file, const char* string) {
+  fputc('"', file);
+  for (const char* c = string; *c != '\0'; ++c) {
+    if (*c == '"') {
+      fputc('"', file);
+    }
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+void WriteJsonString(FILE* file, const char* string) {
+  fputc('"', file);
+  for (const char* c = string; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+void HeapSnapshot::Capture() {
+  MemoryTracker::GetCallSites(&sites_);
+  time_ = GetTime();
+  Normalize(&sites_);
+
+  double elapsed = time_ - kStartTime;
+  for (size_t i = 0; i < sites_.size(); ++i) {
+    sites_[i].allocation_rate_ = (elapsed > 0.0) ?
+        sites_[i].total_count_ / elapsed : 0.0;
+  }
+}
+
+HeapSnapshot HeapSnapshot::Diff(const HeapSnapshot& before,
+                                const HeapSnapshot& after) {
+  HeapSnapshot result;
+  result.time_ = after.time_;
+  double elapsed = after.time_ - before.time_;
+
+  // Both snapshots are sorted by site after Capture(), unless they have been
+  // sorted by cost since, so work on sorted copies.
+  std::vector<CallSiteStatistics> a(before.sites_);
+  std::vector<CallSiteStatistics> b(after.sites_);
+  std::sort(a.begin(), a.end(), SiteLess);
+  std::sort(b.begin(), b.end(), SiteLess);
+
+  size_t i = 0;
+  size_t j = 0;
+  while (j < b.size()) {
+    if (i < a.size() && SiteLess(a[i], b[j])) {
+      // Sites never disappear, but tolerate snapshots from other sources.
+      ++i;
+      continue;
+    }
+
+    CallSiteStatistics site = b[j];
+    if (i < a.size() && SameSite(a[i], b[j])) {
+      site.live_bytes_ -= a[i].live_bytes_;
+      site.live_count_ -= a[i].live_count_;
+      site.total_count_ -= a[i].total_count_;
+      site.total_bytes_ -= a[i].total_bytes_;
+      ++i;
+    }
+    site.allocation_rate_ = (elapsed > 0.0) ? site.total_count_ / elapsed :
+                                              0.0;
+
+    if (site.live_bytes_ != 0 || site.live_count_ != 0 ||
+        site.total_count_ != 0) {
+      result.sites_.push_back(site);
+    }
+    ++j;
+  }
+
+  return result;
+}
+
+void HeapSnapshot::Sort(const SortOrder order) {
+  switch (order) {
+    case kSortByLiveBytes:
+      std::stable_sort(sites_.begin(), sites_.end(),
+          Descending<int64_t>(&CallSiteStatistics::live_bytes_));
+      break;
+    case kSortByLiveCount:
+      std::stable_sort(sites_.begin(), sites_.end(),
+          Descending<int64_t>(&CallSiteStatistics::live_count_));
+      break;
+    case kSortByPeakBytes:
+      std::stable_sort(sites_.begin(), sites_.end(),
+          Descending<int64_t>(&CallSiteStatistics::peak_bytes_));
+      break;
+    case kSortByTotalCount:
+      std::stable_sort(sites_.begin(), sites_.end(),
+          Descending<uint64_t>(&CallSiteStatistics::total_count_));
+      break;
+    case kSortByTotalBytes:
+      std::stable_sort(sites_.begin(), sites_.end(),
+          Descending<uint64_t>(&CallSiteStatistics::total_bytes_));
+      break;
+    case kSortByAllocationRate:
+      std::stable_sort(sites_.begin(), sites_.end(),
+          Descending<double>(&CallSiteStatistics::allocation_rate_));
+      break;
+  }
+}
+
+void HeapSnapshot::Print(FILE* file, const size_t max_sites) const {
+  fprintf(file, "%14s %10s %14s %12s %14s %12s  %s\n", "live bytes", "live",
+          "peak bytes", "allocations", "total bytes", "per second",
+          "call site");
+
+  size_t count = std::min(max_sites, sites_.size());
+  for (size_t i = 0; i < count; ++i) {
+    const CallSiteStatistics& site = sites_[i];
+    fprintf(file, "%14lld %10lld %14lld %12llu %14llu %12.1f  %s:%u\n",
+            static_cast<long long>(site.live_bytes_),
+            static_cast<long long>(site.live_count_),
+            static_cast<long long>(site.peak_bytes_),
+            static_cast<unsigned long long>(site.total_count_),
+            static_cast<unsigned long long>(site.total_bytes_),
+            site.allocation_rate_, site.file_, site.line_);
+  }
+
+  if (count < sites_.size()) {
+    fprintf(file, "... %lu more call sites\n",
+            static_cast<unsigned long>(sites_.size() - count));
+  }
+}
+
+void HeapSnapshot::WriteCsv(FILE* file) const {
+  fprintf(file, "file,line,live_bytes,live_count,peak_bytes,total_count,"
+                "total_bytes,allocation_rate\n");
+
+  for (size_t i = 0; i < sites_.size(); ++i) {
+    const CallSiteStatistics& site = sites_[i];
+    WriteCsvString(file, site.file_);
+    fprintf(file, ",%u,%lld,%lld,%lld,%llu,%llu,%f\n", site.line_,
+            static_cast<long long>(site.live_bytes_),
+            static_cast<long long>(site.live_count_),
+            static_cast<long long>(site.peak_bytes_),
+            static_cast<unsigned long long>(site.total_count_),
+            static_cast<unsigned long long>(site.total_bytes_),
+            site.allocation_rate_);
+  }
+}
+
+void HeapSnapshot::WriteJson(FILE* file) const {
+  fprintf(file, "{\"time\": %f, \"sites\": [", time_);
+
+  for (size_t i = 0; i < sites_.size(); ++i) {
+    const CallSiteStatistics& site = sites_[i];
+    fprintf(file, "%s\n  {\"file\": ", (i > 0) ? "," : "");
+    WriteJsonString(file, site.file_);
+    fprintf(file, ", \"line\": %u, \"live_bytes\": %lld, \"live_count\": %lld, "
+                  "\"peak_bytes\": %lld, \"total_count\": %llu, "
+                  "\"total_bytes\": %llu, \"allocation_rate\": %f}",
+            site.line_, static_cast<long long>(site.live_bytes_),
+            static_cast<long long>(site.live_count_),
+            static_cast<long long>(site.peak_bytes_),
+            static_cast<unsigned long long>(site.total_count_),
+            static_cast<unsigned long long>(site.total_bytes_),
+            site.allocation_rate_);
+  }
+
+  fprintf(file, "\n]}\n");
+}
+
+}  // namespace core
+}  // namespace mx
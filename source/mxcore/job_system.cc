@@ -0,0 +1,564 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "mxcore/job_system.h"
+#include "mxcore/thread_index.h"
+#include "mxcore/work_stealing_deque.h"
+
+namespace mx {
+namespace core {
+
+namespace {
+
+// Rounds of failed steal attempts before a worker goes to sleep.
+const uint32_t kIdleRounds = 64;
+
+}  // namespace
+
+// A fiber of the pool, or a worker thread's own context.
+struct JobFiber {
+  JobFiber() : system_(NULL), worker_(0), next_(NULL), stack_(NULL) {}
+
+  Fiber fiber_;
+  JobSystem* system_;
+  // The worker running the fiber. A suspended fiber resumes on it.
+  uint32_t worker_;
+  // Links fibers waiting for the same counter or ready to resume.
+  JobFiber* next_;
+  // NULL for a thread's own context.
+  void* stack_;
+};
+
+struct alignas(kCacheLineSize) JobSystem::Worker {
+  Worker(JobSystem* system, const uint32_t index, void* arena_base,
+         const size_t arena_size, const uint32_t deque_capacity)
+      : system_(system),
+        index_(index),
+        random_(index * 2654435761u + 1),
+        arena_base_(arena_base),
+        arena_(arena_base, arena_size, &system->block_allocator_,
+               arena_size),
+        deque_(deque_capacity),
+        current_fiber_(&thread_fiber_),
+        ready_(NULL),
+        release_fiber_(NULL),
+        suspended_fiber_(NULL),
+        suspended_counter_(NULL),
+        statistics_() {
+    thread_fiber_.system_ = system;
+    thread_fiber_.worker_ = index;
+  }
+
+  // Picks steal victims.
+  uint32_t NextRandom() {
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 17;
+    random_ ^= random_ << 5;
+    return random_;
+  }
+
+  // Only written by the worker itself, but read by others.
+  void Count(std::atomic<uint64_t>* counter) {
+    counter->store(counter->load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  }
+
+  JobSystem* system_;
+  const uint32_t index_;
+  uint32_t random_;
+  void* arena_base_;
+  LinearAllocator arena_;
+  WorkStealingDeque<Job> deque_;
+
+  JobFiber thread_fiber_;
+  JobFiber* current_fiber_;
+  // Suspended fibers whose counters dropped to zero.
+  std::atomic<JobFiber*> ready_;
+  // Left behind by the last switch; see AfterSwitch().
+  JobFiber* release_fiber_;
+  JobFiber* suspended_fiber_;
+  JobCounter* suspended_counter_;
+
+  struct {
+    std::atomic<uint64_t> executed_;
+    std::atomic<uint64_t> stolen_;
+    std::atomic<uint64_t> steal_attempts_;
+    std::atomic<uint64_t> overflows_;
+    std::atomic<uint64_t> sleeps_;
+    std::atomic<uint64_t> suspends_;
+  } statistics_;
+};
+
+thread_local JobSystem::Worker* JobSystem::current_worker_ = NULL;
+
+JobSystem::JobSystem(const uint32_t worker_count, const size_t arena_size,
+                     const uint32_t deque_capacity, const uint32_t fiber_count,
+                     const size_t fiber_stack_size)
+    : worker_count_(std::min((worker_count > 0) ? worker_count :
+                             std::max(std::thread::hardware_concurrency(), 1u),
+                             kMaxThreads)),
+      fiber_count_(fiber_count),
+      fiber_stack_size_(AlignUp(fiber_stack_size, kCacheLineSize)),
+      arena_memory_(AlignUp(arena_size, kCacheLineSize) * worker_count_),
+      worker_memory_(sizeof(Worker) * worker_count_),
+      workers_(reinterpret_cast<Worker*>(worker_memory_.pointer())),
+      stack_memory_(fiber_stack_size_ * fiber_count),
+      fibers_(new JobFiber[fiber_count]),
+      sleeping_(0),
+      stopping_(false),
+      wake_epoch_(0) {
+  const size_t stride = AlignUp(arena_size, kCacheLineSize);
+  uint8_t* arena_base = reinterpret_cast<uint8_t*>(arena_memory_.pointer());
+  for (uint32_t i = 0; i < worker_count_; ++i) {
+    new(&workers_[i]) Worker(this, i, arena_base + i * stride, arena_size,
+                             deque_capacity);
+  }
+
+  uint8_t* stack_base = reinterpret_cast<uint8_t*>(stack_memory_.pointer());
+  fiber_pool_.reserve(fiber_count_);
+  for (uint32_t i = 0; i < fiber_count_; ++i) {
+    fibers_[i].system_ = this;
+    fibers_[i].stack_ = stack_base + i * fiber_stack_size_;
+    fiber_pool_.push_back(&fibers_[fiber_count_ - 1 - i]);
+  }
+
+  assert(current_worker_ == NULL);
+  current_worker_ = &workers_[0];
+  threads_.reserve(worker_count_ - 1);
+  for (uint32_t i = 1; i < worker_count_; ++i) {
+    threads_.push_back(std::thread(&JobSystem::WorkerMain, this,
+                                   &workers_[i]));
+  }
+}
+
+JobSystem::~JobSystem() {
+  stopping_.store(true, std::memory_order_release);
+  WakeWorkers();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+
+  assert(current_worker_ == &workers_[0]);
+  assert(fiber_pool_.size() == fiber_count_);
+  current_worker_ = NULL;
+  for (uint32_t i = 0; i < worker_count_; ++i) {
+    assert(workers_[i].deque_.size() == 0);
+    assert(workers_[i].current_fiber_ == &workers_[i].thread_fiber_);
+    workers_[i].~Worker();
+  }
+  delete[] fibers_;
+}
+
+Job* JobSystem::CreateJob(JobFunction function, const void* data,
+                          const size_t size, JobCounter* counter) {
+  assert(size <= kJobDataSize);
+  Worker* worker = GetCurrentWorker();
+  Job* job = reinterpret_cast<Job*>(
+      worker->arena_.Allocate(sizeof(Job), kCacheLineSize));
+  job->function_ = function;
+  job->counter_ = counter;
+  job->next_ = NULL;
+  if (size > 0) {
+    memcpy(job->data_, data, size);
+  }
+
+  if (counter != NULL) {
+    counter->value_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+void JobSystem::Run(Job* job) {
+  Worker* worker = GetCurrentWorker();
+  if (!worker->deque_.Push(job)) {
+    worker->Count(&worker->statistics_.overflows_);
+    Execute(worker, job);
+    return;
+  }
+
+  // Pairs with the fence in Sleep(): either the sleeping worker finds the job
+  // or it is counted here and woken up.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed) > 0) {
+    WakeWorkers();
+  }
+}
+
+void JobSystem::RunAfter(JobCounter* dependency, Job* job) {
+  dependency->Lock();
+  if (dependency->value_.load(std::memory_order_acquire) == 0) {
+    dependency->Unlock();
+    Run(job);
+    return;
+  }
+
+  job->next_ = dependency->waiting_;
+  dependency->waiting_ = job;
+  dependency->Unlock();
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+  Worker* worker = GetCurrentWorker();
+  while (counter->value_.load(std::memory_order_acquire) > 0) {
+    if (fiber_count_ > 0) {
+      // Suspends the calling fiber and continues with a ready fiber or a
+      // fresh one from the pool. Returns here once counter dropped to zero.
+      JobFiber* next = PopReady(worker);
+      if (next == NULL) {
+        next = AcquireFiber(worker);
+      }
+      if (next != NULL) {
+        worker->Count(&worker->statistics_.suspends_);
+        worker->suspended_fiber_ = worker->current_fiber_;
+        worker->suspended_counter_ = counter;
+        SwitchTo(worker, next);
+        continue;
+      }
+    }
+
+    Job* job = FindJob(worker);
+    if (job != NULL) {
+      Execute(worker, job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  // The job finishing the counter drops it to zero while holding the lock.
+  // Waiting for the lock keeps the caller from destroying the counter before
+  // that job is done with it.
+  counter->Lock();
+  counter->Unlock();
+}
+
+void JobSystem::Reset() {
+  assert(current_worker_ == &workers_[0]);
+  for (uint32_t i = 0; i < worker_count_; ++i) {
+    assert(workers_[i].deque_.size() == 0);
+    workers_[i].arena_.Rewind(workers_[i].arena_base_);
+  }
+}
+
+uint32_t JobSystem::current_worker() const {
+  return GetCurrentWorker()->index_;
+}
+
+JobStatistics JobSystem::statistics() const {
+  JobStatistics total;
+  memset(&total, 0, sizeof(total));
+  for (uint32_t i = 0; i < worker_count_; ++i) {
+    const JobStatistics worker = statistics(i);
+    total.executed_ += worker.executed_;
+    total.stolen_ += worker.stolen_;
+    total.steal_attempts_ += worker.steal_attempts_;
+    total.overflows_ += worker.overflows_;
+    total.sleeps_ += worker.sleeps_;
+    total.suspends_ += worker.suspends_;
+  }
+  return total;
+}
+
+JobStatistics JobSystem::statistics(const uint32_t worker) const {
+  assert(worker < worker_count_);
+  const Worker& source = workers_[worker];
+  JobStatistics result;
+  result.executed_ = source.statistics_.executed_.load();
+  result.stolen_ = source.statistics_.stolen_.load();
+  result.steal_attempts_ = source.statistics_.steal_attempts_.load();
+  result.overflows_ = source.statistics_.overflows_.load();
+  result.sleeps_ = source.statistics_.sleeps_.load();
+  result.suspends_ = source.statistics_.suspends_.load();
+  return result;
+}
+
+void JobSystem::ResetStatistics() {
+  for (uint32_t i = 0; i < worker_count_; ++i) {
+    workers_[i].statistics_.executed_.store(0);
+    workers_[i].statistics_.stolen_.store(0);
+    workers_[i].statistics_.steal_attempts_.store(0);
+    workers_[i].statistics_.overflows_.store(0);
+    workers_[i].statistics_.sleeps_.store(0);
+    workers_[i].statistics_.suspends_.store(0);
+  }
+}
+
+uint32_t JobSystem::free_fiber_count() const {
+  std::lock_guard<std::mutex> lock(fiber_pool_mutex_);
+  return static_cast<uint32_t>(fiber_pool_.size());
+}
+
+const LinearAllocator& JobSystem::arena(const uint32_t worker) const {
+  assert(worker < worker_count_);
+  return workers_[worker].arena_;
+}
+
+void JobSystem::WorkerMain(Worker* worker) {
+  current_worker_ = worker;
+  Schedule(worker);
+  current_worker_ = NULL;
+}
+
+void JobSystem::FiberMain(void* argument) {
+  JobFiber* fiber = reinterpret_cast<JobFiber*>(argument);
+  JobSystem* system = fiber->system_;
+  Worker* worker = &system->workers_[fiber->worker_];
+  system->AfterSwitch(worker);
+  system->Schedule(worker);
+}
+
+void JobSystem::Schedule(Worker* worker) {
+  // Only the thread's own context leaves the loop; pooled fibers keep
+  // resuming ready fibers until the thread's context is among them.
+  uint32_t idle_rounds = 0;
+  while (!stopping_.load(std::memory_order_acquire) ||
+         worker->current_fiber_ != &worker->thread_fiber_) {
+    JobFiber* ready = PopReady(worker);
+    if (ready != NULL) {
+      worker->release_fiber_ = worker->current_fiber_;
+      SwitchTo(worker, ready);
+      idle_rounds = 0;
+      continue;
+    }
+
+    Job* job = FindJob(worker);
+    if (job != NULL) {
+      Execute(worker, job);
+      idle_rounds = 0;
+    } else if (++idle_rounds < kIdleRounds) {
+      std::this_thread::yield();
+    } else {
+      Sleep(worker);
+      idle_rounds = 0;
+    }
+  }
+}
+
+JobSystem::Worker* JobSystem::GetCurrentWorker() const {
+  assert(current_worker_ != NULL && current_worker_->system_ == this &&
+         "not a thread of this job system");
+  return current_worker_;
+}
+
+Job* JobSystem::FindJob(Worker* worker) {
+  Job* job = worker->deque_.Pop();
+  if (job != NULL || worker_count_ == 1) {
+    return job;
+  }
+
+  // Tries every other worker once, starting at a random one.
+  const uint32_t start = worker->NextRandom() % worker_count_;
+  for (uint32_t i = 0; i < worker_count_; ++i) {
+    const uint32_t victim = (start + i) % worker_count_;
+    if (victim == worker->index_) {
+      continue;
+    }
+
+    worker->Count(&worker->statistics_.steal_attempts_);
+    job = workers_[victim].deque_.Steal();
+    if (job != NULL) {
+      worker->Count(&worker->statistics_.stolen_);
+      return job;
+    }
+  }
+  return NULL;
+}
+
+void JobSystem::Execute(Worker* worker, Job* job) {
+  job->function_(this, job->data_);
+  worker->Count(&worker->statistics_.executed_);
+  if (job->counter_ != NULL) {
+    Finish(job->counter_);
+  }
+}
+
+void JobSystem::Finish(JobCounter* counter) {
+  uint32_t value = counter->value_.load(std::memory_order_relaxed);
+  for (;;) {
+    assert(value > 0);
+    if (value > 1) {
+      if (counter->value_.compare_exchange_weak(value, value - 1,
+                                                std::memory_order_acq_rel)) {
+        return;
+      }
+      continue;
+    }
+
+    // Possibly the last job. Takes the waiting jobs and drops the counter to
+    // zero atomically with respect to RunAfter() and Wait().
+    counter->Lock();
+    value = 1;
+    if (counter->value_.compare_exchange_strong(value, 0,
+                                                std::memory_order_acq_rel)) {
+      Job* waiting = counter->waiting_;
+      JobFiber* fibers = counter->fibers_;
+      counter->waiting_ = NULL;
+      counter->fibers_ = NULL;
+      counter->Unlock();
+      while (waiting != NULL) {
+        Job* next = waiting->next_;
+        Run(waiting);
+        waiting = next;
+      }
+      while (fibers != NULL) {
+        JobFiber* next = fibers->next_;
+        MakeReady(fibers);
+        fibers = next;
+      }
+      return;
+    }
+    counter->Unlock();
+  }
+}
+
+void JobSystem::Sleep(Worker* worker) {
+  uint64_t epoch;
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    epoch = wake_epoch_;
+  }
+
+  sleeping_.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (worker->ready_.load(std::memory_order_relaxed) != NULL) {
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  Job* job = FindJob(worker);
+  if (job != NULL) {
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    Execute(worker, job);
+    return;
+  }
+
+  worker->Count(&worker->statistics_.sleeps_);
+  {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (epoch == wake_epoch_ &&
+           !stopping_.load(std::memory_order_acquire)) {
+      wake_condition_.wait(lock);
+    }
+  }
+  sleeping_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void JobSystem::WakeWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    ++wake_epoch_;
+  }
+  wake_condition_.notify_all();
+}
+
+JobFiber* JobSystem::AcquireFiber(Worker* worker) {
+  JobFiber* fiber;
+  {
+    std::lock_guard<std::mutex> lock(fiber_pool_mutex_);
+    if (fiber_pool_.empty()) {
+      return NULL;
+    }
+    fiber = fiber_pool_.back();
+    fiber_pool_.pop_back();
+  }
+
+  fiber->worker_ = worker->index_;
+  fiber->fiber_.Reset(fiber->stack_, fiber_stack_size_, &JobSystem::FiberMain,
+                      fiber);
+  return fiber;
+}
+
+void JobSystem::SwitchTo(Worker* worker, JobFiber* fiber) {
+  JobFiber* current = worker->current_fiber_;
+  worker->current_fiber_ = fiber;
+  Fiber::Switch(&current->fiber_, &fiber->fiber_);
+  // Fibers never change workers, so worker is still the calling one.
+  AfterSwitch(worker);
+}
+
+void JobSystem::AfterSwitch(Worker* worker) {
+  // A fiber that stopped running jobs goes back to the pool. A thread's own
+  // context can't, it continues scheduling once the worker gets to it.
+  JobFiber* released = worker->release_fiber_;
+  if (released != NULL) {
+    worker->release_fiber_ = NULL;
+    if (released->stack_ != NULL) {
+      std::lock_guard<std::mutex> lock(fiber_pool_mutex_);
+      fiber_pool_.push_back(released);
+    } else {
+      MakeReady(released);
+    }
+  }
+
+  // A fiber is only parked on its counter once it stopped running, so that
+  // no other worker can resume it too early.
+  JobFiber* suspended = worker->suspended_fiber_;
+  if (suspended != NULL) {
+    JobCounter* counter = worker->suspended_counter_;
+    worker->suspended_fiber_ = NULL;
+    worker->suspended_counter_ = NULL;
+    counter->Lock();
+    if (counter->value_.load(std::memory_order_acquire) == 0) {
+      counter->Unlock();
+      MakeReady(suspended);
+    } else {
+      suspended->next_ = counter->fibers_;
+      counter->fibers_ = suspended;
+      counter->Unlock();
+    }
+  }
+}
+
+void JobSystem::MakeReady(JobFiber* fiber) {
+  Worker& worker = workers_[fiber->worker_];
+  JobFiber* head = worker.ready_.load(std::memory_order_relaxed);
+  do {
+    fiber->next_ = head;
+  } while (!worker.ready_.compare_exchange_weak(head, fiber,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed));
+
+  // Pairs with the fence in Sleep(), like Run().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed) > 0) {
+    WakeWorkers();
+  }
+}
+
+JobFiber* JobSystem::PopReady(Worker* worker) {
+  // Only the owning worker pops, so the head's successor can't change while
+  // it is being popped.
+  JobFiber* head = worker->ready_.load(std::memory_order_acquire);
+  while (head != NULL &&
+         !worker->ready_.compare_exchange_weak(head, head->next_,
+                                               std::memory_order_acquire,
+                                               std::memory_order_acquire)) {
+  }
+  return head;
+}
+
+}  // namespace core
+}  // namespace mx
@@ -26,27 +26,198 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
+#include "mxcore/alignment.h"
 #include "mxcore/linear_allocator.h"
+#include "mxcore/memory_tracker.h"
 
 namespace mx {
 namespace core {
 
-LinearAllocator::LinearAllocator(void* base, const size_t size) : size_(size) {
-  base_ = marker_ = reinterpret_cast<uint8_t*>(base);
-  end_ = base_ + size;
+namespace {
+
+const size_t kBlockDataAlignment = 16;
+
+}  // namespace
+
+void* HeapBlockAllocator::AllocateBlock(const size_t size) {
+  return mxalloc(size);
+}
+
+void HeapBlockAllocator::FreeBlock(void* block, const size_t size) {
+  mxfree(block);
+}
+
+LinearAllocator::LinearAllocator(void* base, const size_t size)
+    : size_(size),
+      block_allocator_(NULL),
+      block_size_(0),
+      current_block_(NULL),
+      spare_blocks_(NULL),
+      previous_bytes_allocated_(0),
+      high_water_mark_(0),
+      block_count_(0),
+      spare_block_count_(0) {
+  base_ = marker_ = initial_base_ = reinterpret_cast<uint8_t*>(base);
+  end_ = initial_end_ = base_ + size;
+}
+
+LinearAllocator::LinearAllocator(void* base, const size_t size,
+                                 BlockAllocator* block_allocator,
+                                 const size_t block_size)
+    : size_(size),
+      block_allocator_(block_allocator),
+      block_size_(block_size),
+      current_block_(NULL),
+      spare_blocks_(NULL),
+      previous_bytes_allocated_(0),
+      high_water_mark_(0),
+      block_count_(0),
+      spare_block_count_(0) {
+  assert(block_allocator != NULL);
+  base_ = marker_ = initial_base_ = reinterpret_cast<uint8_t*>(base);
+  end_ = initial_end_ = base_ + size;
+}
+
+LinearAllocator::~LinearAllocator() {
+  if (current_block_ != NULL) {
+    Rewind(initial_base_);
+  }
+
+  while (spare_blocks_ != NULL) {
+    Block* block = spare_blocks_;
+    spare_blocks_ = block->previous_;
+    block_allocator_->FreeBlock(block, block->size_);
+  }
 }
 
 void* LinearAllocator::Allocate(const size_t size) {
+  if (size > static_cast<size_t>(end_ - marker_)) {
+    return Grow(size, 1, 0);
+  }
+
   uint8_t* result = marker_;
   marker_ += size;
-  assert(marker_ <= end_);
   return result;
 }
 
+void* LinearAllocator::Allocate(const size_t size, const size_t alignment,
+                                const size_t offset) {
+  assert(IsPowerOfTwo(alignment));
+  uintptr_t address = reinterpret_cast<uintptr_t>(marker_) + offset;
+  uintptr_t result = AlignUp(address, alignment) - offset;
+
+  if (result + size > reinterpret_cast<uintptr_t>(end_)) {
+    return Grow(size, alignment, offset);
+  }
+
+  marker_ = reinterpret_cast<uint8_t*>(result + size);
+  return reinterpret_cast<void*>(result);
+}
+
 void LinearAllocator::Rewind(void* to) {
+  UpdateHighWaterMark();
+
+  while ((current_block_ != NULL) && !((to >= base_) && (to <= end_))) {
+    ReleaseBlock();
+  }
+
   assert((to >= base_) && (to <= end_));
   marker_ = reinterpret_cast<uint8_t*>(to);
 }
 
+void LinearAllocator::ResetHighWaterMark() {
+  high_water_mark_ = bytes_allocated();
+}
+
+size_t LinearAllocator::size() const {
+  return growing() ? static_cast<size_t>(-1) : size_;
+}
+
+size_t LinearAllocator::high_water_mark() const {
+  size_t allocated = bytes_allocated();
+  return (allocated > high_water_mark_) ? allocated : high_water_mark_;
+}
+
+void* LinearAllocator::Grow(const size_t size, const size_t alignment,
+                            const size_t offset) {
+  if (block_allocator_ == NULL) {
+    assert(false && "LinearAllocator exhausted");
+    return NULL;
+  }
+
+  UpdateHighWaterMark();
+
+  // Worst case size including the header and alignment padding.
+  size_t header_size = AlignUp(sizeof(Block), kBlockDataAlignment);
+  size_t required = header_size + size + offset + alignment - 1;
+
+  Block* block = NULL;
+  for (Block** spare = &spare_blocks_; *spare != NULL;
+       spare = &(*spare)->previous_) {
+    if ((*spare)->size_ >= required) {
+      block = *spare;
+      *spare = block->previous_;
+      --spare_block_count_;
+      break;
+    }
+  }
+
+  if (block == NULL) {
+    size_t block_size = (block_size_ > required) ? block_size_ : required;
+    block = reinterpret_cast<Block*>(
+        block_allocator_->AllocateBlock(block_size));
+    if (block == NULL) {
+      return NULL;
+    }
+    block->size_ = block_size;
+  }
+
+  block->previous_ = current_block_;
+  block->previous_bytes_allocated_ = previous_bytes_allocated_;
+  previous_bytes_allocated_ += marker_ - base_;
+  current_block_ = block;
+  ++block_count_;
+
+  base_ = marker_ = GetBlockData(block);
+  end_ = reinterpret_cast<uint8_t*>(block) + block->size_;
+
+  return Allocate(size, alignment, offset);
+}
+
+void LinearAllocator::ReleaseBlock() {
+  Block* block = current_block_;
+  current_block_ = block->previous_;
+  previous_bytes_allocated_ = block->previous_bytes_allocated_;
+  --block_count_;
+
+  block->previous_ = spare_blocks_;
+  spare_blocks_ = block;
+  ++spare_block_count_;
+
+  if (current_block_ != NULL) {
+    base_ = GetBlockData(current_block_);
+    end_ = reinterpret_cast<uint8_t*>(current_block_) + current_block_->size_;
+  } else {
+    base_ = initial_base_;
+    end_ = initial_end_;
+  }
+
+  // The marker of the block we return to is unknown at this point, Rewind()
+  // sets it right after.
+  marker_ = end_;
+}
+
+void LinearAllocator::UpdateHighWaterMark() {
+  size_t allocated = bytes_allocated();
+  if (allocated > high_water_mark_) {
+    high_water_mark_ = allocated;
+  }
+}
+
+uint8_t* LinearAllocator::GetBlockData(Block* block) {
+  return reinterpret_cast<uint8_t*>(block) +
+         AlignUp(sizeof(Block), kBlockDataAlignment);
+}
+
 }  // namespace core
 }  // namespace mx
@@ -25,6 +25,14 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "mxcore/alignment.h"
+#include "mxcore/heap_profile.h"
 #include "mxcore/memory_tracker.h"
 
 namespace mx {
@@ -41,42 +49,696 @@ Allocation::Allocation(void* pointer, const char* file, const uint32_t line,
 
 }  // namespace internal
 
-size_t MemoryTracker::bytes_allocated_ = 0;
-MemoryTracker::AllocationMap MemoryTracker::allocations_;
+namespace {
+
+// Number of records in the static table of every shard, has to be a power
+// of two.
+#ifndef MX_MEMORY_TRACKER_SHARD_CAPACITY
+  #define MX_MEMORY_TRACKER_SHARD_CAPACITY 1024
+#endif
+
+// Maximum number of distinct call sites, has to be a power of two.
+#ifndef MX_MEMORY_TRACKER_SITE_CAPACITY
+  #define MX_MEMORY_TRACKER_SITE_CAPACITY 4096
+#endif
+
+const uint32_t kShardBits = 6;
+const uint32_t kShardCount = 1 << kShardBits;
+const uint32_t kMinimumCapacity = 16;
+const uint32_t kShardCapacity = MX_MEMORY_TRACKER_SHARD_CAPACITY;
+const size_t kReportedSites = 20;
+const uint32_t kSiteCapacity = MX_MEMORY_TRACKER_SITE_CAPACITY;
+
+// Allocations from sites that don't fit into the site table any more are
+// accounted to this extra entry.
+const uint32_t kOverflowSite = kSiteCapacity;
+
+static_assert((kSiteCapacity & (kSiteCapacity - 1)) == 0,
+              "MX_MEMORY_TRACKER_SITE_CAPACITY has to be a power of two");
+static_assert(kShardCapacity >= kMinimumCapacity &&
+              (kShardCapacity & (kShardCapacity - 1)) == 0,
+              "MX_MEMORY_TRACKER_SHARD_CAPACITY has to be a power of two");
+
+struct Record {
+  void* pointer_;
+  const char* file_;
+  size_t size_;
+  uint32_t line_;
+  uint32_t site_;
+  uint32_t frame_;
+};
+
+// Counters are only modified while the shard is locked, but may be read
+// without locking.
+struct SizeClassCounters {
+  std::atomic<uint64_t> live_count_;
+  std::atomic<uint64_t> live_bytes_;
+  std::atomic<uint64_t> total_count_;
+  std::atomic<uint64_t> total_bytes_;
+  std::atomic<uint64_t> lifetimes_[kLifetimeBucketCount];
+};
+
+// Minimal spin lock. Its zero state is unlocked, so shards are usable before
+// static constructors run.
+class SpinLock {
+ public:
+  void Lock() {
+    for (uint32_t spins = 0;
+         state_.exchange(1, std::memory_order_acquire) != 0; ++spins) {
+      if (spins > 64) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void Unlock() { state_.store(0, std::memory_order_release); }
+
+ private:
+  std::atomic<uint32_t> state_;
+};
+
+class ScopedSpinLock {
+ public:
+  explicit ScopedSpinLock(SpinLock& lock) : lock_(lock) { lock_.Lock(); }
+  ~ScopedSpinLock() { lock_.Unlock(); }
+
+ private:
+  SpinLock& lock_;
+};
+
+// A linear probing table of records. Tables never hold tombstones,
+// removals shift the following records back instead.
+struct Table {
+  Record* records_;
+  uint32_t capacity_;
+  uint32_t shift_;
+  uint32_t count_;
+  Table* next_;
+};
+
+// All members are zero-initialized statically. Shards are aligned to cache
+// lines, so threads working on different shards don't share any.
+//
+// Every shard starts out with a table in static storage. Once all of its
+// tables are 3/4 full, a spill table twice the size of the largest one is
+// allocated outside the lock and put in front of the list, so the existing
+// records never move. Lookups probe every table; Reserve() merges them into
+// one.
+struct alignas(kCacheLineSize) Shard {
+  SpinLock lock_;
+  Table* tables_;
+  uint32_t count_;
+  std::atomic<size_t> bytes_;
+  std::atomic<size_t> live_;
+  SizeClassCounters size_classes_[kSizeClassCount];
+};
+
+Shard shards[kShardCount];
+Table initial_tables[kShardCount];
+Record initial_records[kShardCount][kShardCapacity];
+std::atomic<uint32_t> current_frame(0);
+
+// Aggregated statistics of all allocations made at one file and line. Sites
+// are only ever added, lookups are lock-free and the counters are updated
+// atomically. key_ is published last, after file_ and line_ have been set.
+struct CallSite {
+  std::atomic<uint64_t> key_;
+  const char* file_;
+  uint32_t line_;
+  std::atomic<size_t> live_bytes_;
+  std::atomic<size_t> live_count_;
+  std::atomic<size_t> peak_bytes_;
+  std::atomic<uint64_t> total_count_;
+  std::atomic<uint64_t> total_bytes_;
+};
+
+CallSite sites[kSiteCapacity + 1];
+SpinLock site_lock;
+uint32_t site_count = 0;
+
+uint32_t NextPowerOfTwo(const size_t value) {
+  uint32_t result = kMinimumCapacity;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+uint32_t Log2(const uint32_t value) {
+  uint32_t result = 0;
+  while ((1U << result) < value) {
+    ++result;
+  }
+  return result;
+}
+
+uint64_t Hash(const void* pointer) {
+  return (reinterpret_cast<uintptr_t>(pointer) >> 4) * 0x9e3779b97f4a7c15ULL;
+}
+
+// The upper bits of a multiplicative hash are the well mixed ones. The
+// topmost select the shard, the ones right below the slot in its table.
+Shard& GetShard(const uint64_t hash) {
+  return shards[hash >> (64 - kShardBits)];
+}
+
+uint32_t GetSlot(const Table& table, const uint64_t hash) {
+  return static_cast<uint32_t>((hash << kShardBits) >> table.shift_);
+}
+
+uint64_t GetSiteKey(const char* file, const uint32_t line) {
+  // Never zero, which marks empty slots.
+  return (Hash(file) ^ (line * 0xc2b2ae3d27d4eb4fULL)) | 1;
+}
+
+bool SiteMatches(const CallSite& site, const uint64_t key, const char* file,
+                 const uint32_t line) {
+  return site.key_.load(std::memory_order_acquire) == key &&
+         site.file_ == file && site.line_ == line;
+}
+
+uint32_t GetSite(const char* file, const uint32_t line) {
+  const uint64_t key = GetSiteKey(file, line);
+  const uint32_t mask = kSiteCapacity - 1;
+  uint32_t slot = static_cast<uint32_t>(key >> 32) & mask;
+
+  for (;; slot = (slot + 1) & mask) {
+    if (SiteMatches(sites[slot], key, file, line)) {
+      return slot;
+    } else if (sites[slot].key_.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+  }
+
+  // Unknown site, insert it unless another thread did so in the meantime.
+  ScopedSpinLock lock(site_lock);
+  for (;; slot = (slot + 1) & mask) {
+    if (SiteMatches(sites[slot], key, file, line)) {
+      return slot;
+    } else if (sites[slot].key_.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+
+  if ((site_count + 1) * 4 > kSiteCapacity * 3) {
+    return kOverflowSite;
+  }
+
+  ++site_count;
+  sites[slot].file_ = file;
+  sites[slot].line_ = line;
+  sites[slot].key_.store(key, std::memory_order_release);
+  return slot;
+}
+
+void AddToSite(const uint32_t index, const size_t size) {
+  CallSite& site = sites[index];
+  size_t live = site.live_bytes_.fetch_add(size, std::memory_order_relaxed) +
+                size;
+  site.live_count_.fetch_add(1, std::memory_order_relaxed);
+  site.total_count_.fetch_add(1, std::memory_order_relaxed);
+  site.total_bytes_.fetch_add(size, std::memory_order_relaxed);
+
+  size_t peak = site.peak_bytes_.load(std::memory_order_relaxed);
+  while (live > peak && !site.peak_bytes_.compare_exchange_weak(
+             peak, live, std::memory_order_relaxed)) {}
+}
+
+void RemoveFromSite(const uint32_t index, const size_t size) {
+  CallSite& site = sites[index];
+  site.live_bytes_.fetch_sub(size, std::memory_order_relaxed);
+  site.live_count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void InitializeTable(Table* table, Record* records, const uint32_t capacity) {
+  table->records_ = records;
+  table->capacity_ = capacity;
+  table->shift_ = 64 - Log2(capacity);
+  table->count_ = 0;
+  table->next_ = NULL;
+}
+
+// Allocates the table and its records in one block. Uses the raw allocator,
+// which doesn't call back into the tracker, so the shard must not be locked.
+// Running out of memory while tracking is fatal in all builds, since the
+// allocation being tracked can't be recorded anywhere else.
+Table* CreateTable(const uint32_t capacity) {
+  Table* table = reinterpret_cast<Table*>(
+      calloc(1, sizeof(Table) + capacity * sizeof(Record)));
+  if (table == NULL) {
+    fprintf(stderr, "Out of memory while growing the memory tracker.\n");
+    abort();
+  }
+  InitializeTable(table, reinterpret_cast<Record*>(table + 1), capacity);
+  return table;
+}
+
+bool IsInitialTable(const Shard& shard, const Table* table) {
+  return table == &initial_tables[&shard - shards];
+}
+
+// Points an unused shard at its static table.
+void Initialize(Shard& shard) {
+  if (shard.tables_ == NULL) {
+    const uint32_t index = static_cast<uint32_t>(&shard - shards);
+    InitializeTable(&initial_tables[index], initial_records[index],
+                    kShardCapacity);
+    shard.tables_ = &initial_tables[index];
+  }
+}
+
+bool HasRoom(const Table& table) {
+  return (table.count_ + 1) * 4 <= table.capacity_ * 3;
+}
+
+Record* Insert(Table& table, const Record& record) {
+  uint32_t mask = table.capacity_ - 1;
+  uint32_t slot = GetSlot(table, Hash(record.pointer_));
+  while (table.records_[slot].pointer_ != NULL) {
+    slot = (slot + 1) & mask;
+  }
+  table.records_[slot] = record;
+  ++table.count_;
+  return &table.records_[slot];
+}
+
+// Empties the slot and moves back records that probed past it, so lookups
+// can keep stopping at the first empty slot.
+void Erase(Table& table, uint32_t slot) {
+  uint32_t mask = table.capacity_ - 1;
+  for (uint32_t next = (slot + 1) & mask;; next = (next + 1) & mask) {
+    void* pointer = table.records_[next].pointer_;
+    if (pointer == NULL) {
+      break;
+    }
+
+    // Records may only move towards the slot they hash to.
+    uint32_t home = GetSlot(table, Hash(pointer));
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      table.records_[slot] = table.records_[next];
+      slot = next;
+    }
+  }
+
+  table.records_[slot].pointer_ = NULL;
+  --table.count_;
+}
+
+// Returns the table holding pointer and stores its slot, or returns NULL.
+Table* Find(const Shard& shard, const void* pointer, const uint64_t hash,
+            uint32_t* slot) {
+  for (Table* table = shard.tables_; table != NULL; table = table->next_) {
+    uint32_t mask = table->capacity_ - 1;
+    for (uint32_t i = GetSlot(*table, hash);; i = (i + 1) & mask) {
+      void* current = table->records_[i].pointer_;
+      if (current == pointer) {
+        *slot = i;
+        return table;
+      } else if (current == NULL) {
+        break;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Returns a table with room for one more record, or NULL if all are full.
+Table* FindRoom(const Shard& shard) {
+  for (Table* table = shard.tables_; table != NULL; table = table->next_) {
+    if (HasRoom(*table)) {
+      return table;
+    }
+  }
+  return NULL;
+}
+
+// Only called with the shard locked, so there's no need for an atomic
+// read-modify-write.
+void Increment(std::atomic<uint64_t>& counter, const uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+void AddToHistogram(Shard& shard, const size_t size) {
+  SizeClassCounters& counters =
+      shard.size_classes_[MemoryTracker::GetSizeClass(size)];
+  Increment(counters.live_count_, 1);
+  Increment(counters.live_bytes_, size);
+  Increment(counters.total_count_, 1);
+  Increment(counters.total_bytes_, size);
+}
+
+// Pass a negative lifetime for allocations that weren't actually freed.
+void RemoveFromHistogram(Shard& shard, const size_t size,
+                         const int64_t lifetime) {
+  SizeClassCounters& counters =
+      shard.size_classes_[MemoryTracker::GetSizeClass(size)];
+  Increment(counters.live_count_, -1);
+  Increment(counters.live_bytes_, -static_cast<uint64_t>(size));
+  if (lifetime >= 0) {
+    Increment(counters.lifetimes_[MemoryTracker::GetLifetimeBucket(
+        static_cast<uint32_t>(lifetime))], 1);
+  }
+}
+
+void SetCounters(Shard& shard, const size_t bytes) {
+  shard.bytes_.store(bytes, std::memory_order_relaxed);
+  shard.live_.store(shard.count_, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+namespace {
+
+// Records an allocation with the shard locked. Returns false if all tables
+// are full and spill is NULL; otherwise spill is taken over if needed.
+bool Track(Shard& shard, const internal::Allocation& allocation,
+           const uint32_t site, const uint64_t hash, Table** spill) {
+  ScopedSpinLock lock(shard.lock_);
+  Initialize(shard);
+
+  size_t bytes = shard.bytes_.load(std::memory_order_relaxed);
+  uint32_t slot;
+  Table* table = Find(shard, allocation.pointer_, hash, &slot);
+  Record* record;
+
+  if (table != NULL) {
+    // The address has been handed out again without being removed.
+    record = &table->records_[slot];
+    bytes -= record->size_;
+    RemoveFromSite(record->site_, record->size_);
+    RemoveFromHistogram(shard, record->size_, -1);
+  } else {
+    table = FindRoom(shard);
+    if (table == NULL) {
+      if (*spill == NULL) {
+        return false;
+      }
+      table = *spill;
+      table->next_ = shard.tables_;
+      shard.tables_ = table;
+      *spill = NULL;
+    }
+
+    Record empty = {};
+    empty.pointer_ = allocation.pointer_;
+    record = Insert(*table, empty);
+    ++shard.count_;
+  }
+
+  AddToSite(site, allocation.size_);
+  record->file_ = allocation.file_;
+  record->line_ = allocation.line_;
+  record->size_ = allocation.size_;
+  record->site_ = site;
+  record->frame_ = current_frame.load(std::memory_order_relaxed);
+  AddToHistogram(shard, allocation.size_);
+  SetCounters(shard, bytes + allocation.size_);
+  return true;
+}
+
+// The capacity of the next spill table of a shard.
+uint32_t GetSpillCapacity(Shard& shard) {
+  ScopedSpinLock lock(shard.lock_);
+  uint32_t capacity = kMinimumCapacity;
+  for (Table* table = shard.tables_; table != NULL; table = table->next_) {
+    capacity = std::max(capacity, table->capacity_ * 2);
+  }
+  return capacity;
+}
+
+}  // namespace
 
 void* MemoryTracker::Add(const internal::Allocation& allocation) {
-  AllocationTuple item(allocation.pointer_, allocation);
-  allocations_.insert(item);
-  bytes_allocated_ += allocation.size_;
+  if (allocation.pointer_ == NULL) {
+    return NULL;
+  }
+
+  uint32_t site = GetSite(allocation.file_, allocation.line_);
+  uint64_t hash = Hash(allocation.pointer_);
+  Shard& shard = GetShard(hash);
+
+  // Spill tables are allocated without holding the lock. Another thread may
+  // have made room in the meantime, in which case the table isn't needed.
+  Table* spill = NULL;
+  while (!Track(shard, allocation, site, hash, &spill)) {
+    spill = CreateTable(GetSpillCapacity(shard));
+  }
+  free(spill);
+
   return allocation.pointer_;
 }
 
 bool MemoryTracker::Remove(void* pointer) {
-   AllocationIterator item = allocations_.find(pointer);
-
-  if (item != allocations_.end()) {
-    bytes_allocated_ -= item->second.size_;
-    allocations_.erase(item);
+  if (pointer == NULL) {
     return true;
   }
 
+  uint64_t hash = Hash(pointer);
+  Shard& shard = GetShard(hash);
+  {
+    ScopedSpinLock lock(shard.lock_);
+    uint32_t slot;
+    Table* table = Find(shard, pointer, hash, &slot);
+
+    if (table != NULL) {
+      Record record = table->records_[slot];
+      size_t bytes = shard.bytes_.load(std::memory_order_relaxed);
+      Erase(*table, slot);
+      --shard.count_;
+      RemoveFromSite(record.site_, record.size_);
+      RemoveFromHistogram(shard, record.size_,
+          current_frame.load(std::memory_order_relaxed) - record.frame_);
+      SetCounters(shard, bytes - record.size_);
+      return true;
+    }
+  }
+
   printf("Tried to delete illegal pointer @ 0x%p\n", pointer);
   return false;
 }
 
 void MemoryTracker::Report() {
+  HeapSnapshot snapshot;
+  snapshot.Capture();
+  snapshot.Sort(HeapSnapshot::kSortByLiveBytes);
+
+  printf("*** MEMORY REPORT ***\n");
+  printf("%lu bytes in %lu allocations\n",
+         static_cast<unsigned long>(bytes_allocated()),
+         static_cast<unsigned long>(allocation_count()));
+  snapshot.Print(stdout, kReportedSites);
+  ReportHistogram();
+  printf("*** MEMORY REPORT ***\n");
+}
+
+void MemoryTracker::ReportHistogram() {
+  MemoryHistogram histogram;
+  GetHistogram(&histogram);
+
+  // Lifetime buckets are condensed into a few ranges of frames.
+  const uint32_t kRangeCount = 5;
+  const uint32_t range_ends[kRangeCount] = { 1, 2, 4, 7, kLifetimeBucketCount };
+
+  printf("%12s %10s %14s %12s %14s %10s %10s %10s %10s %10s\n", "size",
+         "live", "live bytes", "allocations", "total bytes", "0 frames",
+         "1 frame", "2-7", "8-63", "64+");
+
+  for (uint32_t i = 0; i < kSizeClassCount; ++i) {
+    const SizeClassStatistics& size_class = histogram.size_classes_[i];
+    if (size_class.total_count_ == 0) {
+      continue;
+    }
+
+    char size[32];
+    if (i + 1 < kSizeClassCount) {
+      snprintf(size, sizeof(size), "<= %llu", 1ULL << i);
+    } else {
+      snprintf(size, sizeof(size), "> %llu", 1ULL << (i - 1));
+    }
+
+    printf("%12s %10llu %14llu %12llu %14llu", size,
+           static_cast<unsigned long long>(size_class.live_count_),
+           static_cast<unsigned long long>(size_class.live_bytes_),
+           static_cast<unsigned long long>(size_class.total_count_),
+           static_cast<unsigned long long>(size_class.total_bytes_));
+
+    uint32_t bucket = 0;
+    for (uint32_t range = 0; range < kRangeCount; ++range) {
+      uint64_t count = 0;
+      for (; bucket < range_ends[range]; ++bucket) {
+        count += size_class.lifetimes_[bucket];
+      }
+      printf(" %10llu", static_cast<unsigned long long>(count));
+    }
+    printf("\n");
+  }
+}
+
+void MemoryTracker::ReportAllocations() {
   printf("*** MEMORY REPORT ***\n");
 
-  AllocationIterator item;
-  AllocationIterator end = allocations_.end();
+  for (uint32_t i = 0; i < kShardCount; ++i) {
+    Shard& shard = shards[i];
+    ScopedSpinLock lock(shard.lock_);
 
-  for (item = allocations_.begin(); item != end; ++item) {
-    printf("%s at line %d @ 0x%p\n", item->second.file_, item->second.line_,
-           item->second.pointer_);
+    for (Table* table = shard.tables_; table != NULL; table = table->next_) {
+      for (uint32_t slot = 0; slot < table->capacity_; ++slot) {
+        const Record& record = table->records_[slot];
+        if (record.pointer_ != NULL) {
+          printf("%s at line %d @ 0x%p\n", record.file_, record.line_,
+                 record.pointer_);
+        }
+      }
+    }
   }
 
   printf("*** MEMORY REPORT ***\n");
 }
 
+void MemoryTracker::Reserve(const size_t count) {
+  // Shards fill up unevenly, leave some headroom on top of the even share.
+  size_t per_shard = (count / kShardCount) * 2 + kMinimumCapacity;
+  uint32_t requested = NextPowerOfTwo(per_shard * 4 / 3 + 1);
+
+  for (uint32_t i = 0; i < kShardCount; ++i) {
+    Shard& shard = shards[i];
+    Table* merged = NULL;
+    for (;;) {
+      Table* replaced = NULL;
+      uint32_t capacity;
+      {
+        ScopedSpinLock lock(shard.lock_);
+        Initialize(shard);
+        capacity = std::max(requested,
+                            NextPowerOfTwo((shard.count_ + 1) * 4 / 3 + 1));
+        if (shard.tables_->next_ == NULL &&
+            shard.tables_->capacity_ >= capacity) {
+          break;
+        }
+
+        // The new table is only too small if other threads allocated while
+        // it was created.
+        if (merged != NULL && merged->capacity_ >= capacity) {
+          replaced = shard.tables_;
+          shard.tables_ = merged;
+          merged = NULL;
+          for (Table* table = replaced; table != NULL; table = table->next_) {
+            for (uint32_t slot = 0; slot < table->capacity_; ++slot) {
+              if (table->records_[slot].pointer_ != NULL) {
+                Insert(*shard.tables_, table->records_[slot]);
+              }
+            }
+          }
+        }
+      }
+
+      if (replaced != NULL) {
+        while (replaced != NULL) {
+          Table* next = replaced->next_;
+          if (!IsInitialTable(shard, replaced)) {
+            free(replaced);
+          }
+          replaced = next;
+        }
+        break;
+      }
+
+      // Allocate without holding the lock, the tracker itself isn't involved.
+      free(merged);
+      merged = CreateTable(capacity);
+    }
+    free(merged);
+  }
+}
+
+size_t MemoryTracker::bytes_allocated() {
+  size_t bytes = 0;
+  for (uint32_t i = 0; i < kShardCount; ++i) {
+    bytes += shards[i].bytes_.load(std::memory_order_relaxed);
+  }
+  return bytes;
+}
+
+void MemoryTracker::GetCallSites(std::vector<CallSiteStatistics>* result) {
+  result->clear();
+
+  for (uint32_t i = 0; i <= kSiteCapacity; ++i) {
+    const CallSite& site = sites[i];
+    uint64_t total_count = site.total_count_.load(std::memory_order_relaxed);
+    if (total_count == 0) {
+      continue;
+    }
+
+    bool overflow = (i == kOverflowSite);
+    CallSiteStatistics statistics;
+    statistics.file_ = overflow ? "<other>" : site.file_;
+    statistics.line_ = overflow ? 0 : site.line_;
+    statistics.live_bytes_ = site.live_bytes_.load(std::memory_order_relaxed);
+    statistics.live_count_ = site.live_count_.load(std::memory_order_relaxed);
+    statistics.peak_bytes_ = site.peak_bytes_.load(std::memory_order_relaxed);
+    statistics.total_count_ = total_count;
+    statistics.total_bytes_ = site.total_bytes_.load(std::memory_order_relaxed);
+    statistics.allocation_rate_ = 0.0;
+    result->push_back(statistics);
+  }
+}
+
+void MemoryTracker::GetHistogram(MemoryHistogram* histogram) {
+  memset(histogram, 0, sizeof(*histogram));
+
+  for (uint32_t i = 0; i < kShardCount; ++i) {
+    for (uint32_t j = 0; j < kSizeClassCount; ++j) {
+      const SizeClassCounters& counters = shards[i].size_classes_[j];
+      SizeClassStatistics& result = histogram->size_classes_[j];
+      result.live_count_ +=
+          counters.live_count_.load(std::memory_order_relaxed);
+      result.live_bytes_ +=
+          counters.live_bytes_.load(std::memory_order_relaxed);
+      result.total_count_ +=
+          counters.total_count_.load(std::memory_order_relaxed);
+      result.total_bytes_ +=
+          counters.total_bytes_.load(std::memory_order_relaxed);
+      for (uint32_t k = 0; k < kLifetimeBucketCount; ++k) {
+        result.lifetimes_[k] +=
+            counters.lifetimes_[k].load(std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+void MemoryTracker::NextFrame() {
+  current_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t MemoryTracker::frame() {
+  return current_frame.load(std::memory_order_relaxed);
+}
+
+uint32_t MemoryTracker::GetSizeClass(const size_t size) {
+  uint32_t size_class = 0;
+  while ((size_class + 1 < kSizeClassCount) &&
+         ((static_cast<uint64_t>(1) << size_class) < size)) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+uint32_t MemoryTracker::GetLifetimeBucket(const uint32_t frames) {
+  uint32_t bucket = 0;
+  while ((bucket + 1 < kLifetimeBucketCount) && (frames >> bucket) != 0) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+size_t MemoryTracker::allocation_count() {
+  size_t count = 0;
+  for (uint32_t i = 0; i < kShardCount; ++i) {
+    count += shards[i].live_.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
 }  // namespace core
 }  // namespace mx
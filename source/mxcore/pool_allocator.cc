@@ -0,0 +1,182 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdlib.h>
+#include "mxcore/pool_allocator.h"
+#include "mxcore/thread_index.h"
+
+namespace mx {
+namespace core {
+
+namespace {
+
+// Number of blocks moved between a thread cache and the shared free list.
+const uint32_t kCacheBatchSize = 32;
+
+size_t GetBlockSize(const size_t size, const size_t alignment) {
+  assert(IsPowerOfTwo(alignment));
+  size_t block_size = (size > sizeof(void*)) ? size : sizeof(void*);
+  return AlignUp(block_size, alignment);
+}
+
+}  // namespace
+
+FixedBlockPool::FixedBlockPool(const size_t block_size, const size_t alignment,
+                               const uint32_t blocks_per_page,
+                               const bool thread_caches)
+    : block_size_(GetBlockSize(block_size, alignment)),
+      blocks_per_page_(blocks_per_page),
+      free_list_(NULL),
+      pages_(NULL),
+      page_count_(0),
+      page_alignment_(alignment > kCacheLineSize ? alignment : kCacheLineSize),
+      thread_caches_(NULL),
+      thread_cache_memory_(NULL) {
+  assert(blocks_per_page > 0);
+
+  if (thread_caches) {
+    thread_cache_memory_ = mxnew(AlignedMemory<kCacheLineSize>,
+                                 (sizeof(ThreadCache) * kMaxThreads));
+    thread_caches_ = reinterpret_cast<ThreadCache*>(
+        thread_cache_memory_->pointer());
+    for (uint32_t i = 0; i < kMaxThreads; ++i) {
+      thread_caches_[i].head_ = NULL;
+      thread_caches_[i].count_ = 0;
+    }
+  }
+}
+
+FixedBlockPool::~FixedBlockPool() {
+  while (pages_ != NULL) {
+    Page* page = pages_;
+    pages_ = page->next_;
+    free(page);
+  }
+
+  if (thread_cache_memory_ != NULL) {
+    mxdelete(thread_cache_memory_);
+  }
+}
+
+void* FixedBlockPool::Allocate() {
+  if (thread_caches_ == NULL) {
+    if (free_list_ == NULL) {
+      AddPage();
+    }
+
+    FreeBlock* block = free_list_;
+    free_list_ = block->next_;
+    return block;
+  }
+
+  ThreadCache& cache = thread_caches_[CurrentThreadIndex()];
+  if (cache.head_ == NULL) {
+    Refill(cache);
+  }
+
+  FreeBlock* block = cache.head_;
+  cache.head_ = block->next_;
+  --cache.count_;
+  return block;
+}
+
+void FixedBlockPool::Free(void* pointer) {
+  if (pointer == NULL) {
+    return;
+  }
+
+  FreeBlock* block = reinterpret_cast<FreeBlock*>(pointer);
+
+  if (thread_caches_ == NULL) {
+    block->next_ = free_list_;
+    free_list_ = block;
+    return;
+  }
+
+  ThreadCache& cache = thread_caches_[CurrentThreadIndex()];
+  block->next_ = cache.head_;
+  cache.head_ = block;
+
+  if (++cache.count_ > 2 * kCacheBatchSize) {
+    Drain(cache);
+  }
+}
+
+void FixedBlockPool::AddPage() {
+  // The page header sits at the start of the allocation, the blocks start at
+  // the next aligned address after it.
+  size_t page_size = sizeof(Page) + page_alignment_ +
+                     blocks_per_page_ * block_size_;
+  uint8_t* raw = reinterpret_cast<uint8_t*>(malloc(page_size));
+  assert(raw != NULL);
+
+  Page* page = reinterpret_cast<Page*>(raw);
+  page->next_ = pages_;
+  pages_ = page;
+  ++page_count_;
+
+  uint8_t* blocks = reinterpret_cast<uint8_t*>(
+      AlignUp(reinterpret_cast<uintptr_t>(raw + sizeof(Page)),
+              page_alignment_));
+  for (uint32_t i = blocks_per_page_; i > 0; --i) {
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(
+        blocks + (i - 1) * block_size_);
+    block->next_ = free_list_;
+    free_list_ = block;
+  }
+}
+
+void FixedBlockPool::Refill(ThreadCache& cache) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (uint32_t i = 0; i < kCacheBatchSize; ++i) {
+    if (free_list_ == NULL) {
+      AddPage();
+    }
+
+    FreeBlock* block = free_list_;
+    free_list_ = block->next_;
+    block->next_ = cache.head_;
+    cache.head_ = block;
+    ++cache.count_;
+  }
+}
+
+void FixedBlockPool::Drain(ThreadCache& cache) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (uint32_t i = 0; i < kCacheBatchSize; ++i) {
+    FreeBlock* block = cache.head_;
+    cache.head_ = block->next_;
+    --cache.count_;
+    block->next_ = free_list_;
+    free_list_ = block;
+  }
+}
+
+}  // namespace core
+}  // namespace mx
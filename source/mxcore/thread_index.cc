@@ -0,0 +1,98 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include "mxcore/thread_index.h"
+
+namespace mx {
+namespace core {
+
+namespace {
+
+const uint32_t kInvalidThreadIndex = 0xffffffff;
+
+// One bit per thread index in use.
+std::atomic<uint64_t> used_indices(0);
+
+uint32_t AcquireIndex() {
+  uint64_t used = used_indices.load(std::memory_order_relaxed);
+
+  for (;;) {
+    uint32_t index = 0;
+    while ((index < kMaxThreads) && (used & (uint64_t(1) << index))) {
+      ++index;
+    }
+    // Handing out an index past the end would overrun every per-thread
+    // array, so running out of indices is fatal in all builds.
+    if (index == kMaxThreads) {
+      fprintf(stderr, "More than %u threads need a thread index.\n",
+              kMaxThreads);
+      abort();
+    }
+
+    if (used_indices.compare_exchange_weak(used, used | (uint64_t(1) << index),
+                                           std::memory_order_acquire)) {
+      return index;
+    }
+  }
+}
+
+void ReleaseIndex(const uint32_t index) {
+  used_indices.fetch_and(~(uint64_t(1) << index), std::memory_order_release);
+}
+
+// Returns the thread's index to the pool when the thread exits.
+class ThreadIndexReleaser {
+ public:
+  ThreadIndexReleaser() : index_(kInvalidThreadIndex) {}
+  ~ThreadIndexReleaser() {
+    if (index_ != kInvalidThreadIndex) {
+      ReleaseIndex(index_);
+    }
+  }
+
+  uint32_t index_;
+};
+
+thread_local uint32_t thread_index = kInvalidThreadIndex;
+thread_local ThreadIndexReleaser releaser;
+
+}  // namespace
+
+uint32_t CurrentThreadIndex() {
+  if (thread_index == kInvalidThreadIndex) {
+    thread_index = AcquireIndex();
+    releaser.index_ = thread_index;
+  }
+
+  return thread_index;
+}
+
+}  // namespace core
+}  // namespace mx
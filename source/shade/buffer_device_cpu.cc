@@ -0,0 +1,123 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include "shade/buffer_device_cpu.h"
+
+namespace mx {
+namespace shade {
+
+BufferDeviceCpu::BufferDeviceCpu()
+    : next_buffer_(1),
+      last_fence_(0),
+      signaled_fence_(0),
+      latency_(0),
+      waits_(0),
+      hazards_(0) {}
+
+uint32_t BufferDeviceCpu::CreateBuffer(const size_t size,
+                                       const BufferUsage usage) {
+  const uint32_t buffer = next_buffer_++;
+  buffers_[buffer].resize(size);
+  return buffer;
+}
+
+void BufferDeviceCpu::DestroyBuffer(const uint32_t buffer) {
+  buffers_.erase(buffer);
+}
+
+void BufferDeviceCpu::Write(const uint32_t buffer, const size_t offset,
+                            const void* data, const size_t size) {
+  std::vector<uint8_t>& memory = buffers_[buffer];
+  assert(offset + size <= memory.size());
+  memcpy(&memory[offset], data, size);
+}
+
+void* BufferDeviceCpu::Map(const uint32_t buffer, const size_t offset,
+                           const size_t size) {
+  std::vector<uint8_t>& memory = buffers_[buffer];
+  assert(offset + size <= memory.size());
+
+  while (!ranges_.empty() && ranges_.front().fence_ <= signaled_fence_) {
+    ranges_.pop_front();
+  }
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    const Range& range = ranges_[i];
+    if (range.buffer_ == buffer && range.offset_ < offset + size &&
+        offset < range.offset_ + range.size_) {
+      ++hazards_;
+    }
+  }
+
+  // The range is read by the commands up to the next fence.
+  Range range = {buffer, offset, size, last_fence_ + 1};
+  ranges_.push_back(range);
+  return &memory[offset];
+}
+
+void BufferDeviceCpu::Unmap(const uint32_t buffer, const size_t offset,
+                            const size_t size) {
+}
+
+FenceHandle BufferDeviceCpu::InsertFence() {
+  ++last_fence_;
+  if (last_fence_ > latency_ && last_fence_ - latency_ > signaled_fence_) {
+    signaled_fence_ = last_fence_ - latency_;
+  }
+  return last_fence_;
+}
+
+bool BufferDeviceCpu::IsSignaled(const FenceHandle fence) {
+  return fence <= signaled_fence_;
+}
+
+void BufferDeviceCpu::Wait(const FenceHandle fence) {
+  assert(fence <= last_fence_);
+  ++waits_;
+  if (fence > signaled_fence_) {
+    signaled_fence_ = fence;
+  }
+}
+
+const uint8_t* BufferDeviceCpu::data(const uint32_t buffer) const {
+  std::unordered_map<uint32_t, std::vector<uint8_t> >::const_iterator it =
+      buffers_.find(buffer);
+  if (it == buffers_.end() || it->second.empty()) {
+    return NULL;
+  }
+  return &it->second[0];
+}
+
+size_t BufferDeviceCpu::size(const uint32_t buffer) const {
+  std::unordered_map<uint32_t, std::vector<uint8_t> >::const_iterator it =
+      buffers_.find(buffer);
+  return it != buffers_.end() ? it->second.size() : 0;
+}
+
+}  // namespace shade
+}  // namespace mx
@@ -0,0 +1,104 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "shade/buffer_device_gl.h"
+
+namespace mx {
+namespace shade {
+
+namespace {
+
+// Buffers are bound to the copy target, so uploads don't disturb the vertex
+// and index bindings used for drawing.
+const GLenum kUploadTarget = GL_COPY_WRITE_BUFFER;
+
+GLsync ToSync(const FenceHandle fence) {
+  return reinterpret_cast<GLsync>(static_cast<uintptr_t>(fence));
+}
+
+}  // namespace
+
+uint32_t BufferDeviceGL::CreateBuffer(const size_t size,
+                                      const BufferUsage usage) {
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(kUploadTarget, buffer);
+  glBufferData(kUploadTarget, size, NULL,
+               usage == kStaticUsage ? GL_STATIC_DRAW : GL_STREAM_DRAW);
+  return buffer;
+}
+
+void BufferDeviceGL::DestroyBuffer(const uint32_t buffer) {
+  const GLuint name = buffer;
+  glDeleteBuffers(1, &name);
+}
+
+void BufferDeviceGL::Write(const uint32_t buffer, const size_t offset,
+                           const void* data, const size_t size) {
+  glBindBuffer(kUploadTarget, buffer);
+  glBufferSubData(kUploadTarget, offset, size, data);
+}
+
+void* BufferDeviceGL::Map(const uint32_t buffer, const size_t offset,
+                          const size_t size) {
+  glBindBuffer(kUploadTarget, buffer);
+  return glMapBufferRange(kUploadTarget, offset, size,
+                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                          GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void BufferDeviceGL::Unmap(const uint32_t buffer, const size_t offset,
+                           const size_t size) {
+  glBindBuffer(kUploadTarget, buffer);
+  glUnmapBuffer(kUploadTarget);
+}
+
+FenceHandle BufferDeviceGL::InsertFence() {
+  GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  return static_cast<FenceHandle>(reinterpret_cast<uintptr_t>(sync));
+}
+
+bool BufferDeviceGL::IsSignaled(const FenceHandle fence) {
+  const GLenum result = glClientWaitSync(ToSync(fence), 0, 0);
+  return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+void BufferDeviceGL::Wait(const FenceHandle fence) {
+  const GLuint64 kTimeout = 1000000;
+  GLenum result;
+  do {
+    result = glClientWaitSync(ToSync(fence), GL_SYNC_FLUSH_COMMANDS_BIT,
+                              kTimeout);
+  } while (result == GL_TIMEOUT_EXPIRED);
+}
+
+void BufferDeviceGL::DestroyFence(const FenceHandle fence) {
+  glDeleteSync(ToSync(fence));
+}
+
+}  // namespace shade
+}  // namespace mx
@@ -0,0 +1,333 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include "shade/buffer_manager.h"
+
+namespace mx {
+namespace shade {
+
+namespace {
+
+size_t Align(const size_t size) {
+  const size_t alignment = BufferManager::kAlignment;
+  return (std::max<size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+const size_t BufferManager::kAlignment;
+
+BufferManager::BufferManager(BufferDevice* device, const size_t block_size,
+                             const size_t ring_size,
+                             const uint32_t max_frames_in_flight)
+    : device_(device),
+      block_size_(Align(block_size)),
+      ring_size_(Align(ring_size)),
+      max_frames_in_flight_(std::max<uint32_t>(max_frames_in_flight, 1)),
+      ring_buffer_(0),
+      ring_head_(0),
+      ring_used_(0),
+      frame_size_(0),
+      frame_(0) {
+  assert(device_ != NULL);
+  memset(&stream_location_, 0, sizeof(stream_location_));
+  memset(&statistics_, 0, sizeof(statistics_));
+}
+
+BufferManager::~BufferManager() {
+  Clear();
+}
+
+void BufferManager::Clear() {
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    device_->DestroyFence(frames_[i].fence_);
+  }
+  frames_.clear();
+
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    device_->DestroyBuffer(blocks_[i].buffer_);
+  }
+  blocks_.clear();
+  entries_.clear();
+
+  if (ring_buffer_ != 0) {
+    device_->DestroyBuffer(ring_buffer_);
+    ring_buffer_ = 0;
+  }
+  ring_head_ = 0;
+  ring_used_ = 0;
+  frame_size_ = 0;
+}
+
+void BufferManager::BeginFrame() {
+  ++frame_;
+  memset(&statistics_, 0, sizeof(statistics_));
+
+  while (!frames_.empty() && device_->IsSignaled(frames_.front().fence_)) {
+    RetireFrame(false);
+  }
+  while (frames_.size() >= max_frames_in_flight_) {
+    RetireFrame(true);
+  }
+}
+
+void BufferManager::EndFrame() {
+  RingFrame frame;
+  frame.fence_ = device_->InsertFence();
+  frame.size_ = frame_size_;
+  frames_.push_back(frame);
+  frame_size_ = 0;
+}
+
+const DeviceBuffer* BufferManager::Acquire(const uint64_t key,
+                                           const void* data,
+                                           const size_t size,
+                                           const BufferUsage usage) {
+  if (usage == kStreamUsage) {
+    ++statistics_.uploads_;
+    return Stream(data, size, &stream_location_) ? &stream_location_ : NULL;
+  }
+
+  std::unordered_map<uint64_t, Entry>::iterator it = entries_.find(key);
+  if (it != entries_.end()) {
+    const Entry& entry = it->second;
+    if (entry.usage_ == usage && entry.location_.size_ == size &&
+        (usage == kStaticUsage || entry.frame_ == frame_)) {
+      ++statistics_.cache_hits_;
+      return &entry.location_;
+    }
+    if (entry.usage_ == kStaticUsage) {
+      FreeStatic(entry.location_);
+    }
+  } else {
+    it = entries_.insert(std::make_pair(key, Entry())).first;
+  }
+
+  Entry& entry = it->second;
+  entry.usage_ = usage;
+  entry.frame_ = frame_;
+  ++statistics_.uploads_;
+
+  bool uploaded = false;
+  if (usage == kStaticUsage) {
+    uploaded = AllocateStatic(size, &entry.location_);
+    if (uploaded && size > 0) {
+      device_->Write(entry.location_.buffer_, entry.location_.offset_, data,
+                     size);
+      statistics_.upload_bytes_ += size;
+    }
+  } else {
+    uploaded = Stream(data, size, &entry.location_);
+  }
+
+  if (!uploaded) {
+    entries_.erase(it);
+    return NULL;
+  }
+  return &entry.location_;
+}
+
+void BufferManager::Update(const uint64_t key, const void* data,
+                           const size_t size) {
+  std::unordered_map<uint64_t, Entry>::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+
+  const Entry& entry = it->second;
+  if (entry.usage_ == kStaticUsage && entry.location_.size_ == size) {
+    if (size > 0) {
+      device_->Write(entry.location_.buffer_, entry.location_.offset_, data,
+                     size);
+    }
+    ++statistics_.uploads_;
+    statistics_.upload_bytes_ += size;
+    return;
+  }
+  Release(key);
+}
+
+void BufferManager::Release(const uint64_t key) {
+  std::unordered_map<uint64_t, Entry>::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+  if (it->second.usage_ == kStaticUsage) {
+    FreeStatic(it->second.location_);
+  }
+  entries_.erase(it);
+}
+
+bool BufferManager::AllocateStatic(const size_t size, DeviceBuffer* location) {
+  const size_t aligned = Align(size);
+
+  Block* block = NULL;
+  std::map<size_t, size_t>::iterator range;
+  for (size_t i = 0; i < blocks_.size() && block == NULL; ++i) {
+    if (blocks_[i].free_size_ < aligned) {
+      continue;
+    }
+    range = blocks_[i].free_.begin();
+    for (; range != blocks_[i].free_.end(); ++range) {
+      if (range->second >= aligned) {
+        block = &blocks_[i];
+        break;
+      }
+    }
+  }
+
+  if (block == NULL) {
+    const size_t block_size = std::max(block_size_, aligned);
+    const uint32_t buffer = device_->CreateBuffer(block_size, kStaticUsage);
+    if (buffer == 0) {
+      return false;
+    }
+    Block new_block;
+    new_block.buffer_ = buffer;
+    new_block.size_ = block_size;
+    new_block.free_size_ = block_size;
+    new_block.free_[0] = block_size;
+    blocks_.push_back(new_block);
+    block = &blocks_.back();
+    range = block->free_.begin();
+  }
+
+  const size_t offset = range->first;
+  const size_t remaining = range->second - aligned;
+  block->free_.erase(range);
+  if (remaining > 0) {
+    block->free_[offset + aligned] = remaining;
+  }
+  block->free_size_ -= aligned;
+
+  location->buffer_ = block->buffer_;
+  location->offset_ = offset;
+  location->size_ = size;
+  return true;
+}
+
+void BufferManager::FreeStatic(const DeviceBuffer& location) {
+  std::vector<Block>::iterator block = blocks_.begin();
+  while (block != blocks_.end() && block->buffer_ != location.buffer_) {
+    ++block;
+  }
+  assert(block != blocks_.end());
+
+  // Merges the range with its neighbours.
+  const size_t aligned = Align(location.size_);
+  std::map<size_t, size_t>::iterator range =
+      block->free_.insert(std::make_pair(location.offset_, aligned)).first;
+  std::map<size_t, size_t>::iterator next = std::next(range);
+  if (next != block->free_.end() &&
+      range->first + range->second == next->first) {
+    range->second += next->second;
+    block->free_.erase(next);
+  }
+  if (range != block->free_.begin()) {
+    std::map<size_t, size_t>::iterator previous = std::prev(range);
+    if (previous->first + previous->second == range->first) {
+      previous->second += range->second;
+      block->free_.erase(range);
+    }
+  }
+  block->free_size_ += aligned;
+
+  // Blocks holding a single large buffer are not reused.
+  if (block->free_size_ == block->size_ && block->size_ > block_size_) {
+    device_->DestroyBuffer(block->buffer_);
+    blocks_.erase(block);
+  }
+}
+
+bool BufferManager::Stream(const void* data, const size_t size,
+                           DeviceBuffer* location) {
+  const size_t aligned = Align(size);
+  if (aligned > ring_size_) {
+    return false;
+  }
+  if (ring_buffer_ == 0) {
+    ring_buffer_ = device_->CreateBuffer(ring_size_, kStreamUsage);
+    if (ring_buffer_ == 0) {
+      return false;
+    }
+  }
+
+  if (ring_used_ == 0) {
+    ring_head_ = 0;
+  }
+
+  // Data never wraps around the end of the ring. The space skipped at the
+  // end belongs to the current frame.
+  size_t offset = ring_head_;
+  size_t needed = aligned;
+  if (offset + aligned > ring_size_) {
+    needed += ring_size_ - offset;
+    offset = 0;
+  }
+
+  while (ring_size_ - ring_used_ < needed) {
+    if (frames_.empty()) {
+      return false;
+    }
+    RetireFrame(true);
+  }
+
+  if (size > 0) {
+    void* memory = device_->Map(ring_buffer_, offset, size);
+    assert(memory != NULL);
+    memcpy(memory, data, size);
+    device_->Unmap(ring_buffer_, offset, size);
+  }
+
+  ring_head_ = (offset + aligned) % ring_size_;
+  ring_used_ += needed;
+  frame_size_ += needed;
+  statistics_.upload_bytes_ += size;
+
+  location->buffer_ = ring_buffer_;
+  location->offset_ = offset;
+  location->size_ = size;
+  return true;
+}
+
+void BufferManager::RetireFrame(const bool wait) {
+  const RingFrame& frame = frames_.front();
+  if (wait) {
+    device_->Wait(frame.fence_);
+    ++statistics_.waits_;
+  }
+  device_->DestroyFence(frame.fence_);
+  ring_used_ -= frame.size_;
+  frames_.pop_front();
+}
+
+}  // namespace shade
+}  // namespace mx
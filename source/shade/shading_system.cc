@@ -26,22 +26,554 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
 #include <SDL.h>
+#include "mxcore/radix_sort.h"
 #include "shade/shading_system.h"
 
 namespace mx {
 namespace shade {
 
+const uint32_t kChunkBits = 8;
+const uint32_t kChunkSize = 1 << kChunkBits;
+
+struct Geometry {
+  BufferHandle vertex_buffer_;
+  BufferHandle normal_buffer_;
+  BufferHandle index_buffer_;
+};
+
+// The members of a block read while dispatching, packed into 24 bytes.
+// Blocks are visited in sorted order, so records aren't padded to cache
+// lines; blocks sorted next to each other were often submitted together,
+// and their records then share lines.
+struct BatchRecord {
+  Geometry geometry_;
+  StateHandle state_;
+  float depth_;
+  uint8_t layer_;
+  bool has_constants_;
+};
+
+static_assert(sizeof(BatchRecord) == 24, "BatchRecord has grown");
+
+// Render blocks submitted by one thread, stored in a list of chunks as a
+// structure of arrays. Sorting only reads the keys and sequence numbers,
+// dispatching the batch records and, for blocks that have them, the
+// constants. The constants column is only allocated from the arena once a
+// block in the chunk has constants.
+struct SubmissionChunk {
+  SubmissionChunk* next_;
+  uint32_t count_;
+  DrawConstants* constants_;
+  uint64_t keys_[kChunkSize];
+  uint32_t sequences_[kChunkSize];
+  BatchRecord records_[kChunkSize];
+};
+
+struct alignas(core::kCacheLineSize) SubmissionBucket {
+  SubmissionChunk* first_;
+  SubmissionChunk* last_;
+  size_t count_;
+};
+
+// The submissions of one thread in a frame packet.
+struct SubmissionList {
+  const SubmissionChunk* first_;
+  size_t count_;
+};
+
+// Everything needed to sort and dispatch a frame. Packets are filled by
+// EndFrame() and only used by the dispatching thread until the frame has
+// been dispatched.
+struct FramePacket {
+  std::vector<SubmissionList> submissions_;
+  bool deterministic_;
+  uint32_t max_instances_;
+  // The chunks of all threads. RenderItem::index_ / kChunkSize is the
+  // position of a block's chunk in this table.
+  std::vector<const SubmissionChunk*> chunks_;
+  std::vector<RenderItem> items_;
+  std::vector<RenderItem> scratch_;
+  core::RadixSortHistograms histograms_;
+  std::vector<DrawConstants> instance_data_;
+  FrameStatistics statistics_;
+};
+
+namespace {
+
+const uint32_t kLayerBits = 4;
+const uint32_t kShaderBits = 12;
+const uint32_t kStateBits = 16;
+const uint32_t kBufferBits = 16;
+const uint32_t kDepthBits = 15;
+
+// Uniform blocks are only guaranteed to hold 16 KB, which is 256 instances.
+const uint32_t kDefaultMaxInstances = 256;
+
+const DrawConstants kDefaultConstants = {
+  {1.0f, 0.0f, 0.0f, 0.0f,
+   0.0f, 1.0f, 0.0f, 0.0f,
+   0.0f, 0.0f, 1.0f, 0.0f},
+  {1.0f, 1.0f, 1.0f, 1.0f}
+};
+
+// Slots are assigned in the order buffers are created, so the order of the
+// queue is the same in every run. Buffers sharing the lower bits of their
+// slot only make sorting less effective.
+uint64_t BufferIdentity(const BufferHandle buffer) {
+  return buffer & ((1 << kBufferBits) - 1);
+}
+
+uint64_t QuantizeDepth(const float depth) {
+  const float kMaxDepth = static_cast<float>((1 << kDepthBits) - 1);
+  if (!(depth > 0.0f)) {
+    return 0;
+  }
+  if (depth >= 1.0f) {
+    return static_cast<uint64_t>(kMaxDepth);
+  }
+  return static_cast<uint64_t>(depth * kMaxDepth);
+}
+
+bool SameGeometry(const Geometry& a, const Geometry& b) {
+  return a.vertex_buffer_ == b.vertex_buffer_ &&
+      a.normal_buffer_ == b.normal_buffer_ &&
+      a.index_buffer_ == b.index_buffer_;
+}
+
+// Returns false if one of the buffers has been destroyed.
+bool BuffersExist(const Geometry& geometry,
+                  const core::SlotMap<Buffer<float> >& vertex_buffers,
+                  const core::SlotMap<Buffer<uint32_t> >& index_buffers) {
+  return (geometry.vertex_buffer_ == kNullBuffer ||
+          vertex_buffers.Contains(geometry.vertex_buffer_)) &&
+      (geometry.normal_buffer_ == kNullBuffer ||
+       vertex_buffers.Contains(geometry.normal_buffer_)) &&
+      (geometry.index_buffer_ == kNullBuffer ||
+       index_buffers.Contains(geometry.index_buffer_));
+}
+
+uint64_t GetKey(const RenderItem& item) {
+  return item.key_;
+}
+
+uint64_t GetSequence(const RenderItem& item) {
+  return item.sequence_;
+}
+
+}  // namespace
+
 void ShadingSystem::Initialize() {
   assert(SDL_Init(SDL_INIT_VIDEO) != -1);
+  InvalidateDeviceState();
+}
+
+ShadingSystem::ShadingSystem(const uint32_t thread_count,
+                             const size_t arena_size,
+                             const uint32_t max_frames_in_flight)
+    : max_frames_in_flight_(max_frames_in_flight),
+      frame_allocator_(arena_size, thread_count, max_frames_in_flight + 1,
+                       &block_allocator_),
+      bucket_memory_(sizeof(SubmissionBucket) * core::kMaxThreads),
+      buckets_(reinterpret_cast<SubmissionBucket*>(bucket_memory_.pointer())),
+      deterministic_(false),
+      max_instances_(kDefaultMaxInstances),
+      last_packet_(NULL),
+      device_state_valid_(false),
+      bound_state_(kDefaultState),
+      bound_shader_(0),
+      device_state_lost_(false),
+      queued_frames_(0),
+      dispatched_frames_(0),
+      stopping_(false) {
+  memset(&statistics_, 0, sizeof(statistics_));
+  for (uint32_t i = 0; i < core::kMaxThreads; ++i) {
+    new(&buckets_[i]) SubmissionBucket();
+  }
+  const uint32_t packet_count = std::max<uint32_t>(max_frames_in_flight, 1);
+  for (uint32_t i = 0; i < packet_count; ++i) {
+    packets_.push_back(new FramePacket());
+  }
+  last_packet_ = packets_[0];
+}
+
+ShadingSystem::~ShadingSystem() {
+  StopRenderThread();
+  for (size_t i = 0; i < packets_.size(); ++i) {
+    delete packets_[i];
+  }
 }
 
 void ShadingSystem::BeginFrame() {
-  render_queue_.clear();
+  frame_allocator_.BeginFrame();
+  for (uint32_t i = 0; i < core::kMaxThreads; ++i) {
+    buckets_[i].first_ = NULL;
+    buckets_[i].last_ = NULL;
+    buckets_[i].count_ = 0;
+  }
+  // Without a render thread, the blocks of the last frame were just rewound.
+  if (max_frames_in_flight_ == 0) {
+    packets_[0]->items_.clear();
+  }
+}
+
+void ShadingSystem::Render(const RenderBlock& render_block,
+                           const uint32_t sequence) {
+  SubmissionBucket& bucket = buckets_[frame_allocator_.slot()];
+  SubmissionChunk* chunk = bucket.last_;
+
+  if (chunk == NULL || chunk->count_ == kChunkSize) {
+    // The blocks are constructed on submission.
+    chunk = reinterpret_cast<SubmissionChunk*>(frame_allocator_.Allocate(
+        sizeof(SubmissionChunk), alignof(SubmissionChunk)));
+    assert(chunk != NULL);
+    chunk->next_ = NULL;
+    chunk->count_ = 0;
+    chunk->constants_ = NULL;
+
+    if (bucket.last_ != NULL) {
+      bucket.last_->next_ = chunk;
+    } else {
+      bucket.first_ = chunk;
+    }
+    bucket.last_ = chunk;
+  }
+
+  const uint32_t slot = chunk->count_++;
+  chunk->keys_[slot] = ComputeSortKey(render_block);
+  chunk->sequences_[slot] = sequence;
+  BatchRecord& record = chunk->records_[slot];
+  record.geometry_.vertex_buffer_ = render_block.vertex_buffer_;
+  record.geometry_.normal_buffer_ = render_block.normal_buffer_;
+  record.geometry_.index_buffer_ = render_block.index_buffer_;
+  record.state_ = render_block.state_;
+  record.layer_ = render_block.layer_;
+  record.depth_ = render_block.depth_;
+  record.has_constants_ = (render_block.constants_ != NULL);
+  if (record.has_constants_) {
+    if (chunk->constants_ == NULL) {
+      chunk->constants_ = reinterpret_cast<DrawConstants*>(
+          frame_allocator_.Allocate(sizeof(DrawConstants) * kChunkSize,
+                                    alignof(DrawConstants)));
+      assert(chunk->constants_ != NULL);
+    }
+    chunk->constants_[slot] = *render_block.constants_;
+  }
+  ++bucket.count_;
+}
+
+void ShadingSystem::EndFrame() {
+  if (max_frames_in_flight_ == 0) {
+    FramePacket* packet = packets_[0];
+    CapturePacket(packet);
+    SortRenderQueue(packet);
+    Dispatch(packet);
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_ = packet->statistics_;
+    return;
+  }
+
+  if (!render_thread_.joinable()) {
+    render_thread_ = std::thread(&ShadingSystem::RunRenderThread, this);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (queued_frames_ - dispatched_frames_ >= max_frames_in_flight_) {
+    frame_dispatched_.wait(lock);
+  }
+  // The render thread is done with the packet, as every packet in use
+  // belongs to a frame in flight.
+  CapturePacket(packets_[queued_frames_ % packets_.size()]);
+  ++queued_frames_;
+  lock.unlock();
+  frame_queued_.notify_one();
+}
+
+void ShadingSystem::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (dispatched_frames_ != queued_frames_) {
+    frame_dispatched_.wait(lock);
+  }
+}
+
+void ShadingSystem::StopRenderThread() {
+  if (!render_thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  frame_queued_.notify_one();
+  render_thread_.join();
+  stopping_ = false;
+}
+
+BufferHandle ShadingSystem::CreateVertexBuffer(const Buffer<float>& buffer) {
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  return vertex_buffers_.Insert(buffer);
 }
 
-void ShadingSystem::Render(const RenderBlock& render_block) {
-  render_queue_.push_back(render_block);
+BufferHandle ShadingSystem::CreateIndexBuffer(
+    const Buffer<uint32_t>& buffer) {
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  return index_buffers_.Insert(buffer);
+}
+
+void ShadingSystem::DestroyVertexBuffer(const BufferHandle buffer) {
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  if (vertex_buffers_.Erase(buffer)) {
+    released_vertex_buffers_.push_back(buffer);
+  }
+}
+
+void ShadingSystem::DestroyIndexBuffer(const BufferHandle buffer) {
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  if (index_buffers_.Erase(buffer)) {
+    released_index_buffers_.push_back(buffer);
+  }
+}
+
+uint32_t ShadingSystem::frames_in_flight() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<uint32_t>(queued_frames_ - dispatched_frames_);
+}
+
+FrameStatistics ShadingSystem::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+const std::vector<DrawConstants>& ShadingSystem::instance_data() const {
+  return last_packet_->instance_data_;
+}
+
+const std::vector<RenderItem>& ShadingSystem::render_items() const {
+  return last_packet_->items_;
+}
+
+RenderBlock ShadingSystem::GetQueuedBlock(const size_t position) const {
+  const uint32_t index = last_packet_->items_[position].index_;
+  const SubmissionChunk& chunk = *last_packet_->chunks_[index >> kChunkBits];
+  const uint32_t slot = index & (kChunkSize - 1);
+  const BatchRecord& record = chunk.records_[slot];
+  return RenderBlock(record.geometry_.vertex_buffer_,
+                     record.geometry_.normal_buffer_,
+                     record.geometry_.index_buffer_, record.state_,
+                     record.layer_, record.depth_,
+                     record.has_constants_ ? &chunk.constants_[slot] : NULL);
+}
+
+void ShadingSystem::RunRenderThread() {
+  BeginRenderThread();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    while (dispatched_frames_ == queued_frames_ && !stopping_) {
+      frame_queued_.wait(lock);
+    }
+    if (dispatched_frames_ == queued_frames_) {
+      break;
+    }
+
+    FramePacket* packet = packets_[dispatched_frames_ % packets_.size()];
+    lock.unlock();
+    SortRenderQueue(packet);
+    Dispatch(packet);
+    lock.lock();
+
+    statistics_ = packet->statistics_;
+    last_packet_ = packet;
+    ++dispatched_frames_;
+    frame_dispatched_.notify_all();
+  }
+  lock.unlock();
+
+  EndRenderThread();
+}
+
+void ShadingSystem::CapturePacket(FramePacket* packet) {
+  // Buckets are indexed by thread index, so most of them stay empty.
+  packet->submissions_.clear();
+  for (uint32_t i = 0; i < core::kMaxThreads; ++i) {
+    if (buckets_[i].count_ > 0) {
+      SubmissionList submissions;
+      submissions.first_ = buckets_[i].first_;
+      submissions.count_ = buckets_[i].count_;
+      packet->submissions_.push_back(submissions);
+    }
+  }
+  packet->deterministic_ = deterministic_;
+  packet->max_instances_ = max_instances_;
+}
+
+void ShadingSystem::SortRenderQueue(FramePacket* packet) {
+  size_t count = 0;
+  for (size_t i = 0; i < packet->submissions_.size(); ++i) {
+    count += packet->submissions_[i].count_;
+  }
+
+  std::vector<RenderItem>& render_items = packet->items_;
+  render_items.resize(count);
+  packet->scratch_.resize(count);
+  packet->chunks_.clear();
+  if (count == 0) {
+    return;
+  }
+
+  RenderItem* items = &render_items[0];
+  for (size_t i = 0; i < packet->submissions_.size(); ++i) {
+    const SubmissionChunk* chunk = packet->submissions_[i].first_;
+    for (; chunk != NULL; chunk = chunk->next_) {
+      const uint32_t base =
+          static_cast<uint32_t>(packet->chunks_.size()) << kChunkBits;
+      packet->chunks_.push_back(chunk);
+      for (uint32_t slot = 0; slot < chunk->count_; ++slot) {
+        items->key_ = chunk->keys_[slot];
+        items->index_ = base + slot;
+        items->sequence_ = chunk->sequences_[slot];
+        ++items;
+      }
+    }
+  }
+
+  // The sort is stable, so sorting by sequence first breaks ties between
+  // equal keys independently of which thread submitted a block.
+  if (packet->deterministic_) {
+    core::RadixSort(&render_items[0], &packet->scratch_[0], count,
+                    GetSequence, &packet->histograms_);
+  }
+  core::RadixSort(&render_items[0], &packet->scratch_[0], count, GetKey,
+                  &packet->histograms_);
+}
+
+void ShadingSystem::Dispatch(FramePacket* packet) {
+  if (device_state_lost_.exchange(false)) {
+    device_state_valid_ = false;
+  }
+
+  // Buffers can't be created or destroyed while the frame is drawn, so the
+  // backend hooks may look them up.
+  std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+  for (size_t i = 0; i < released_vertex_buffers_.size(); ++i) {
+    ReleaseVertexBuffer(released_vertex_buffers_[i]);
+  }
+  for (size_t i = 0; i < released_index_buffers_.size(); ++i) {
+    ReleaseIndexBuffer(released_index_buffers_[i]);
+  }
+  released_vertex_buffers_.clear();
+  released_index_buffers_.clear();
+
+  BeginDispatch();
+  FrameStatistics& statistics = packet->statistics_;
+  memset(&statistics, 0, sizeof(statistics));
+
+  // Buffers may be destroyed between frames, so their bindings are only
+  // tracked within a frame.
+  const std::vector<RenderItem>& render_items = packet->items_;
+  const std::vector<const SubmissionChunk*>& chunks = packet->chunks_;
+  std::vector<DrawConstants>& instance_data = packet->instance_data_;
+  const Geometry* previous = NULL;
+  const size_t count = render_items.size();
+  instance_data.resize(count);
+  size_t first = 0;
+  while (first < count) {
+    const uint32_t index = render_items[first].index_;
+    const SubmissionChunk& chunk = *chunks[index >> kChunkBits];
+    const uint32_t slot = index & (kChunkSize - 1);
+    const BatchRecord& record = chunk.records_[slot];
+    const StateHandle state_handle = record.state_;
+    const Geometry& geometry = record.geometry_;
+
+    // The buffers of the last draw were checked already.
+    if ((previous == NULL || !SameGeometry(geometry, *previous)) &&
+        !BuffersExist(geometry, vertex_buffers_, index_buffers_)) {
+      instance_data[first] = record.has_constants_ ?
+          chunk.constants_[slot] : kDefaultConstants;
+      ++statistics.stale_blocks_;
+      ++first;
+      continue;
+    }
+
+    // Batches the following blocks with the same state, layer and geometry.
+    size_t last = first;
+    for (; last < count && last - first < packet->max_instances_; ++last) {
+      const uint32_t other_index = render_items[last].index_;
+      const SubmissionChunk& other = *chunks[other_index >> kChunkBits];
+      const uint32_t other_slot = other_index & (kChunkSize - 1);
+      const BatchRecord& other_record = other.records_[other_slot];
+      if (other_record.state_ != state_handle ||
+          other_record.layer_ != record.layer_ ||
+          !SameGeometry(other_record.geometry_, geometry)) {
+        break;
+      }
+      instance_data[last] = other_record.has_constants_ ?
+          other.constants_[other_slot] : kDefaultConstants;
+    }
+    const uint32_t instance_count = static_cast<uint32_t>(last - first);
+    const RenderBlock render_block(geometry.vertex_buffer_,
+                                   geometry.normal_buffer_,
+                                   geometry.index_buffer_, state_handle,
+                                   record.layer_, record.depth_,
+                                   &instance_data[first]);
+
+    if (!device_state_valid_ || state_handle != bound_state_) {
+      const RenderState& state = state_cache_.Get(state_handle);
+      if (!device_state_valid_ || state.shader_ != bound_shader_) {
+        BindShader(state.shader_);
+        bound_shader_ = state.shader_;
+        ++statistics.shader_binds_;
+      }
+      ApplyState(state);
+      bound_state_ = state_handle;
+      device_state_valid_ = true;
+      ++statistics.state_binds_;
+    } else {
+      ++statistics.state_binds_skipped_;
+    }
+    statistics.state_binds_skipped_ += instance_count - 1;
+
+    if (previous == NULL || !SameGeometry(geometry, *previous)) {
+      BindGeometry(render_block);
+      ++statistics.geometry_binds_;
+    } else {
+      ++statistics.geometry_binds_skipped_;
+    }
+    statistics.geometry_binds_skipped_ += instance_count - 1;
+
+    Draw(render_block, &instance_data[first], instance_count);
+    ++statistics.draws_;
+    statistics.blocks_ += instance_count;
+    previous = &geometry;
+    first = last;
+  }
+
+  Present();
+}
+
+uint64_t ShadingSystem::ComputeSortKey(const RenderBlock& render_block) const {
+  const RenderState& state = state_cache_.Get(render_block.state_);
+  const bool translucent = state.translucent_;
+  const uint64_t shader = state.shader_ & ((1 << kShaderBits) - 1);
+  const uint64_t depth = QuantizeDepth(render_block.depth_);
+
+  uint64_t key = render_block.layer_ & ((1 << kLayerBits) - 1);
+  key = (key << 1) | (translucent ? 1 : 0);
+
+  if (translucent) {
+    key = (key << kDepthBits) | (((1 << kDepthBits) - 1) - depth);
+  }
+  key = (key << kShaderBits) | shader;
+  key = (key << kStateBits) | (render_block.state_ & ((1 << kStateBits) - 1));
+  key = (key << kBufferBits) | BufferIdentity(render_block.vertex_buffer_);
+  if (!translucent) {
+    key = (key << kDepthBits) | depth;
+  }
+
+  return key;
 }
 
 }  // namespace shade
@@ -26,10 +26,35 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
+#include <string.h>
 #include "shade/shading_system_gl.h"
 
 namespace mx {
 namespace shade {
+namespace {
+
+// Vertex and index buffer handles are numbered independently, so index
+// buffers are kept in the buffer manager under keys of their own.
+uint64_t VertexBufferKey(const BufferHandle buffer) {
+  return buffer;
+}
+
+uint64_t IndexBufferKey(const BufferHandle buffer) {
+  return (static_cast<uint64_t>(1) << 32) | buffer;
+}
+
+// Uniform buffer binding points read by the shaders.
+const GLuint kInstanceBinding = 0;
+const GLuint kStateBinding = 1;
+
+// The members of a RenderState read by the shaders, in std140 layout: every
+// vec3 takes the space of a vec4.
+struct StateConstants {
+  float diffuse_color_[4];
+  float ambient_light_[2][4];
+};
+
+}  // namespace
 
 void ShadingSystemGL::Initialize() {
   ShadingSystem::Initialize();
@@ -47,19 +72,132 @@ void ShadingSystemGL::Initialize() {
   gl_context_ = SDL_GL_CreateContext(window_);
   SDL_GL_SetSwapInterval(1);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  glGenVertexArrays(1, &vertex_array_);
+  glBindVertexArray(vertex_array_);
+  glGenBuffers(1, &instance_buffer_);
+  glGenBuffers(1, &state_buffer_);
+
+  // The context is current on the render thread while it runs.
+  if (max_frames_in_flight() > 0) {
+    SDL_GL_MakeCurrent(window_, NULL);
+  }
+}
+
+void ShadingSystemGL::BeginRenderThread() {
+  SDL_GL_MakeCurrent(window_, gl_context_);
+}
+
+void ShadingSystemGL::EndRenderThread() {
+  SDL_GL_MakeCurrent(window_, NULL);
+}
+
+void ShadingSystemGL::ReleaseVertexBuffer(const BufferHandle buffer) {
+  buffer_manager_.Release(VertexBufferKey(buffer));
 }
 
-void ShadingSystemGL::EndFrame() {
+void ShadingSystemGL::ReleaseIndexBuffer(const BufferHandle buffer) {
+  buffer_manager_.Release(IndexBufferKey(buffer));
+}
+
+void ShadingSystemGL::BeginDispatch() {
+  buffer_manager_.BeginFrame();
   glClear(GL_COLOR_BUFFER_BIT);
-  
-  std::vector<RenderBlock>::iterator renderblock_iterator = render_queue_.begin();
-  for (; renderblock_iterator != render_queue_.end(); ++renderblock_iterator) {
+}
+
+void ShadingSystemGL::BindShader(const uint32_t shader) {
+  // The backend has no shader programs yet, so there is nothing to bind.
+}
+
+void ShadingSystemGL::ApplyState(const RenderState& state) {
+  StateConstants constants;
+  memset(&constants, 0, sizeof(constants));
+  memcpy(constants.diffuse_color_, state.diffuse_color_,
+         sizeof(state.diffuse_color_));
+  memcpy(constants.ambient_light_[0], &state.ambient_light_[0],
+         3 * sizeof(float));
+  memcpy(constants.ambient_light_[1], &state.ambient_light_[3],
+         3 * sizeof(float));
+
+  // Only called when the state changes, so the buffer is orphaned like the
+  // instance buffer.
+  glBindBuffer(GL_UNIFORM_BUFFER, state_buffer_);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(constants), &constants,
+               GL_STREAM_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, kStateBinding, state_buffer_);
+}
+
+void ShadingSystemGL::BindGeometry(const RenderBlock& render_block) {
+  const BufferHandle attributes[2] = {
+    render_block.vertex_buffer_, render_block.normal_buffer_
+  };
+  for (GLuint i = 0; i < 2; ++i) {
+    const Buffer<float>* attribute = GetVertexBuffer(attributes[i]);
+    const DeviceBuffer* buffer = attribute != NULL ?
+        buffer_manager_.Acquire(VertexBufferKey(attributes[i]), *attribute) :
+        NULL;
+    if (buffer == NULL) {
+      glDisableVertexAttribArray(i);
+      continue;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_);
+    glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, 0,
+                          reinterpret_cast<const GLvoid*>(buffer->offset_));
+    glEnableVertexAttribArray(i);
   }
 
+  index_count_ = 0;
+  const Buffer<uint32_t>* indices = GetIndexBuffer(render_block.index_buffer_);
+  if (indices != NULL) {
+    const DeviceBuffer* buffer = buffer_manager_.Acquire(
+        IndexBufferKey(render_block.index_buffer_), *indices);
+    if (buffer != NULL) {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->buffer_);
+      index_offset_ = buffer->offset_;
+      index_count_ = indices->size_;
+    }
+  }
+}
+
+void ShadingSystemGL::Draw(const RenderBlock& render_block,
+                           const DrawConstants* instances,
+                           const uint32_t instance_count) {
+  // Shaders read the constants of an instance at gl_InstanceID. The buffer is
+  // orphaned, so the driver doesn't wait for the previous draw.
+  glBindBuffer(GL_UNIFORM_BUFFER, instance_buffer_);
+  glBufferData(GL_UNIFORM_BUFFER, instance_count * sizeof(DrawConstants), NULL,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, instance_count * sizeof(DrawConstants),
+                  instances);
+  glBindBufferBase(GL_UNIFORM_BUFFER, kInstanceBinding, instance_buffer_);
+
+  const Buffer<float>* vertices = GetVertexBuffer(render_block.vertex_buffer_);
+  if (index_count_ > 0) {
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(index_count_),
+                            GL_UNSIGNED_INT,
+                            reinterpret_cast<const GLvoid*>(index_offset_),
+                            instance_count);
+  } else if (vertices != NULL) {
+    glDrawArraysInstanced(GL_TRIANGLES, 0,
+                          static_cast<GLsizei>(vertices->size_ / 3),
+                          instance_count);
+  }
+}
+
+void ShadingSystemGL::Present() {
+  buffer_manager_.EndFrame();
   SDL_GL_SwapWindow(window_);
 }
 
 void ShadingSystemGL::Dispose() {
+  if (max_frames_in_flight() > 0) {
+    StopRenderThread();
+    SDL_GL_MakeCurrent(window_, gl_context_);
+  }
+  buffer_manager_.Clear();
+  glDeleteBuffers(1, &instance_buffer_);
+  glDeleteBuffers(1, &state_buffer_);
+  glDeleteVertexArrays(1, &vertex_array_);
   SDL_GL_DeleteContext(gl_context_);
   SDL_DestroyWindow(window_);
 }
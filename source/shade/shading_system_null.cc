@@ -0,0 +1,70 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include "shade/shading_system_null.h"
+
+namespace mx {
+namespace shade {
+
+ShadingSystemNull::ShadingSystemNull(const uint32_t thread_count,
+                                     const size_t arena_size,
+                                     const uint32_t max_frames_in_flight)
+    : ShadingSystem(thread_count, arena_size, max_frames_in_flight),
+      frames_(0) {
+  memset(&dispatch_statistics_, 0, sizeof(dispatch_statistics_));
+}
+
+void ShadingSystemNull::BeginDispatch() {
+  memset(&dispatch_statistics_, 0, sizeof(dispatch_statistics_));
+}
+
+void ShadingSystemNull::BindShader(const uint32_t shader) {
+  ++dispatch_statistics_.shader_binds_;
+}
+
+void ShadingSystemNull::ApplyState(const RenderState& state) {
+  ++dispatch_statistics_.state_changes_;
+}
+
+void ShadingSystemNull::BindGeometry(const RenderBlock& render_block) {
+  ++dispatch_statistics_.geometry_binds_;
+}
+
+void ShadingSystemNull::Draw(const RenderBlock& render_block,
+                             const DrawConstants* instances,
+                             const uint32_t instance_count) {
+  ++dispatch_statistics_.draws_;
+  dispatch_statistics_.instances_ += instance_count;
+}
+
+void ShadingSystemNull::Present() {
+  ++frames_;
+}
+
+}  // namespace shade
+}  // namespace mx
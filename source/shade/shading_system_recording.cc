@@ -0,0 +1,330 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include "shade/shading_system_recording.h"
+
+namespace mx {
+namespace shade {
+namespace {
+
+// Reads values from a command stream, failing once the end is passed.
+class StreamReader {
+ public:
+  StreamReader(const uint8_t* stream, const size_t size)
+      : stream_(stream), size_(size), position_(0) {}
+
+  template <class T>
+  bool Read(T* value) {
+    if (size_ - position_ < sizeof(*value)) {
+      return false;
+    }
+    memcpy(value, stream_ + position_, sizeof(*value));
+    position_ += sizeof(*value);
+    return true;
+  }
+
+  bool done() const { return position_ == size_; }
+  size_t remaining() const { return size_ - position_; }
+
+ private:
+  const uint8_t* stream_;
+  const size_t size_;
+  size_t position_;
+};
+
+BufferHandle CreateBuffer(ShadingSystem* target, const Buffer<float>& buffer) {
+  return target->CreateVertexBuffer(buffer);
+}
+
+BufferHandle CreateBuffer(ShadingSystem* target,
+                          const Buffer<uint32_t>& buffer) {
+  return target->CreateIndexBuffer(buffer);
+}
+
+void DestroyBuffer(ShadingSystem* target, const BufferHandle buffer,
+                   const Buffer<float>*) {
+  target->DestroyVertexBuffer(buffer);
+}
+
+void DestroyBuffer(ShadingSystem* target, const BufferHandle buffer,
+                   const Buffer<uint32_t>*) {
+  target->DestroyIndexBuffer(buffer);
+}
+
+// Recreates the buffers referenced by a stream in the target. Buffer ids are
+// only unique within a frame, so buffers are looked up by id and extent.
+// Backends may look buffers up by handle, so they stay alive until the table
+// is destroyed.
+template <class T>
+class BufferTable {
+ public:
+  explicit BufferTable(ShadingSystem* target) : target_(target) {}
+
+  ~BufferTable() {
+    typename std::map<Key, BufferHandle>::const_iterator it;
+    for (it = buffers_.begin(); it != buffers_.end(); ++it) {
+      DestroyBuffer(target_, it->second, static_cast<const Buffer<T>*>(NULL));
+    }
+  }
+
+  // Returns false if the stream is malformed or the target has too many
+  // buffers.
+  bool Read(StreamReader* reader, BufferHandle* buffer) {
+    uint32_t id;
+    uint64_t start;
+    uint64_t size;
+    if (!reader->Read(&id) || !reader->Read(&start) || !reader->Read(&size)) {
+      return false;
+    }
+
+    if (id == 0) {
+      *buffer = kNullBuffer;
+      return true;
+    }
+    const Key key(id, start, size);
+    typename std::map<Key, BufferHandle>::const_iterator it =
+        buffers_.find(key);
+    if (it == buffers_.end()) {
+      const Buffer<T> entry(NULL, static_cast<size_t>(start),
+                            static_cast<size_t>(size));
+      it = buffers_.insert(std::make_pair(key, CreateBuffer(target_, entry)))
+          .first;
+    }
+    *buffer = it->second;
+    return *buffer != kNullBuffer;
+  }
+
+ private:
+  struct Key {
+    Key(const uint32_t id, const uint64_t start, const uint64_t size)
+        : id_(id), start_(start), size_(size) {}
+
+    bool operator<(const Key& other) const {
+      if (id_ != other.id_) {
+        return id_ < other.id_;
+      }
+      if (start_ != other.start_) {
+        return start_ < other.start_;
+      }
+      return size_ < other.size_;
+    }
+
+    uint32_t id_;
+    uint64_t start_;
+    uint64_t size_;
+  };
+
+  ShadingSystem* target_;
+  std::map<Key, BufferHandle> buffers_;
+};
+
+}  // namespace
+
+ShadingSystemRecording::ShadingSystemRecording(const uint32_t thread_count,
+                                               const size_t arena_size)
+    : ShadingSystem(thread_count, arena_size) {}
+
+bool ShadingSystemRecording::WriteToFile(const char* path) const {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  bool result = stream_.empty() ||
+      fwrite(&stream_[0], 1, stream_.size(), file) == stream_.size();
+  return (fclose(file) == 0) && result;
+}
+
+bool ShadingSystemRecording::ReadFromFile(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  stream_.clear();
+  uint8_t data[4096];
+  size_t size;
+  while ((size = fread(data, 1, sizeof(data), file)) > 0) {
+    stream_.insert(stream_.end(), data, data + size);
+  }
+
+  bool result = (ferror(file) == 0);
+  fclose(file);
+  return result;
+}
+
+bool ShadingSystemRecording::Replay(const uint8_t* stream, const size_t size,
+                                    ShadingSystem* target) {
+  StreamReader reader(stream, size);
+  // Buffers are created in the target for the whole replay. States are
+  // interned into the target.
+  BufferTable<float> float_buffers(target);
+  BufferTable<uint32_t> index_buffers(target);
+  RenderBlock render_block;
+  std::vector<DrawConstants> instances;
+
+  while (!reader.done()) {
+    uint8_t command;
+    if (!reader.Read(&command)) {
+      return false;
+    }
+
+    switch (command) {
+      case kBeginDispatch:
+        target->BeginDispatch();
+        break;
+
+      case kBindShader: {
+        uint32_t shader;
+        if (!reader.Read(&shader)) {
+          return false;
+        }
+        target->BindShader(shader);
+        break;
+      }
+
+      case kApplyState: {
+        RenderState state;
+        uint8_t translucent;
+        if (!reader.Read(&state.diffuse_color_) ||
+            !reader.Read(&state.ambient_light_) ||
+            !reader.Read(&state.shader_) || !reader.Read(&translucent)) {
+          return false;
+        }
+        state.translucent_ = (translucent != 0);
+        render_block.state_ = target->InternState(state);
+        target->ApplyState(target->state_cache().Get(render_block.state_));
+        break;
+      }
+
+      case kBindGeometry:
+        if (!float_buffers.Read(&reader, &render_block.vertex_buffer_) ||
+            !float_buffers.Read(&reader, &render_block.normal_buffer_) ||
+            !index_buffers.Read(&reader, &render_block.index_buffer_)) {
+          return false;
+        }
+        target->BindGeometry(render_block);
+        break;
+
+      case kDraw: {
+        uint32_t instance_count;
+        if (!reader.Read(&render_block.layer_) ||
+            !reader.Read(&render_block.depth_) ||
+            !reader.Read(&instance_count) || instance_count == 0 ||
+            reader.remaining() / sizeof(DrawConstants) < instance_count) {
+          return false;
+        }
+        instances.resize(instance_count);
+        for (uint32_t i = 0; i < instance_count; ++i) {
+          reader.Read(&instances[i]);
+        }
+        target->Draw(render_block, &instances[0], instance_count);
+        break;
+      }
+
+      case kPresent:
+        target->Present();
+        break;
+
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void ShadingSystemRecording::BeginDispatch() {
+  buffer_ids_.clear();
+  Write<uint8_t>(kBeginDispatch);
+}
+
+void ShadingSystemRecording::BindShader(const uint32_t shader) {
+  Write<uint8_t>(kBindShader);
+  Write(shader);
+}
+
+void ShadingSystemRecording::ApplyState(const RenderState& state) {
+  Write<uint8_t>(kApplyState);
+  Write(state.diffuse_color_);
+  Write(state.ambient_light_);
+  Write(state.shader_);
+  Write<uint8_t>(state.translucent_ ? 1 : 0);
+}
+
+void ShadingSystemRecording::BindGeometry(const RenderBlock& render_block) {
+  Write<uint8_t>(kBindGeometry);
+  WriteBuffer(GetVertexBuffer(render_block.vertex_buffer_));
+  WriteBuffer(GetVertexBuffer(render_block.normal_buffer_));
+  WriteBuffer(GetIndexBuffer(render_block.index_buffer_));
+}
+
+void ShadingSystemRecording::Draw(const RenderBlock& render_block,
+                                  const DrawConstants* instances,
+                                  const uint32_t instance_count) {
+  Write<uint8_t>(kDraw);
+  Write(render_block.layer_);
+  Write(render_block.depth_);
+  Write(instance_count);
+  for (uint32_t i = 0; i < instance_count; ++i) {
+    Write(instances[i]);
+  }
+}
+
+void ShadingSystemRecording::Present() {
+  Write<uint8_t>(kPresent);
+}
+
+template <class T>
+void ShadingSystemRecording::WriteBuffer(const Buffer<T>* buffer) {
+  uint32_t id = 0;
+  uint64_t start = 0;
+  uint64_t size = 0;
+
+  if (buffer != NULL) {
+    std::unordered_map<const void*, uint32_t>::iterator entry =
+        buffer_ids_.find(buffer);
+    if (entry == buffer_ids_.end()) {
+      id = static_cast<uint32_t>(buffer_ids_.size()) + 1;
+      buffer_ids_[buffer] = id;
+    } else {
+      id = entry->second;
+    }
+    start = buffer->start_;
+    size = buffer->size_;
+  }
+
+  Write(id);
+  Write(start);
+  Write(size);
+}
+
+}  // namespace shade
+}  // namespace mx
@@ -0,0 +1,124 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include "shade/state_cache.h"
+
+namespace mx {
+namespace shade {
+namespace {
+
+// FNV-1a hash over 32 bit values.
+class Fnv {
+ public:
+  Fnv() : value_(14695981039346656037ULL) {}
+
+  void Add(const uint32_t value) {
+    value_ = (value_ ^ value) * 1099511628211ULL;
+  }
+
+  void Add(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    Add(bits);
+  }
+
+  uint64_t value() const { return value_; }
+
+ private:
+  uint64_t value_;
+};
+
+}  // namespace
+
+const uint32_t StateCache::kChunkBits;
+const uint32_t StateCache::kChunkSize;
+const uint32_t StateCache::kMaxChunks;
+
+StateCache::StateCache() : size_(0) {
+  memset(chunks_, 0, sizeof(chunks_));
+  RenderState state;
+  memset(&state, 0, sizeof(state));
+  Intern(state);
+}
+
+StateCache::~StateCache() {
+  for (uint32_t i = 0; i < kMaxChunks && chunks_[i] != NULL; ++i) {
+    delete[] chunks_[i];
+  }
+}
+
+StateHandle StateCache::Intern(const RenderState& state) {
+  const uint64_t hash = Hash(state);
+
+  typedef std::unordered_multimap<uint64_t, StateHandle>::const_iterator
+      Iterator;
+  std::pair<Iterator, Iterator> range = handles_.equal_range(hash);
+  for (Iterator entry = range.first; entry != range.second; ++entry) {
+    if (Equal(Get(entry->second), state)) {
+      return entry->second;
+    }
+  }
+
+  const StateHandle handle = size_;
+  assert(handle < kMaxChunks * kChunkSize);
+  RenderState*& chunk = chunks_[handle >> kChunkBits];
+  if (chunk == NULL) {
+    chunk = new RenderState[kChunkSize];
+  }
+  chunk[handle & (kChunkSize - 1)] = state;
+  ++size_;
+  handles_.insert(std::make_pair(hash, handle));
+  return handle;
+}
+
+// Compares members individually, so padding doesn't matter.
+bool StateCache::Equal(const RenderState& a, const RenderState& b) {
+  return memcmp(a.diffuse_color_, b.diffuse_color_,
+                sizeof(a.diffuse_color_)) == 0 &&
+         memcmp(a.ambient_light_, b.ambient_light_,
+                sizeof(a.ambient_light_)) == 0 &&
+         a.shader_ == b.shader_ &&
+         a.translucent_ == b.translucent_;
+}
+
+uint64_t StateCache::Hash(const RenderState& state) {
+  Fnv hash;
+  for (uint32_t i = 0; i < 3; ++i) {
+    hash.Add(state.diffuse_color_[i]);
+  }
+  for (uint32_t i = 0; i < 6; ++i) {
+    hash.Add(state.ambient_light_[i]);
+  }
+  hash.Add(state.shader_);
+  hash.Add(static_cast<uint32_t>(state.translucent_));
+  return hash.value();
+}
+
+}  // namespace shade
+}  // namespace mx
@@ -0,0 +1,285 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include <vector>
+#include <shade/buffer_device_cpu.h>
+#include <shade/buffer_manager.h>
+
+using namespace mx::shade;
+
+namespace {
+
+template <class T>
+bool Matches(const BufferDeviceCpu& device, const DeviceBuffer* location,
+             const Buffer<T>& buffer) {
+  const uint8_t* data = device.data(location->buffer_);
+  return location->size_ == buffer.size_ * sizeof(T) &&
+      location->offset_ + location->size_ <= device.size(location->buffer_) &&
+      memcmp(data + location->offset_, buffer.data_ + buffer.start_,
+             location->size_) == 0;
+}
+
+void TestStaticBuffers() {
+  BufferDeviceCpu device;
+  BufferManager manager(&device, 1024, 1024);
+
+  std::vector<float> vertices(64);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    vertices[i] = static_cast<float>(i);
+  }
+  // Three buffers of 100 bytes each are sub-allocated from one block.
+  Buffer<float> buffers[3];
+  for (uint32_t i = 0; i < 3; ++i) {
+    buffers[i] = Buffer<float>(&vertices[0], 8 * i, 25);
+  }
+
+  manager.BeginFrame();
+  const DeviceBuffer* locations[3];
+  for (uint32_t i = 0; i < 3; ++i) {
+    locations[i] = manager.Acquire(&buffers[i]);
+    assert(locations[i] != NULL);
+    assert(Matches(device, locations[i], buffers[i]));
+    assert(locations[i]->offset_ % BufferManager::kAlignment == 0);
+  }
+  assert(locations[0]->buffer_ == locations[2]->buffer_);
+  assert(locations[1]->offset_ >= locations[0]->offset_ + 100);
+  assert(manager.block_count() == 1);
+  assert(manager.statistics().uploads_ == 3);
+  assert(manager.statistics().upload_bytes_ == 300);
+  manager.EndFrame();
+
+  // Static buffers are only uploaded once.
+  manager.BeginFrame();
+  for (uint32_t i = 0; i < 3; ++i) {
+    const DeviceBuffer* location = manager.Acquire(&buffers[i]);
+    assert(location == locations[i]);
+    (void)location;
+  }
+  assert(manager.statistics().uploads_ == 0);
+  assert(manager.statistics().cache_hits_ == 3);
+
+  vertices[8] = -1.0f;
+  assert(!Matches(device, locations[1], buffers[1]));
+  manager.Update(&buffers[1]);
+  assert(Matches(device, locations[1], buffers[1]));
+  manager.EndFrame();
+
+  // Freed ranges are merged with their neighbours and reused.
+  const size_t first = locations[0]->offset_;
+  manager.Release(&buffers[0]);
+  manager.Release(&buffers[1]);
+  Buffer<float> large(&vertices[0], 0, 50);
+  manager.BeginFrame();
+  const DeviceBuffer* location = manager.Acquire(&large);
+  assert(location->offset_ == first);
+  (void)first;
+  assert(Matches(device, location, large));
+
+  // Buffers larger than a block get a block of their own, which is destroyed
+  // when they are released.
+  std::vector<float> huge_vertices(1000, 1.0f);
+  Buffer<float> huge(&huge_vertices[0], 0, huge_vertices.size());
+  location = manager.Acquire(&huge);
+  assert(Matches(device, location, huge));
+  assert(manager.block_count() == 2);
+  assert(device.buffer_count() == 2);
+  (void)location;
+  manager.Release(&huge);
+  assert(manager.block_count() == 1);
+  assert(device.buffer_count() == 1);
+
+  // A buffer that changed its size is uploaded again.
+  buffers[2].size_ = 10;
+  location = manager.Acquire(&buffers[2]);
+  assert(Matches(device, location, buffers[2]));
+  assert(manager.statistics().uploads_ == 3);
+  (void)location;
+  manager.EndFrame();
+
+  manager.Clear();
+  assert(device.buffer_count() == 0);
+}
+
+void TestDynamicBuffers() {
+  BufferDeviceCpu device;
+  BufferManager manager(&device, 1024, 1024);
+
+  std::vector<uint32_t> indices(32, 7);
+  Buffer<uint32_t> dynamic(&indices[0], 0, 32, kDynamicUsage);
+  Buffer<uint32_t> stream(&indices[0], 0, 16, kStreamUsage);
+
+  for (uint32_t frame = 0; frame < 4; ++frame) {
+    indices[0] = frame;
+    manager.BeginFrame();
+    // Dynamic buffers are copied into the ring once per frame, stream
+    // buffers every time.
+    const DeviceBuffer* location = manager.Acquire(&dynamic);
+    assert(Matches(device, location, dynamic));
+    const DeviceBuffer* cached = manager.Acquire(&dynamic);
+    assert(cached == location);
+    (void)cached;
+    for (uint32_t i = 0; i < 2; ++i) {
+      location = manager.Acquire(&stream);
+      assert(location != NULL);
+      assert(Matches(device, location, stream));
+    }
+    (void)location;
+    assert(manager.statistics().uploads_ == 3);
+    assert(manager.statistics().cache_hits_ == 1);
+    assert(manager.statistics().upload_bytes_ == 256);
+    manager.EndFrame();
+  }
+  assert(manager.block_count() == 0);
+  assert(device.buffer_count() == 1);
+  assert(device.hazards() == 0);
+
+  // Updating a dynamic buffer copies it again.
+  manager.BeginFrame();
+  manager.Acquire(&dynamic);
+  indices[1] = 3;
+  manager.Update(&dynamic);
+  const DeviceBuffer* location = manager.Acquire(&dynamic);
+  assert(Matches(device, location, dynamic));
+  assert(manager.statistics().uploads_ == 2);
+  (void)location;
+  manager.EndFrame();
+}
+
+void TestFences() {
+  // The simulated GPU is two frames behind, and every frame streams a
+  // quarter of the ring.
+  BufferDeviceCpu device;
+  device.set_latency(2);
+  BufferManager manager(&device, 1024, 1024, 8);
+
+  std::vector<uint8_t> data(64);
+  Buffer<uint8_t> buffer(&data[0], 0, data.size(), kStreamUsage);
+  for (uint32_t frame = 0; frame < 32; ++frame) {
+    manager.BeginFrame();
+    for (uint32_t i = 0; i < 4; ++i) {
+      data[i] = static_cast<uint8_t>(frame);
+      const DeviceBuffer* location = manager.Acquire(&buffer);
+      assert(location != NULL && Matches(device, location, buffer));
+      (void)location;
+    }
+    assert(manager.statistics().waits_ == 0);
+    manager.EndFrame();
+    assert(manager.ring_used() <= manager.ring_size());
+  }
+  assert(device.waits() == 0);
+  assert(manager.frames_in_flight() == 3);
+
+  // A GPU further behind makes the CPU wait for ring space.
+  device.set_latency(6);
+  uint32_t waits = 0;
+  for (uint32_t frame = 0; frame < 32; ++frame) {
+    manager.BeginFrame();
+    for (uint32_t i = 0; i < 4; ++i) {
+      const DeviceBuffer* location = manager.Acquire(&buffer);
+      assert(location != NULL);
+      (void)location;
+    }
+    waits += manager.statistics().waits_;
+    manager.EndFrame();
+  }
+  assert(waits > 0);
+  assert(device.waits() == waits);
+  assert(device.hazards() == 0);
+
+  // Data that doesn't fit next to the current frame is rejected.
+  manager.BeginFrame();
+  std::vector<uint8_t> large(1024);
+  Buffer<uint8_t> fills(&large[0], 0, large.size(), kStreamUsage);
+  const DeviceBuffer* location = manager.Acquire(&fills);
+  assert(location != NULL);
+  location = manager.Acquire(&buffer);
+  assert(location == NULL);
+  Buffer<uint8_t> too_large(&large[0], 0, large.size() + 1, kStreamUsage);
+  location = manager.Acquire(&too_large);
+  assert(location == NULL);
+  (void)location;
+  manager.EndFrame();
+  assert(device.hazards() == 0);
+}
+
+void TestFramesInFlight() {
+  BufferDeviceCpu device;
+  device.set_latency(10);
+  BufferManager manager(&device, 1024, 1024, 2);
+
+  for (uint32_t frame = 0; frame < 8; ++frame) {
+    manager.BeginFrame();
+    assert(manager.frames_in_flight() < 2);
+    assert(manager.statistics().waits_ == (frame < 2 ? 0 : 1));
+    manager.EndFrame();
+  }
+}
+
+// Buffers acquired by key, e.g. by the handle of a buffer in a slot map,
+// stay on the device when the Buffer object moves.
+void TestKeyedBuffers() {
+  BufferDeviceCpu device;
+  BufferManager manager(&device, 1024, 1024);
+  std::vector<float> vertices(16, 1.0f);
+  Buffer<float> buffers[2];
+  buffers[0] = Buffer<float>(&vertices[0], 0, 16);
+
+  manager.BeginFrame();
+  const DeviceBuffer* location = manager.Acquire(7, buffers[0]);
+  assert(location != NULL);
+  assert(Matches(device, location, buffers[0]));
+  buffers[1] = buffers[0];
+  const DeviceBuffer* moved = manager.Acquire(7, buffers[1]);
+  assert(moved == location);
+  (void)moved;
+  assert(manager.statistics().uploads_ == 1);
+  assert(manager.statistics().cache_hits_ == 1);
+
+  vertices[0] = 2.0f;
+  manager.Update(7, buffers[1]);
+  assert(Matches(device, location, buffers[1]));
+
+  manager.Release(7);
+  location = manager.Acquire(7, buffers[1]);
+  assert(Matches(device, location, buffers[1]));
+  assert(manager.statistics().uploads_ == 3);
+  (void)location;
+  manager.EndFrame();
+}
+
+}  // namespace
+
+int main() {
+  TestStaticBuffers();
+  TestDynamicBuffers();
+  TestFences();
+  TestFramesInFlight();
+  TestKeyedBuffers();
+  return 0;
+}
@@ -0,0 +1,108 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <mxcore/aligned_memory.h>
+#include <mxcore/concurrent_linear_allocator.h>
+#include <mxcore/linear_allocator.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kMaxThreads = 32;
+const uint32_t kAllocationsPerThread = 1 << 16;
+const size_t kAllocationSize = 16;
+
+// The way shared arenas had to be used before ConcurrentLinearAllocator.
+class LockedLinearAllocator {
+ public:
+  LockedLinearAllocator(void* base, const size_t size)
+      : allocator_(base, size) {}
+
+  void* Allocate(const size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocator_.Allocate(size);
+  }
+
+  void Rewind(void* to) { allocator_.Rewind(to); }
+
+ private:
+  LinearAllocator allocator_;
+  std::mutex mutex_;
+};
+
+template <class Allocator>
+void Work(Allocator* allocator) {
+  for (uint32_t i = 0; i < kAllocationsPerThread; ++i) {
+    *reinterpret_cast<uint8_t*>(allocator->Allocate(kAllocationSize)) = 0;
+  }
+}
+
+// Returns the number of allocations per second with thread_count threads
+// sharing one allocator.
+template <class Allocator>
+double Measure(Allocator& allocator, void* start, uint32_t thread_count) {
+  std::vector<std::thread> threads;
+  allocator.Rewind(start);
+
+  Timer timer;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.push_back(std::thread(Work<Allocator>, &allocator));
+  }
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads[i].join();
+  }
+  double seconds = timer.elapsed_seconds();
+
+  return (static_cast<double>(thread_count) * kAllocationsPerThread) / seconds;
+}
+
+}  // namespace
+
+int main() {
+  AlignedMemory<8> memory(kMaxThreads * kAllocationsPerThread *
+                          kAllocationSize);
+  LockedLinearAllocator locked(memory.pointer(), memory.size());
+  ConcurrentLinearAllocator concurrent(memory.pointer(), memory.size());
+
+  printf("%8s %16s %16s %8s\n", "threads", "locked/s", "concurrent/s",
+         "speedup");
+
+  for (uint32_t threads = 1; threads <= kMaxThreads; threads *= 2) {
+    double locked_rate = Measure(locked, memory.pointer(), threads);
+    double concurrent_rate = Measure(concurrent, memory.pointer(), threads);
+    printf("%8u %16.0f %16.0f %8.2f\n", threads, locked_rate, concurrent_rate,
+           concurrent_rate / locked_rate);
+  }
+
+  return 0;
+}
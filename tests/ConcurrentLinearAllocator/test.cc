@@ -0,0 +1,160 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <mxcore/aligned_memory.h>
+#include <mxcore/alignment.h>
+#include <mxcore/concurrent_linear_allocator.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kThreadCount = 16;
+const uint32_t kAllocationsPerThread = 10000;
+
+struct Block {
+  uint8_t* pointer;
+  size_t size;
+  uint8_t pattern;
+};
+
+bool operator<(const Block& a, const Block& b) {
+  return a.pointer < b.pointer;
+}
+
+// Allocates blocks of varying size and fills each one with the thread's
+// pattern, so overlapping allocations can be detected afterwards.
+void AllocateBlocks(ConcurrentLinearAllocator* allocator, uint8_t pattern,
+                    std::vector<Block>* blocks) {
+  for (uint32_t i = 0; i < kAllocationsPerThread; ++i) {
+    Block block;
+    block.size = 1 + (i * 7 + pattern) % 61;
+    block.pattern = pattern;
+    block.pointer = reinterpret_cast<uint8_t*>(allocator->Allocate(block.size));
+    assert(block.pointer != NULL);
+    memset(block.pointer, pattern, block.size);
+    blocks->push_back(block);
+  }
+}
+
+// Allocates until the allocator runs dry and counts the bytes obtained.
+void Exhaust(ConcurrentLinearAllocator* allocator, size_t* bytes) {
+  *bytes = 0;
+  while (allocator->Allocate(24) != NULL) {
+    *bytes += 24;
+  }
+}
+
+void TestConcurrentAllocation(ConcurrentLinearAllocator& allocator) {
+  std::vector<Block> blocks[kThreadCount];
+  std::vector<std::thread> threads;
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    blocks[i].reserve(kAllocationsPerThread);
+    threads.push_back(std::thread(AllocateBlocks, &allocator,
+                                  static_cast<uint8_t>(i + 1), &blocks[i]));
+  }
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads[i].join();
+  }
+
+  std::vector<Block> all;
+  size_t total = 0;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    all.insert(all.end(), blocks[i].begin(), blocks[i].end());
+  }
+
+  std::sort(all.begin(), all.end());
+  for (size_t i = 0; i < all.size(); ++i) {
+    for (size_t j = 0; j < all[i].size; ++j) {
+      assert(all[i].pointer[j] == all[i].pattern);
+    }
+    if (i + 1 < all.size()) {
+      assert(all[i].pointer + all[i].size <= all[i + 1].pointer);
+    }
+    total += all[i].size;
+  }
+
+  // Without alignment padding the blocks have to be packed without gaps.
+  assert(total == allocator.bytes_allocated());
+  printf("%lu blocks, %lu bytes\n", static_cast<unsigned long>(all.size()),
+         static_cast<unsigned long>(total));
+}
+
+void TestExhaustion(ConcurrentLinearAllocator& allocator) {
+  size_t bytes[kThreadCount];
+  std::vector<std::thread> threads;
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.push_back(std::thread(Exhaust, &allocator, &bytes[i]));
+  }
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads[i].join();
+    total += bytes[i];
+  }
+
+  assert(total <= allocator.size());
+  assert(allocator.size() - total < 24);
+  void* overflow = allocator.Allocate(1);
+  assert(overflow == NULL);
+  (void)overflow;
+  printf("exhausted after %lu bytes\n", static_cast<unsigned long>(total));
+}
+
+}  // namespace
+
+int main() {
+  AlignedMemory<8> memory(kThreadCount * kAllocationsPerThread * 64);
+  ConcurrentLinearAllocator allocator(memory.pointer(), memory.size());
+  void* start = allocator.marker();
+
+  TestConcurrentAllocation(allocator);
+  allocator.Rewind(start);
+  assert(allocator.bytes_allocated() == 0);
+
+  TestExhaustion(allocator);
+  allocator.Rewind(start);
+  void* first = allocator.Allocate(16);
+  assert(first == start);
+
+  allocator.Allocate(3);
+  void* aligned = allocator.Allocate(32, 32);
+  assert(IsAligned(aligned, 32));
+  (void)first;
+  (void)aligned;
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <mxcore/aligned_memory.h>
+#include <mxcore/mpmc_queue.h>
+#include <mxcore/mpsc_queue.h>
+#include <mxcore/spsc_queue.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kItems = 1 << 20;
+const uint32_t kCapacity = 1024;
+
+// The baseline: a deque behind a mutex, bounded like the lock-free queues.
+class LockedQueue {
+ public:
+  bool Push(const uint32_t& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (values_.size() >= kCapacity) {
+      return false;
+    }
+    values_.push_back(value);
+    return true;
+  }
+
+  bool Pop(uint32_t* value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (values_.empty()) {
+      return false;
+    }
+    *value = values_.front();
+    values_.pop_front();
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::deque<uint32_t> values_;
+};
+
+struct Message : public MpscNode {
+  uint32_t value_;
+};
+
+// Adapts the intrusive queue to the same interface with a preallocated
+// message per value. Unlike the others it is unbounded.
+class MessageQueue {
+ public:
+  MessageQueue() : messages_(kItems) {}
+
+  bool Push(const uint32_t& value) {
+    Message* message = &messages_[value];
+    message->value_ = value;
+    queue_.Push(message);
+    return true;
+  }
+
+  bool Pop(uint32_t* value) {
+    Message* message = queue_.Pop();
+    if (message == NULL) {
+      return false;
+    }
+    *value = message->value_;
+    return true;
+  }
+
+ private:
+  MpscQueue<Message> queue_;
+  std::vector<Message> messages_;
+};
+
+// Producers push kItems values in total, consumers pop until all arrived.
+// Returns millions of items per second.
+template <typename Queue>
+double Run(Queue* queue, const uint32_t producers, const uint32_t consumers) {
+  std::atomic<uint32_t> remaining(kItems);
+  std::atomic<uint64_t> checksum(0);
+  std::vector<std::thread> threads;
+  Timer timer;
+  for (uint32_t c = 0; c < consumers; ++c) {
+    threads.push_back(std::thread([queue, &remaining, &checksum]() {
+      uint64_t sum = 0;
+      uint32_t value;
+      while (remaining.load(std::memory_order_relaxed) > 0) {
+        if (queue->Pop(&value)) {
+          remaining.fetch_sub(1, std::memory_order_relaxed);
+          sum += value;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      checksum.fetch_add(sum);
+    }));
+  }
+  for (uint32_t p = 0; p < producers; ++p) {
+    threads.push_back(std::thread([queue, p, producers]() {
+      for (uint32_t i = p; i < kItems; i += producers) {
+        while (!queue->Push(i)) {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  const double seconds = timer.elapsed_seconds();
+
+  if (checksum.load() != uint64_t(kItems) * (kItems - 1) / 2) {
+    printf("checksum mismatch\n");
+  }
+  return kItems / seconds / 1000000.0;
+}
+
+void Print(const char* name, const uint32_t producers,
+           const uint32_t consumers, const double lock_free,
+           const double locked) {
+  printf("%6s %10u %10u %12.2f %12.2f %8.2f\n", name, producers, consumers,
+         lock_free, locked, lock_free / locked);
+}
+
+}  // namespace
+
+int main() {
+  const uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<uint32_t> thread_counts;
+  for (uint32_t threads = 1; threads < std::max(hardware, 4u); threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(std::max(hardware, 4u));
+
+  printf("%u hardware threads, %u items\n", hardware, kItems);
+  printf("%6s %10s %10s %12s %12s %8s\n", "queue", "producers", "consumers",
+         "Mitems/s", "mutex", "ratio");
+
+  {
+    AlignedMemory<16> memory(SpscQueue<uint32_t>::memory_size(kCapacity));
+    SpscQueue<uint32_t> queue(memory.pointer(), kCapacity);
+    LockedQueue locked;
+    Print("spsc", 1, 1, Run(&queue, 1, 1), Run(&locked, 1, 1));
+  }
+
+  for (size_t i = 0; i < thread_counts.size(); ++i) {
+    const uint32_t threads = thread_counts[i];
+    AlignedMemory<16> memory(MpmcQueue<uint32_t>::memory_size(kCapacity));
+    MpmcQueue<uint32_t> queue(memory.pointer(), kCapacity);
+    LockedQueue locked;
+    Print("mpmc", threads, threads, Run(&queue, threads, threads),
+          Run(&locked, threads, threads));
+  }
+
+  for (size_t i = 0; i < thread_counts.size(); ++i) {
+    const uint32_t threads = thread_counts[i];
+    MessageQueue queue;
+    LockedQueue locked;
+    Print("mpsc", threads, 1, Run(&queue, threads, 1),
+          Run(&locked, threads, 1));
+  }
+  return 0;
+}
@@ -0,0 +1,249 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mxcore/aligned_memory.h>
+#include <mxcore/mpmc_queue.h>
+#include <mxcore/mpsc_queue.h>
+#include <mxcore/spsc_queue.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kProducers = 4;
+const uint32_t kConsumers = 4;
+const uint32_t kItemsPerProducer = 100000;
+
+// Items carry their producer in the upper bits and a sequence number in the
+// lower ones.
+const uint32_t kSequenceBits = 24;
+
+void TestMpmcBasics() {
+  AlignedMemory<16> memory(MpmcQueue<uint32_t>::memory_size(4));
+  MpmcQueue<uint32_t> queue(memory.pointer(), 4);
+  uint32_t value = 0;
+  assert(!queue.Pop(&value));
+
+  for (uint32_t round = 0; round < 10; ++round) {
+    for (uint32_t i = 0; i < 4; ++i) {
+      const bool pushed = queue.Push(round * 4 + i);
+      assert(pushed);
+      (void)pushed;
+    }
+    const bool pushed = queue.Push(0);
+    assert(!pushed);
+    (void)pushed;
+    assert(queue.size() == 4);
+
+    for (uint32_t i = 0; i < 4; ++i) {
+      const bool popped = queue.Pop(&value);
+      assert(popped);
+      (void)popped;
+      assert(value == round * 4 + i);
+    }
+    assert(!queue.Pop(&value));
+    assert(queue.size() == 0);
+  }
+}
+
+void Produce(MpmcQueue<uint32_t>* queue, const uint32_t producer) {
+  for (uint32_t i = 0; i < kItemsPerProducer; ++i) {
+    while (!queue->Push((producer << kSequenceBits) | i)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void Consume(MpmcQueue<uint32_t>* queue, std::atomic<uint32_t>* remaining,
+             std::vector<uint32_t>* items) {
+  uint32_t value;
+  while (remaining->load(std::memory_order_relaxed) > 0) {
+    if (queue->Pop(&value)) {
+      remaining->fetch_sub(1, std::memory_order_relaxed);
+      items->push_back(value);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Every item has to arrive exactly once, and every consumer has to see the
+// items of a producer in the order they were pushed.
+void CheckItems(const std::vector<uint32_t>* items, const uint32_t consumers,
+                const uint32_t producers) {
+  std::vector<uint32_t> seen(producers * kItemsPerProducer, 0);
+  for (uint32_t c = 0; c < consumers; ++c) {
+    std::vector<int64_t> last(producers, -1);
+    for (size_t i = 0; i < items[c].size(); ++i) {
+      const uint32_t producer = items[c][i] >> kSequenceBits;
+      const uint32_t sequence = items[c][i] & ((1 << kSequenceBits) - 1);
+      assert(producer < producers);
+      assert(static_cast<int64_t>(sequence) > last[producer]);
+      last[producer] = sequence;
+      ++seen[producer * kItemsPerProducer + sequence];
+    }
+  }
+  for (size_t i = 0; i < seen.size(); ++i) {
+    assert(seen[i] == 1);
+  }
+}
+
+void TestMpmcConcurrent() {
+  AlignedMemory<16> memory(MpmcQueue<uint32_t>::memory_size(256));
+  MpmcQueue<uint32_t> queue(memory.pointer(), 256);
+  std::atomic<uint32_t> remaining(kProducers * kItemsPerProducer);
+  std::vector<uint32_t> items[kConsumers];
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kConsumers; ++i) {
+    threads.push_back(std::thread(Consume, &queue, &remaining, &items[i]));
+  }
+  for (uint32_t i = 0; i < kProducers; ++i) {
+    threads.push_back(std::thread(Produce, &queue, i));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  CheckItems(items, kConsumers, kProducers);
+  assert(queue.size() == 0);
+  printf("mpmc: %u items\n", kProducers * kItemsPerProducer);
+}
+
+void TestSpsc() {
+  AlignedMemory<16> memory(SpscQueue<uint32_t>::memory_size(64));
+  SpscQueue<uint32_t> queue(memory.pointer(), 64);
+  uint32_t value = 0;
+  assert(!queue.Pop(&value));
+  for (uint32_t i = 0; i < 64; ++i) {
+    const bool pushed = queue.Push(i);
+    assert(pushed);
+    (void)pushed;
+  }
+  const bool pushed = queue.Push(64);
+  assert(!pushed);
+  (void)pushed;
+  for (uint32_t i = 0; i < 64; ++i) {
+    const bool popped = queue.Pop(&value);
+    assert(popped);
+    (void)popped;
+    assert(value == i);
+  }
+  assert(!queue.Pop(&value));
+
+  // Strict order across threads.
+  const uint32_t kItems = 1000000;
+  std::thread producer([&queue]() {
+    for (uint32_t i = 0; i < kItems; ++i) {
+      while (!queue.Push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  uint32_t expected = 0;
+  while (expected < kItems) {
+    if (queue.Pop(&value)) {
+      assert(value == expected);
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  assert(queue.size() == 0);
+  printf("spsc: %u items in order\n", kItems);
+}
+
+struct Message : public MpscNode {
+  uint32_t value_;
+};
+
+void TestMpsc() {
+  MpscQueue<Message> queue;
+  assert(queue.empty());
+  assert(queue.Pop() == NULL);
+
+  Message messages[3];
+  for (uint32_t round = 0; round < 3; ++round) {
+    for (uint32_t i = 0; i < 3; ++i) {
+      messages[i].value_ = i;
+      queue.Push(&messages[i]);
+    }
+    assert(!queue.empty());
+    for (uint32_t i = 0; i < 3; ++i) {
+      Message* message = queue.Pop();
+      assert(message == &messages[i]);
+      (void)message;
+    }
+    assert(queue.Pop() == NULL);
+    assert(queue.empty());
+  }
+
+  std::vector<Message> pool(kProducers * kItemsPerProducer);
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < kProducers; ++p) {
+    producers.push_back(std::thread([&queue, &pool, p]() {
+      for (uint32_t i = 0; i < kItemsPerProducer; ++i) {
+        Message* message = &pool[p * kItemsPerProducer + i];
+        message->value_ = (p << kSequenceBits) | i;
+        queue.Push(message);
+      }
+    }));
+  }
+
+  std::vector<uint32_t> items;
+  items.reserve(pool.size());
+  while (items.size() < pool.size()) {
+    Message* message = queue.Pop();
+    if (message != NULL) {
+      items.push_back(message->value_);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  for (uint32_t p = 0; p < kProducers; ++p) {
+    producers[p].join();
+  }
+
+  CheckItems(&items, 1, kProducers);
+  assert(queue.Pop() == NULL);
+  printf("mpsc: %lu items\n", static_cast<unsigned long>(items.size()));
+}
+
+}  // namespace
+
+int main() {
+  TestMpmcBasics();
+  TestMpmcConcurrent();
+  TestSpsc();
+  TestMpsc();
+  return 0;
+}
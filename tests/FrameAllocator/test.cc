@@ -0,0 +1,183 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mxcore/frame_allocator.h>
+#include <mxcore/thread_index.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kThreadCount = 4;
+const uint32_t kFrameCount = 3;
+const size_t kArenaSize = 4096;
+
+void Fill(FrameAllocator* frames, uint8_t pattern, uint8_t** result) {
+  uint8_t* data = reinterpret_cast<uint8_t*>(frames->Allocate(1024, 16));
+  memset(data, pattern, 1024);
+  *result = data;
+}
+
+bool Check(const uint8_t* data, uint8_t pattern) {
+  for (uint32_t i = 0; i < 1024; ++i) {
+    if (data[i] != pattern) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TestThreadIndex() {
+  uint32_t index = CurrentThreadIndex();
+  uint32_t other = kMaxThreads;
+  std::thread thread([&other]() { other = CurrentThreadIndex(); });
+  thread.join();
+
+  assert(index == CurrentThreadIndex());
+  assert(other < kMaxThreads && other != index);
+  (void)index;
+
+  // The index of a finished thread is handed out again.
+  uint32_t recycled = kMaxThreads;
+  std::thread next([&recycled]() { recycled = CurrentThreadIndex(); });
+  next.join();
+  assert(recycled == other);
+}
+
+// More threads than thread_count allocate at the same time. The workers
+// wait for each other, so they hold distinct thread indices even on a single
+// core.
+void TestConcurrentThreads() {
+  const uint32_t kWorkers = 6;
+  FrameAllocator frames(kArenaSize, 2, 2);
+  uint8_t* main_data = NULL;
+  Fill(&frames, 0xff, &main_data);
+
+  std::atomic<uint32_t> arrived(0);
+  uint8_t* data[kWorkers];
+  uint32_t slots[kWorkers];
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kWorkers; ++i) {
+    threads.push_back(std::thread([&frames, &arrived, &data, &slots, i]() {
+      Fill(&frames, static_cast<uint8_t>(i + 1), &data[i]);
+      slots[i] = frames.slot();
+      ++arrived;
+      while (arrived.load() < kWorkers) {
+        std::this_thread::yield();
+      }
+    }));
+  }
+  for (uint32_t i = 0; i < kWorkers; ++i) {
+    threads[i].join();
+  }
+
+  for (uint32_t i = 0; i < kWorkers; ++i) {
+    const bool intact = data[i] != NULL && Check(data[i], i + 1);
+    assert(intact);
+    (void)intact;
+    assert(slots[i] < kMaxThreads && slots[i] != frames.slot());
+    for (uint32_t j = 0; j < i; ++j) {
+      assert(slots[i] != slots[j]);
+    }
+  }
+  const bool intact = Check(main_data, 0xff);
+  assert(intact);
+  (void)intact;
+
+  // The arenas beyond thread_count are rewound like the others.
+  uint32_t highest = 0;
+  for (uint32_t i = 0; i < kWorkers; ++i) {
+    highest = slots[i] > highest ? slots[i] : highest;
+  }
+  assert(highest >= 2);
+  assert(frames.arena(highest).bytes_allocated() == 1024);
+  frames.BeginFrame();
+  frames.BeginFrame();
+  assert(frames.arena(highest).bytes_allocated() == 0);
+}
+
+}  // namespace
+
+int main() {
+  TestThreadIndex();
+  TestConcurrentThreads();
+
+  FrameAllocator frames(kArenaSize, kThreadCount, kFrameCount);
+  uint8_t* data[kFrameCount][kThreadCount];
+  void* first_frame[kThreadCount];
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    first_frame[i] = frames.arena(i).marker();
+  }
+
+  for (uint32_t frame = 0; frame < kFrameCount; ++frame) {
+    if (frame > 0) {
+      frames.BeginFrame();
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < kThreadCount; ++i) {
+      uint8_t pattern = static_cast<uint8_t>(frame * kThreadCount + i + 1);
+      threads.push_back(std::thread(Fill, &frames, pattern, &data[frame][i]));
+    }
+    for (uint32_t i = 0; i < kThreadCount; ++i) {
+      threads[i].join();
+    }
+  }
+
+  // All frames still in flight are untouched.
+  for (uint32_t frame = 0; frame < kFrameCount; ++frame) {
+    for (uint32_t i = 0; i < kThreadCount; ++i) {
+      const bool intact = Check(data[frame][i], frame * kThreadCount + i + 1);
+      assert(intact);
+      (void)intact;
+    }
+  }
+
+  // Reusing the oldest set hands out the same memory again.
+  frames.BeginFrame();
+  assert(frames.frame() == kFrameCount);
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    assert(frames.arena(i).marker() == first_frame[i]);
+  }
+  (void)first_frame;
+
+  // The main thread gets its own slot.
+  uint8_t* main_data = reinterpret_cast<uint8_t*>(frames.Allocate(64));
+  assert(main_data != NULL);
+  assert(&frames.allocator() == &frames.allocator());
+  (void)main_data;
+
+  printf("frame %lu\n", static_cast<unsigned long>(frames.frame()));
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <mxcore/heap_profile.h>
+#include <mxcore/memory_tracker.h>
+
+using namespace mx::core;
+
+namespace {
+
+struct Mesh {
+  float vertices_[64];
+};
+
+uint32_t small_line = 0;
+uint32_t mesh_line = 0;
+
+void* AllocateSmall() {
+  small_line = __LINE__ + 1;
+  return mxalloc(16);
+}
+
+Mesh* AllocateMesh() {
+  mesh_line = __LINE__ + 1;
+  return mxnew(Mesh, ());
+}
+
+#ifdef MX_MEMORY_TRACKING_ENABLED
+const CallSiteStatistics* FindSite(const HeapSnapshot& snapshot,
+                                   const uint32_t line) {
+  for (size_t i = 0; i < snapshot.sites().size(); ++i) {
+    const CallSiteStatistics& site = snapshot.sites()[i];
+    if (site.line_ == line && strstr(site.file_, "HeapProfile") != NULL) {
+      return &site;
+    }
+  }
+  return NULL;
+}
+#endif
+
+}  // namespace
+
+int main() {
+  std::vector<void*> small;
+  std::vector<Mesh*> meshes;
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    small.push_back(AllocateSmall());
+  }
+  for (uint32_t i = 0; i < 10; ++i) {
+    meshes.push_back(AllocateMesh());
+  }
+
+  HeapSnapshot before;
+  before.Capture();
+
+  // Churn the small allocations, which doesn't change live memory.
+  for (uint32_t i = 0; i < small.size(); ++i) {
+    mxfree(small[i]);
+    small[i] = AllocateSmall();
+  }
+  mxdelete(meshes.back());
+  meshes.pop_back();
+
+  HeapSnapshot after;
+  after.Capture();
+  HeapSnapshot diff = HeapSnapshot::Diff(before, after);
+
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  const CallSiteStatistics* site = FindSite(after, small_line);
+  assert(site != NULL);
+  assert(site->live_count_ == 1000 && site->live_bytes_ == 16000);
+  assert(site->total_count_ == 2000 && site->peak_bytes_ == 16000);
+
+  site = FindSite(diff, small_line);
+  assert(site != NULL && site->live_bytes_ == 0 && site->total_count_ == 1000);
+  site = FindSite(diff, mesh_line);
+  assert(site != NULL && site->live_count_ == -1 && site->total_count_ == 0);
+
+  after.Sort(HeapSnapshot::kSortByLiveBytes);
+  assert(after.sites()[0].line_ == small_line);
+  after.Sort(HeapSnapshot::kSortByTotalCount);
+  assert(after.sites()[0].total_count_ == 2000);
+  assert(after.sites()[0].allocation_rate_ > 0.0);
+  (void)site;
+#endif
+
+  diff.Sort(HeapSnapshot::kSortByAllocationRate);
+  diff.Print(stdout, 10);
+
+  FILE* file = tmpfile();
+  after.WriteCsv(file);
+  after.WriteJson(file);
+  long size = ftell(file);
+  fclose(file);
+  assert(size > 0);
+  (void)size;
+
+  after.WriteJson(stdout);
+
+  for (uint32_t i = 0; i < small.size(); ++i) {
+    mxfree(small[i]);
+  }
+  for (uint32_t i = 0; i < meshes.size(); ++i) {
+    mxdelete(meshes[i]);
+  }
+
+  MemoryTracker::Report();
+  return 0;
+}
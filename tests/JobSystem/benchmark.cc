@@ -0,0 +1,214 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <algorithm>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <mxcore/job_system.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kRepetitions = 8;
+const uint32_t kTasks = 4096;
+
+// Iterations of the dummy workload per task.
+const uint32_t kSmallTask = 64;
+const uint32_t kLargeTask = 4096;
+
+const uint32_t kTreeBranching = 4;
+const uint32_t kFibers = 256;
+
+float Work(const uint32_t seed, const uint32_t iterations) {
+  float value = static_cast<float>(seed);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    value = sqrtf(value + static_cast<float>(i));
+  }
+  return value;
+}
+
+struct WorkData {
+  float* results_;
+  uint32_t first_;
+  uint32_t count_;
+  uint32_t iterations_;
+};
+
+void RunWork(JobSystem* system, void* data) {
+  const WorkData* work = reinterpret_cast<const WorkData*>(data);
+  for (uint32_t i = work->first_; i < work->first_ + work->count_; ++i) {
+    work->results_[i] = Work(i, work->iterations_);
+  }
+}
+
+// All tasks created by worker 0; the other workers steal.
+void FanOut(JobSystem* system, float* results, const uint32_t iterations) {
+  JobCounter counter;
+  for (uint32_t i = 0; i < kTasks; ++i) {
+    WorkData data = { results, i, 1, iterations };
+    system->Run(system->CreateJob(RunWork, data, &counter));
+  }
+  system->Wait(&counter);
+}
+
+// Recursive halving, so that stolen jobs spawn their own work.
+void Split(JobSystem* system, void* data) {
+  const WorkData* work = reinterpret_cast<const WorkData*>(data);
+  if (work->count_ <= 1) {
+    RunWork(system, data);
+    return;
+  }
+
+  const uint32_t half = work->count_ / 2;
+  WorkData left = { work->results_, work->first_, half, work->iterations_ };
+  WorkData right = { work->results_, work->first_ + half,
+                     work->count_ - half, work->iterations_ };
+  JobCounter counter;
+  system->Run(system->CreateJob(Split, left, &counter));
+  Split(system, &right);
+  system->Wait(&counter);
+}
+
+void Recursive(JobSystem* system, float* results, const uint32_t iterations) {
+  WorkData data = { results, 0, kTasks, iterations };
+  JobCounter counter;
+  system->Run(system->CreateJob(Split, data, &counter));
+  system->Wait(&counter);
+}
+
+struct TreeData {
+  uint32_t depth_;
+  uint32_t seed_;
+};
+
+// A node of a dependency tree: does some work, waits for its children and
+// does some more, like a culling job waiting for its per-cell jobs.
+void Tree(JobSystem* system, void* data) {
+  const TreeData* node = reinterpret_cast<const TreeData*>(data);
+  volatile float result = Work(node->seed_, kSmallTask);
+  if (node->depth_ > 0) {
+    JobCounter counter;
+    for (uint32_t i = 0; i < kTreeBranching; ++i) {
+      TreeData child = { node->depth_ - 1, node->seed_ * kTreeBranching + i };
+      system->Run(system->CreateJob(Tree, child, &counter));
+    }
+    system->Wait(&counter);
+  }
+  result = Work(result, kSmallTask);
+}
+
+}  // namespace
+
+int main() {
+  std::vector<float> results(kTasks);
+  const uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+
+  const uint32_t iterations[] = { kSmallTask, kLargeTask };
+  double serial[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    Timer timer;
+    for (uint32_t repetition = 0; repetition < kRepetitions; ++repetition) {
+      for (uint32_t task = 0; task < kTasks; ++task) {
+        results[task] = Work(task, iterations[i]);
+      }
+    }
+    serial[i] = timer.elapsed_seconds() / kRepetitions;
+  }
+
+  printf("%u hardware threads, %u tasks\n", hardware, kTasks);
+  printf("%8s %10s %10s %12s %8s %10s %10s\n", "workers", "pattern",
+         "task size", "ms", "speedup", "stolen", "sleeps");
+
+  std::vector<uint32_t> worker_counts;
+  for (uint32_t workers = 1; workers < hardware; workers *= 2) {
+    worker_counts.push_back(workers);
+  }
+  worker_counts.push_back(hardware);
+
+  for (size_t w = 0; w < worker_counts.size(); ++w) {
+    JobSystem system(worker_counts[w]);
+    for (uint32_t pattern = 0; pattern < 2; ++pattern) {
+      for (uint32_t i = 0; i < 2; ++i) {
+        system.ResetStatistics();
+        Timer timer;
+        for (uint32_t repetition = 0; repetition < kRepetitions;
+             ++repetition) {
+          if (pattern == 0) {
+            FanOut(&system, &results[0], iterations[i]);
+          } else {
+            Recursive(&system, &results[0], iterations[i]);
+          }
+          system.Reset();
+        }
+        const double seconds = timer.elapsed_seconds() / kRepetitions;
+        const JobStatistics statistics = system.statistics();
+        printf("%8u %10s %10u %12.3f %8.2f %10lu %10lu\n",
+               worker_counts[w], (pattern == 0) ? "fan-out" : "recursive",
+               iterations[i], 1000.0 * seconds, serial[i] / seconds,
+               static_cast<unsigned long>(statistics.stolen_ / kRepetitions),
+               static_cast<unsigned long>(statistics.sleeps_ / kRepetitions));
+      }
+    }
+  }
+
+  // Waits that run other jobs on top of the waiting one versus waits that
+  // suspend the waiting job's fiber.
+  printf("\n%8s %10s %8s %10s %12s %10s\n", "workers", "waits", "depth",
+         "jobs", "ms", "suspends");
+  for (size_t w = 0; w < worker_counts.size(); ++w) {
+    for (uint32_t fibers = 0; fibers <= kFibers; fibers += kFibers) {
+      JobSystem system(worker_counts[w], 1024 * 1024, 4096, fibers);
+      uint32_t jobs = 1;
+      for (uint32_t depth = 0; depth <= 8; ++depth) {
+        if (depth % 2 == 0) {
+          system.ResetStatistics();
+          Timer timer;
+          for (uint32_t repetition = 0; repetition < kRepetitions;
+               ++repetition) {
+            JobCounter counter;
+            TreeData root = { depth, 1 };
+            system.Run(system.CreateJob(Tree, root, &counter));
+            system.Wait(&counter);
+            system.Reset();
+          }
+          const double seconds = timer.elapsed_seconds() / kRepetitions;
+          printf("%8u %10s %8u %10u %12.3f %10lu\n", worker_counts[w],
+                 (fibers > 0) ? "fibers" : "nested", depth, jobs,
+                 1000.0 * seconds,
+                 static_cast<unsigned long>(system.statistics().suspends_ /
+                                            kRepetitions));
+        }
+        jobs = jobs * kTreeBranching + 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,387 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mxcore/job_system.h>
+#include <mxcore/thread_index.h>
+#include <mxcore/work_stealing_deque.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kStressWorkers = 8;
+const uint32_t kFanOutJobs = 100000;
+const uint32_t kDequeItems = 200000;
+const uint32_t kThieves = 4;
+
+void TestDeque() {
+  WorkStealingDeque<uint32_t> deque(4);
+  uint32_t items[5] = { 0, 1, 2, 3, 4 };
+  assert(deque.Pop() == NULL);
+  assert(deque.Steal() == NULL);
+
+  for (uint32_t i = 0; i < 4; ++i) {
+    const bool pushed = deque.Push(&items[i]);
+    assert(pushed);
+    (void)pushed;
+  }
+  const bool pushed = deque.Push(&items[4]);
+  assert(!pushed);
+  (void)pushed;
+  assert(deque.size() == 4);
+
+  // The owner pops the newest item, thieves take the oldest.
+  uint32_t* item = deque.Pop();
+  assert(item == &items[3]);
+  item = deque.Steal();
+  assert(item == &items[0]);
+  item = deque.Pop();
+  assert(item == &items[2]);
+  item = deque.Steal();
+  assert(item == &items[1]);
+  (void)item;
+  assert(deque.Pop() == NULL);
+  assert(deque.size() == 0);
+}
+
+void Steal(WorkStealingDeque<uint32_t>* deque, std::atomic<bool>* done,
+           std::vector<std::atomic<uint32_t> >* taken) {
+  while (!done->load(std::memory_order_acquire) || deque->size() > 0) {
+    uint32_t* item = deque->Steal();
+    if (item != NULL) {
+      (*taken)[*item].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+// The owner pushes and pops while several threads steal; every item has to
+// be taken exactly once.
+void TestDequeStealing() {
+  WorkStealingDeque<uint32_t> deque(256);
+  std::vector<uint32_t> items(kDequeItems);
+  std::vector<std::atomic<uint32_t> > taken(kDequeItems);
+  for (uint32_t i = 0; i < kDequeItems; ++i) {
+    items[i] = i;
+    taken[i].store(0);
+  }
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> thieves;
+  for (uint32_t i = 0; i < kThieves; ++i) {
+    thieves.push_back(std::thread(Steal, &deque, &done, &taken));
+  }
+
+  for (uint32_t i = 0; i < kDequeItems; ++i) {
+    while (!deque.Push(&items[i])) {
+      uint32_t* item = deque.Pop();
+      if (item != NULL) {
+        taken[*item].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (i % 3 == 0) {
+      uint32_t* item = deque.Pop();
+      if (item != NULL) {
+        taken[*item].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (uint32_t i = 0; i < kThieves; ++i) {
+    thieves[i].join();
+  }
+
+  for (uint32_t i = 0; i < kDequeItems; ++i) {
+    assert(taken[i].load() == 1);
+  }
+  printf("deque: %u items taken once\n", kDequeItems);
+}
+
+struct MarkData {
+  std::atomic<uint32_t>* marks_;
+  uint32_t index_;
+};
+
+void Mark(JobSystem* system, void* data) {
+  const MarkData* mark = reinterpret_cast<const MarkData*>(data);
+  mark->marks_[mark->index_].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Worker 0 creates all jobs, so all other workers have to steal theirs.
+void TestFanOut(JobSystem& system) {
+  std::vector<std::atomic<uint32_t> > marks(kFanOutJobs);
+  for (uint32_t i = 0; i < kFanOutJobs; ++i) {
+    marks[i].store(0);
+  }
+
+  system.ResetStatistics();
+  JobCounter counter;
+  for (uint32_t i = 0; i < kFanOutJobs; ++i) {
+    MarkData data = { &marks[0], i };
+    system.Run(system.CreateJob(Mark, data, &counter));
+  }
+  system.Wait(&counter);
+
+  for (uint32_t i = 0; i < kFanOutJobs; ++i) {
+    assert(marks[i].load() == 1);
+  }
+  const JobStatistics statistics = system.statistics();
+  assert(statistics.executed_ == kFanOutJobs);
+  printf("fan-out: %u jobs, %lu stolen, %lu overflowed\n", kFanOutJobs,
+         static_cast<unsigned long>(statistics.stolen_),
+         static_cast<unsigned long>(statistics.overflows_));
+
+  // All jobs came from worker 0's arena.
+  assert(system.arena(0).bytes_allocated() >= kFanOutJobs * sizeof(Job));
+  system.Reset();
+  assert(system.arena(0).bytes_allocated() == 0);
+}
+
+struct SumData {
+  uint32_t depth_;
+  std::atomic<uint64_t>* leaves_;
+};
+
+// Splits into two children until depth reaches zero and waits for them, so
+// every level forks and joins on a different worker.
+void Sum(JobSystem* system, void* data) {
+  const SumData* sum = reinterpret_cast<const SumData*>(data);
+  if (sum->depth_ == 0) {
+    sum->leaves_->fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  JobCounter counter;
+  SumData child = { sum->depth_ - 1, sum->leaves_ };
+  system->Run(system->CreateJob(Sum, child, &counter));
+  system->Run(system->CreateJob(Sum, child, &counter));
+  system->Wait(&counter);
+}
+
+void TestNested(JobSystem& system) {
+  const uint32_t kDepth = 12;
+  std::atomic<uint64_t> leaves(0);
+  JobCounter counter;
+  SumData root = { kDepth, &leaves };
+  system.Run(system.CreateJob(Sum, root, &counter));
+  system.Wait(&counter);
+  assert(leaves.load() == (1u << kDepth));
+  assert(counter.value() == 0);
+  system.Reset();
+  printf("nested: %lu leaves\n", static_cast<unsigned long>(leaves.load()));
+}
+
+struct StageData {
+  std::atomic<uint32_t>* finished_;
+  uint32_t stage_;
+  uint32_t jobs_per_stage_;
+  std::atomic<uint32_t>* errors_;
+};
+
+// Checks that every job of the previous stage finished first.
+void RunStage(JobSystem* system, void* data) {
+  const StageData* stage = reinterpret_cast<const StageData*>(data);
+  if (stage->stage_ > 0 &&
+      stage->finished_[stage->stage_ - 1].load() != stage->jobs_per_stage_) {
+    stage->errors_->fetch_add(1);
+  }
+  stage->finished_[stage->stage_].fetch_add(1);
+}
+
+// Chains stages of jobs with RunAfter(); all of them are queued up front.
+void TestDependencies(JobSystem& system) {
+  const uint32_t kStages = 16;
+  const uint32_t kJobsPerStage = 64;
+  std::atomic<uint32_t> finished[kStages];
+  std::atomic<uint32_t> errors(0);
+  JobCounter counters[kStages];
+  for (uint32_t i = 0; i < kStages; ++i) {
+    finished[i].store(0);
+  }
+
+  for (uint32_t stage = 0; stage < kStages; ++stage) {
+    for (uint32_t i = 0; i < kJobsPerStage; ++i) {
+      StageData data = { finished, stage, kJobsPerStage, &errors };
+      Job* job = system.CreateJob(RunStage, data, &counters[stage]);
+      if (stage == 0) {
+        system.Run(job);
+      } else {
+        system.RunAfter(&counters[stage - 1], job);
+      }
+    }
+  }
+  system.Wait(&counters[kStages - 1]);
+
+  for (uint32_t i = 0; i < kStages; ++i) {
+    assert(finished[i].load() == kJobsPerStage);
+    assert(counters[i].value() == 0);
+  }
+  assert(errors.load() == 0);
+  system.Reset();
+  printf("dependencies: %u stages in order\n", kStages);
+}
+
+// A tiny deque makes Run() execute most jobs right away.
+void TestOverflow() {
+  JobSystem system(2, 4096, 16);
+  std::vector<std::atomic<uint32_t> > marks(1000);
+  for (uint32_t i = 0; i < marks.size(); ++i) {
+    marks[i].store(0);
+  }
+
+  JobCounter counter;
+  for (uint32_t i = 0; i < marks.size(); ++i) {
+    MarkData data = { &marks[0], i };
+    system.Run(system.CreateJob(Mark, data, &counter));
+  }
+  system.Wait(&counter);
+
+  for (uint32_t i = 0; i < marks.size(); ++i) {
+    assert(marks[i].load() == 1);
+  }
+  assert(system.statistics().overflows_ > 0);
+
+  // The 4 KB arena overflowed into heap blocks, which are kept for reuse.
+  assert(system.arena(0).block_count() > 0);
+  system.Reset();
+  assert(system.arena(0).block_count() == 0);
+  assert(system.arena(0).spare_block_count() > 0);
+}
+
+// Marks the thread index of the worker running the job.
+void MarkThreadIndex(JobSystem* system, void* data) {
+  std::atomic<uint32_t>* marks =
+      *reinterpret_cast<std::atomic<uint32_t>**>(data);
+  marks[CurrentThreadIndex()].fetch_add(1, std::memory_order_relaxed);
+}
+
+// More workers than thread indices are capped, so every worker can still
+// take an index.
+void TestWorkerLimit() {
+  JobSystem system(kMaxThreads + 16, 4096, 16);
+  assert(system.worker_count() == kMaxThreads);
+
+  std::vector<std::atomic<uint32_t> > marks(kMaxThreads);
+  for (uint32_t i = 0; i < kMaxThreads; ++i) {
+    marks[i].store(0);
+  }
+  JobCounter counter;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    system.Run(system.CreateJob(MarkThreadIndex, &marks[0], &counter));
+  }
+  system.Wait(&counter);
+
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < kMaxThreads; ++i) {
+    total += marks[i].load();
+  }
+  assert(total == 1000);
+  (void)total;
+}
+
+struct PinData {
+  std::atomic<uint32_t>* moved_;
+  uint32_t depth_;
+};
+
+// Waits at every level; a fiber has to resume on the thread it was
+// suspended on.
+void Pin(JobSystem* system, void* data) {
+  const PinData* pin = reinterpret_cast<const PinData*>(data);
+  if (pin->depth_ == 0) {
+    return;
+  }
+
+  const std::thread::id thread = std::this_thread::get_id();
+  const uint32_t worker = system->current_worker();
+  JobCounter counter;
+  PinData child = { pin->moved_, pin->depth_ - 1 };
+  for (uint32_t i = 0; i < 4; ++i) {
+    system->Run(system->CreateJob(Pin, child, &counter));
+  }
+  system->Wait(&counter);
+  if (std::this_thread::get_id() != thread ||
+      system->current_worker() != worker) {
+    pin->moved_->fetch_add(1);
+  }
+}
+
+void TestFibers(const uint32_t workers) {
+  JobSystem system(workers, 256 * 1024, 4096, 32);
+  assert(system.fiber_mode());
+  assert(system.free_fiber_count() == 32);
+
+  std::atomic<uint32_t> moved(0);
+  JobCounter counter;
+  PinData root = { &moved, 6 };
+  system.Run(system.CreateJob(Pin, root, &counter));
+  system.Wait(&counter);
+  assert(moved.load() == 0);
+
+  // 1365 jobs waited, on 32 fibers, and every fiber went back to the pool.
+  const JobStatistics statistics = system.statistics();
+  assert(statistics.suspends_ > 0);
+  assert(system.free_fiber_count() == 32);
+  system.Reset();
+  printf("fibers: %lu suspends\n",
+         static_cast<unsigned long>(statistics.suspends_));
+}
+
+}  // namespace
+
+int main() {
+  TestDeque();
+  TestDequeStealing();
+  TestOverflow();
+  TestWorkerLimit();
+
+  for (uint32_t workers = 1; workers <= kStressWorkers; workers *= 2) {
+    // Without fibers, and with enough fibers for most waits.
+    for (uint32_t fibers = 0; fibers <= 256; fibers += 256) {
+      JobSystem system(workers, 256 * 1024, 4096, fibers);
+      assert(system.worker_count() == workers);
+      assert(system.current_worker() == 0);
+      printf("%u workers, %u fibers\n", workers, fibers);
+      for (uint32_t round = 0; round < 4; ++round) {
+        TestFanOut(system);
+        TestNested(system);
+        TestDependencies(system);
+      }
+      assert(system.free_fiber_count() == fibers);
+    }
+    TestFibers(workers);
+  }
+
+  JobSystem system;
+  assert(system.worker_count() >= 1);
+  TestFanOut(system);
+  return 0;
+}
@@ -25,13 +25,109 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <mxcore/aligned_memory.h>
+#include <mxcore/alignment.h>
 #include <mxcore/linear_allocator.h>
+#include <mxcore/scope_stack.h>
 
 using namespace mx::core;
 
+namespace {
+
+// Counts the blocks handed out to a growing allocator.
+class CountingBlockAllocator : public HeapBlockAllocator {
+ public:
+  CountingBlockAllocator() : allocated_(0), freed_(0) {}
+
+  void* AllocateBlock(const size_t size) {
+    ++allocated_;
+    return HeapBlockAllocator::AllocateBlock(size);
+  }
+
+  void FreeBlock(void* block, const size_t size) {
+    ++freed_;
+    HeapBlockAllocator::FreeBlock(block, size);
+  }
+
+  uint32_t allocated_;
+  uint32_t freed_;
+};
+
+void TestGrowing() {
+  CountingBlockAllocator blocks;
+
+  {
+    AlignedMemory<8> initial(256);
+    LinearAllocator allocator(initial.pointer(), initial.size(), &blocks, 1024);
+    void* start = allocator.marker();
+
+    // Fill the initial block and spill over into chained ones.
+    for (uint32_t i = 0; i < 20; ++i) {
+      memset(allocator.Allocate(100), i, 100);
+    }
+    assert(allocator.block_count() == 2);
+    assert(blocks.allocated_ == 2);
+
+    {
+      ScopeStack scope(allocator);
+      void* marker = allocator.marker();
+      for (uint32_t i = 0; i < 30; ++i) {
+        void* data = scope.NewRaw(64, 32);
+        assert(data != NULL && IsAligned(data, 32));
+        (void)data;
+      }
+
+      // Larger than a block, gets a block of its own.
+      void* large = scope.NewRaw(4000);
+      assert(large != NULL);
+      assert(allocator.marker() != marker);
+      (void)large;
+      (void)marker;
+    }
+    assert(allocator.block_count() == 2);
+    assert(allocator.spare_block_count() > 0);
+
+    size_t peak = allocator.high_water_mark();
+    assert(peak >= 20 * 100 + 30 * 64 + 4000);
+    printf("high water mark: %lu in %u blocks\n",
+           static_cast<unsigned long>(peak), blocks.allocated_);
+
+    // Rewinding to the start and allocating again reuses the spare blocks.
+    uint32_t allocated = blocks.allocated_;
+    allocator.Rewind(start);
+    assert(allocator.block_count() == 0 && allocator.bytes_allocated() == 0);
+    for (uint32_t i = 0; i < 20; ++i) {
+      allocator.Allocate(100);
+    }
+    assert(blocks.allocated_ == allocated);
+    assert(allocator.high_water_mark() == peak);
+    (void)allocated;
+
+    allocator.ResetHighWaterMark();
+    assert(allocator.high_water_mark() == allocator.bytes_allocated());
+  }
+
+  assert(blocks.allocated_ == blocks.freed_);
+
+  // Growing allocators don't need an initial block.
+  {
+    LinearAllocator allocator(NULL, 0, &blocks, 512);
+    void* start = allocator.marker();
+    void* data = allocator.Allocate(16, 16);
+    assert(data != NULL);
+    (void)data;
+    allocator.Rewind(start);
+    assert(allocator.bytes_allocated() == 0);
+  }
+
+  assert(blocks.allocated_ == blocks.freed_);
+}
+
+}  // namespace
+
 int main() {
   AlignedMemory<8> small_chunk(4);
   LinearAllocator small_allocator(small_chunk.pointer(), small_chunk.size());
@@ -55,5 +151,19 @@ int main() {
 
   big_allocator.Rewind(reinterpret_cast<uint8_t*>(marker_before));
 
+  // Aligned allocations following an odd-sized one.
+  big_allocator.Allocate(3);
+  void* aligned = big_allocator.Allocate(64, 16);
+  assert(IsAligned(aligned, 16));
+  assert(big_allocator.marker() == reinterpret_cast<uint8_t*>(aligned) + 64);
+
+  big_allocator.Allocate(1);
+  uint8_t* with_header = reinterpret_cast<uint8_t*>(
+      big_allocator.Allocate(8 + 32, 32, 8));
+  assert(IsAligned(with_header + 8, 32));
+  printf("aligned = %p, with_header = %p\n", aligned, with_header);
+
+  TestGrowing();
+
   return 0;
 }
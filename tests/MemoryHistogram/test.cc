@@ -0,0 +1,110 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <mxcore/memory_tracker.h>
+
+using namespace mx::core;
+
+int main() {
+  assert(MemoryTracker::GetSizeClass(0) == 0);
+  assert(MemoryTracker::GetSizeClass(1) == 0);
+  assert(MemoryTracker::GetSizeClass(2) == 1);
+  assert(MemoryTracker::GetSizeClass(3) == 2);
+  assert(MemoryTracker::GetSizeClass(64) == 6);
+  assert(MemoryTracker::GetSizeClass(65) == 7);
+  assert(MemoryTracker::GetSizeClass(~static_cast<size_t>(0)) ==
+         kSizeClassCount - 1);
+
+  assert(MemoryTracker::GetLifetimeBucket(0) == 0);
+  assert(MemoryTracker::GetLifetimeBucket(1) == 1);
+  assert(MemoryTracker::GetLifetimeBucket(2) == 2);
+  assert(MemoryTracker::GetLifetimeBucket(3) == 2);
+  assert(MemoryTracker::GetLifetimeBucket(4) == 3);
+  assert(MemoryTracker::GetLifetimeBucket(0xffffffff) ==
+         kLifetimeBucketCount - 1);
+
+  MemoryHistogram before;
+  MemoryTracker::GetHistogram(&before);
+
+  // Short lived allocations are freed within the frame, long lived ones
+  // survive ten frames.
+  std::vector<void*> long_lived;
+  for (uint32_t i = 0; i < 100; ++i) {
+    long_lived.push_back(mxalloc(100));
+  }
+  for (uint32_t frame = 0; frame < 10; ++frame) {
+    for (uint32_t i = 0; i < 50; ++i) {
+      void* pointer = mxalloc(16);
+      mxfree(pointer);
+    }
+    MemoryTracker::NextFrame();
+  }
+
+  MemoryHistogram during;
+  MemoryTracker::GetHistogram(&during);
+
+  for (uint32_t i = 0; i < long_lived.size(); ++i) {
+    mxfree(long_lived[i]);
+  }
+
+  MemoryHistogram after;
+  MemoryTracker::GetHistogram(&after);
+
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  const SizeClassStatistics& small_before = before.size_classes_[4];
+  const SizeClassStatistics& small_after = after.size_classes_[4];
+  assert(small_after.total_count_ - small_before.total_count_ == 500);
+  assert(small_after.total_bytes_ - small_before.total_bytes_ == 8000);
+  assert(small_after.live_count_ == small_before.live_count_);
+  assert(small_after.lifetimes_[0] - small_before.lifetimes_[0] == 500);
+  (void)small_before;
+  (void)small_after;
+
+  const SizeClassStatistics& large_before = before.size_classes_[7];
+  const SizeClassStatistics& large_during = during.size_classes_[7];
+  const SizeClassStatistics& large_after = after.size_classes_[7];
+  assert(large_during.live_count_ - large_before.live_count_ == 100);
+  assert(large_during.live_bytes_ - large_before.live_bytes_ == 10000);
+  assert(large_after.live_count_ == large_before.live_count_);
+  assert(large_after.total_count_ - large_before.total_count_ == 100);
+  const uint32_t bucket = MemoryTracker::GetLifetimeBucket(10);
+  assert(large_after.lifetimes_[bucket] - large_before.lifetimes_[bucket] ==
+         100);
+  assert(large_after.lifetimes_[0] == large_before.lifetimes_[0]);
+  (void)large_before;
+  (void)large_during;
+  (void)large_after;
+  (void)bucket;
+#endif
+
+  MemoryTracker::ReportHistogram();
+  MemoryTracker::Report();
+  return 0;
+}
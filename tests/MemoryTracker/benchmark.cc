@@ -0,0 +1,88 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <mxcore/memory_tracker.h>
+#include <mxcore/timer.h>
+
+namespace {
+
+const uint32_t kLiveAllocations = 10000;
+const uint32_t kOperations = 2000000;
+
+// Replaces pseudo-random allocations of a working set, which is the pattern
+// that made tracked builds slow.
+void Churn(double* rate) {
+  std::vector<void*> live(kLiveAllocations);
+  for (uint32_t i = 0; i < kLiveAllocations; ++i) {
+    live[i] = mxalloc(32);
+  }
+
+  uint32_t seed = 1;
+  mx::core::Timer timer;
+  for (uint32_t i = 0; i < kOperations; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    uint32_t index = (seed >> 8) % kLiveAllocations;
+    mxfree(live[index]);
+    live[index] = mxalloc(16 + (seed & 63));
+  }
+  *rate = 2.0 * kOperations / timer.elapsed_seconds();
+
+  for (uint32_t i = 0; i < kLiveAllocations; ++i) {
+    mxfree(live[i]);
+  }
+}
+
+}  // namespace
+
+int main() {
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  printf("memory tracking enabled\n");
+#else
+  printf("memory tracking disabled\n");
+#endif
+  printf("%8s %16s\n", "threads", "operations/s");
+
+  for (uint32_t thread_count = 1; thread_count <= 8; thread_count *= 2) {
+    std::vector<std::thread> threads;
+    std::vector<double> rates(thread_count);
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      threads.push_back(std::thread(Churn, &rates[i]));
+    }
+
+    double total = 0.0;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      threads[i].join();
+      total += rates[i];
+    }
+    printf("%8u %16.0f\n", thread_count, total);
+  }
+
+  return 0;
+}
@@ -25,12 +25,111 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <assert.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
 #include <mxcore/memory_tracker.h>
 
 class Foo {
   int f_;
 };
 
+// Allocates and frees from several threads at once, keeping every tenth
+// allocation alive until the end.
+void AllocateAndFree(std::vector<void*>* kept, size_t* bytes) {
+  *bytes = 0;
+  for (uint32_t i = 0; i < 50000; ++i) {
+    size_t size = 8 + i % 100;
+    void* pointer = mxalloc(size);
+    if (i % 10 == 0) {
+      kept->push_back(pointer);
+      *bytes += size;
+    } else {
+      mxfree(pointer);
+    }
+  }
+}
+
+// More live allocations than the static tables hold spill into tables from
+// the heap, which still track every one of them exactly.
+void TestSpill() {
+  const uint32_t kCount = 100000;
+  std::vector<void*> pointers;
+  size_t before = mx::core::MemoryTracker::allocation_count();
+  size_t bytes = mx::core::MemoryTracker::bytes_allocated();
+
+  for (uint32_t i = 0; i < kCount; ++i) {
+    pointers.push_back(mxalloc(16));
+  }
+
+  size_t added = mx::core::MemoryTracker::allocation_count() - before;
+  size_t added_bytes = mx::core::MemoryTracker::bytes_allocated() - bytes;
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  assert(added == kCount && added_bytes == kCount * 16);
+#endif
+
+  // Unknown pointers are still reported, however full the tables are.
+  int unknown = 0;
+  bool removed = mx::core::MemoryTracker::Remove(&unknown);
+  assert(!removed);
+  printf("spill: %lu allocations, %lu bytes, unknown pointer removed: %d\n",
+         static_cast<unsigned long>(added),
+         static_cast<unsigned long>(added_bytes), removed);
+
+  for (uint32_t i = 0; i < kCount / 2; ++i) {
+    mxfree(pointers[i]);
+  }
+
+  // Merging the spill tables keeps the remaining allocations.
+  mx::core::MemoryTracker::Reserve(kCount);
+  assert(mx::core::MemoryTracker::allocation_count() ==
+         before + kCount - kCount / 2);
+
+  for (uint32_t i = kCount / 2; i < kCount; ++i) {
+    mxfree(pointers[i]);
+  }
+
+  assert(mx::core::MemoryTracker::allocation_count() == before);
+  assert(mx::core::MemoryTracker::bytes_allocated() == bytes);
+}
+
+void TestThreads() {
+  const uint32_t kThreadCount = 8;
+  std::vector<void*> kept[kThreadCount];
+  size_t bytes[kThreadCount];
+  std::vector<std::thread> threads;
+  size_t before = mx::core::MemoryTracker::bytes_allocated();
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.push_back(std::thread(AllocateAndFree, &kept[i], &bytes[i]));
+  }
+
+  size_t total = 0;
+  size_t count = 0;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads[i].join();
+    total += bytes[i];
+    count += kept[i].size();
+  }
+
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  assert(mx::core::MemoryTracker::bytes_allocated() == before + total);
+  assert(mx::core::MemoryTracker::allocation_count() >= count);
+#endif
+  printf("threads: %lu bytes in %lu allocations\n",
+         static_cast<unsigned long>(total), static_cast<unsigned long>(count));
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    for (size_t j = 0; j < kept[i].size(); ++j) {
+      mxfree(kept[i][j]);
+    }
+  }
+
+  assert(mx::core::MemoryTracker::bytes_allocated() == before);
+  (void)before;
+}
+
 int main(void) {
   void* raw = mxalloc(4096);
   Foo* foo = mxnew(Foo, ());
@@ -46,5 +145,8 @@ int main(void) {
 
   mx::core::MemoryTracker::Report();
 
+  TestSpill();
+  TestThreads();
+
   return 0;
 }
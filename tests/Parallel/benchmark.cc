@@ -0,0 +1,187 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <mxcore/aligned_memory.h>
+#include <mxcore/linear_allocator.h>
+#include <mxcore/parallel.h>
+#include <mxcore/scope_stack.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+const size_t kMaxElements = 100000000;
+const uint32_t kRepetitions = 3;
+
+// Times the serial and the parallel version of an algorithm. Every
+// repetition is timed on its own, which keeps the compiler from merging the
+// repeated serial loops into one.
+template <typename Serial, typename Parallel>
+void Measure(const char* name, JobSystem* system, const size_t count,
+             const Serial& serial, const Parallel& parallel) {
+  double serial_seconds = 0.0;
+  double parallel_seconds = 0.0;
+  for (uint32_t repetition = 0; repetition < kRepetitions; ++repetition) {
+    Timer timer;
+    serial();
+    serial_seconds += timer.elapsed_seconds();
+
+    timer.Reset();
+    parallel();
+    parallel_seconds += timer.elapsed_seconds();
+    system->Reset();
+  }
+
+  printf("%10s %10lu %8u %12.3f %12.3f %8.2f\n", name,
+         static_cast<unsigned long>(count), system->worker_count(),
+         1000.0 * serial_seconds / kRepetitions,
+         1000.0 * parallel_seconds / kRepetitions,
+         serial_seconds / parallel_seconds);
+}
+
+}  // namespace
+
+int main() {
+  std::vector<float> input(kMaxElements);
+  std::vector<float> output(kMaxElements);
+  std::vector<uint32_t> integers(kMaxElements);
+  std::vector<uint32_t> scanned(kMaxElements);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < kMaxElements; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    input[i] = static_cast<float>(seed >> 8) / (1 << 24);
+    integers[i] = seed >> 24;
+  }
+
+  AlignedMemory<16> memory(1024 * 1024);
+  LinearAllocator scratch(memory.pointer(), memory.size());
+
+  const uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<uint32_t> worker_counts(1, 1);
+  if (hardware > 1) {
+    worker_counts.push_back(hardware);
+  }
+
+  const float* in = &input[0];
+  float* out = &output[0];
+  const uint32_t* values = &integers[0];
+  uint32_t* sums = &scanned[0];
+
+  printf("%10s %10s %8s %12s %12s %8s\n", "algorithm", "elements",
+         "workers", "serial ms", "parallel ms", "speedup");
+  for (size_t w = 0; w < worker_counts.size(); ++w) {
+    JobSystem system(worker_counts[w]);
+    for (size_t count = 1000000; count <= kMaxElements; count *= 10) {
+      // Scales and biases every element; bound by memory bandwidth.
+      auto transform = [=](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+          out[i] = 2.0f * in[i] + 1.0f;
+        }
+      };
+      Measure("transform", &system, count,
+              [&]() { transform(0, count); },
+              [&]() { ParallelFor(&system, 0, count, transform); });
+
+      // Normalizes the vector (x, 1, 2) of every element; bound by
+      // arithmetic.
+      auto normalize = [=](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+          out[i] = in[i] / sqrtf(in[i] * in[i] + 5.0f);
+        }
+      };
+      Measure("normalize", &system, count,
+              [&]() { normalize(0, count); },
+              [&]() { ParallelFor(&system, 0, count, normalize); });
+
+      auto sum = [=](size_t first, size_t last) {
+        double sum = 0.0;
+        for (size_t i = first; i < last; ++i) {
+          sum += in[i];
+        }
+        return sum;
+      };
+      auto add = [](double a, double b) { return a + b; };
+      double serial_sum = 0.0;
+      double parallel_sum = 0.0;
+      Measure("sum", &system, count,
+              [&]() { serial_sum = sum(0, count); },
+              [&]() {
+                parallel_sum = ParallelReduce(&system, 0, count, 0.0, sum,
+                                              add);
+              });
+      if (fabs(serial_sum - parallel_sum) > 1e-6 * fabs(serial_sum)) {
+        printf("sum mismatch: %f != %f\n", serial_sum, parallel_sum);
+      }
+
+      Measure("scan", &system, count,
+              [&]() {
+                uint32_t running = 0;
+                for (size_t i = 0; i < count; ++i) {
+                  running += values[i];
+                  sums[i] = running;
+                }
+              },
+              [&]() {
+                ScopeStack scope(scratch);
+                ParallelScan(&system, values, sums, count, 0u,
+                             [](uint32_t a, uint32_t b) { return a + b; },
+                             scope);
+              });
+
+      // Keeps the elements above a threshold, like culling against a plane.
+      size_t serial_kept = 0;
+      size_t parallel_kept = 0;
+      Measure("compact", &system, count,
+              [&]() {
+                serial_kept = 0;
+                for (size_t i = 0; i < count; ++i) {
+                  if (in[i] > 0.5f) {
+                    out[serial_kept++] = in[i];
+                  }
+                }
+              },
+              [&]() {
+                ScopeStack scope(scratch);
+                parallel_kept = ParallelCompact(
+                    &system, in, count, out,
+                    [](float value) { return value > 0.5f; }, scope);
+              });
+      if (serial_kept != parallel_kept) {
+        printf("compact mismatch: %lu != %lu\n",
+               static_cast<unsigned long>(serial_kept),
+               static_cast<unsigned long>(parallel_kept));
+      }
+    }
+  }
+  return 0;
+}
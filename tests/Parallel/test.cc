@@ -0,0 +1,218 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include <mxcore/aligned_memory.h>
+#include <mxcore/linear_allocator.h>
+#include <mxcore/parallel.h>
+#include <mxcore/scope_stack.h>
+
+using namespace mx::core;
+
+namespace {
+
+const size_t kCounts[] = { 0, 1, 1023, 1024, 1025, 100000, 1000000 };
+const size_t kGrains[] = { 0, 1, 7, 4096 };
+
+uint32_t Value(const size_t i) {
+  return static_cast<uint32_t>((i * 2654435761u) >> 7) & 0xffff;
+}
+
+void TestFor(JobSystem* system, const size_t count, const size_t grain) {
+  std::vector<std::atomic<uint32_t> > visits(count);
+  for (size_t i = 0; i < count; ++i) {
+    visits[i].store(0);
+  }
+
+  std::atomic<size_t> ranges(0);
+  ParallelFor(system, 0, count, [&](size_t first, size_t last) {
+    assert(first < last);
+    assert(grain == 0 || last - first <= grain);
+    for (size_t i = first; i < last; ++i) {
+      visits[i].fetch_add(1, std::memory_order_relaxed);
+    }
+    ranges.fetch_add(1, std::memory_order_relaxed);
+  }, grain);
+
+  for (size_t i = 0; i < count; ++i) {
+    assert(visits[i].load() == 1);
+  }
+  assert(count == 0 || ranges.load() > 0);
+}
+
+void TestReduce(JobSystem* system, const size_t count, const size_t grain) {
+  uint64_t expected = 0;
+  for (size_t i = 0; i < count; ++i) {
+    expected += Value(i);
+  }
+
+  const uint64_t sum = ParallelReduce(system, 0, count, uint64_t(0),
+      [](size_t first, size_t last) {
+        uint64_t sum = 0;
+        for (size_t i = first; i < last; ++i) {
+          sum += Value(i);
+        }
+        return sum;
+      },
+      [](uint64_t a, uint64_t b) { return a + b; }, grain);
+  assert(sum == expected);
+  (void)sum;
+
+  // Float sums depend on the combination order, which only depends on the
+  // grain size.
+  const size_t size = (grain > 0) ? grain : 64;
+  float sums[4];
+  for (uint32_t i = 0; i < 4; ++i) {
+    sums[i] = ParallelReduce(system, 0, count, 0.0f,
+        [](size_t first, size_t last) {
+          float sum = 0.0f;
+          for (size_t i = first; i < last; ++i) {
+            sum += 1.0f / (1 + Value(i));
+          }
+          return sum;
+        },
+        [](float a, float b) { return a + b; }, size);
+    assert(sums[i] == sums[0]);
+  }
+  (void)sums;
+}
+
+void TestScan(JobSystem* system, LinearAllocator& scratch, const size_t count,
+              const size_t grain) {
+  std::vector<uint32_t> input(count);
+  std::vector<uint32_t> output(count);
+  for (size_t i = 0; i < count; ++i) {
+    input[i] = Value(i);
+  }
+
+  void* marker = scratch.marker();
+  {
+    ScopeStack scope(scratch);
+    ParallelScan(system, input.data(), output.data(), count, 0u,
+                 [](uint32_t a, uint32_t b) { return a + b; }, scope, grain);
+  }
+  assert(scratch.marker() == marker);
+  (void)marker;
+
+  uint32_t running = 0;
+  for (size_t i = 0; i < count; ++i) {
+    running += input[i];
+    assert(output[i] == running);
+  }
+
+  // In place.
+  {
+    ScopeStack scope(scratch);
+    ParallelScan(system, input.data(), input.data(), count, 0u,
+                 [](uint32_t a, uint32_t b) { return a + b; }, scope, grain);
+  }
+  assert(input == output);
+}
+
+void TestCompact(JobSystem* system, LinearAllocator& scratch,
+                 const size_t count, const size_t grain) {
+  std::vector<uint32_t> input(count);
+  std::vector<uint32_t> output(count);
+  std::vector<uint32_t> expected;
+  for (size_t i = 0; i < count; ++i) {
+    input[i] = Value(i);
+    if (input[i] % 3 == 0) {
+      expected.push_back(input[i]);
+    }
+  }
+
+  size_t kept;
+  {
+    ScopeStack scope(scratch);
+    kept = ParallelCompact(system, input.data(), count, output.data(),
+                           [](uint32_t value) { return value % 3 == 0; },
+                           scope, grain);
+  }
+  assert(kept == expected.size());
+  for (size_t i = 0; i < kept; ++i) {
+    assert(output[i] == expected[i]);
+  }
+}
+
+struct NestedData {
+  std::atomic<uint64_t>* total_;
+};
+
+// Loops started from within a job share the workers with the outer loop.
+void RunNested(JobSystem* system, void* data) {
+  std::atomic<uint64_t>* total =
+      reinterpret_cast<NestedData*>(data)->total_;
+  ParallelFor(system, 0, 10000, [&](size_t first, size_t last) {
+    total->fetch_add(last - first, std::memory_order_relaxed);
+  }, 100);
+}
+
+void TestNested(JobSystem* system) {
+  std::atomic<uint64_t> total(0);
+  JobCounter counter;
+  NestedData data = { &total };
+  for (uint32_t i = 0; i < 16; ++i) {
+    system->Run(system->CreateJob(RunNested, data, &counter));
+  }
+  system->Wait(&counter);
+  assert(total.load() == 16 * 10000);
+}
+
+}  // namespace
+
+int main() {
+  AlignedMemory<16> memory(4 * 1024 * 1024);
+  LinearAllocator scratch(memory.pointer(), memory.size());
+
+  const uint32_t worker_counts[] = { 1, 2, 4 };
+  for (uint32_t w = 0; w < 3; ++w) {
+    JobSystem system(worker_counts[w]);
+    assert(SelectGrainSize(system, 100, 5) == 5);
+    assert(SelectGrainSize(system, 100, 0) == (w == 0 ? 100 : kMinGrainSize));
+
+    for (size_t c = 0; c < sizeof(kCounts) / sizeof(kCounts[0]); ++c) {
+      for (size_t g = 0; g < sizeof(kGrains) / sizeof(kGrains[0]); ++g) {
+        // Single elements per range only for the small arrays.
+        if (kGrains[g] == 1 && kCounts[c] > 100000) {
+          continue;
+        }
+        TestFor(&system, kCounts[c], kGrains[g]);
+        TestReduce(&system, kCounts[c], kGrains[g]);
+        TestScan(&system, scratch, kCounts[c], kGrains[g]);
+        TestCompact(&system, scratch, kCounts[c], kGrains[g]);
+        system.Reset();
+      }
+    }
+    TestNested(&system);
+    system.Reset();
+    printf("%u workers ok\n", worker_counts[w]);
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <mxcore/memory_tracker.h>
+#include <mxcore/pool_allocator.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kLiveObjects = 4096;
+const uint32_t kOperations = 4000000;
+
+struct Particle {
+  float position_[3];
+  float velocity_[3];
+  uint32_t flags_;
+};
+
+// Keeps a working set of live objects and replaces a pseudo-random one on
+// every iteration.
+template <class Policy>
+double Churn(Policy& policy, const uint32_t operations) {
+  Particle* live[kLiveObjects];
+  for (uint32_t i = 0; i < kLiveObjects; ++i) {
+    live[i] = policy.New();
+  }
+
+  uint32_t seed = 1;
+  Timer timer;
+  for (uint32_t i = 0; i < operations; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    uint32_t index = (seed >> 8) % kLiveObjects;
+    policy.Delete(live[index]);
+    live[index] = policy.New();
+  }
+  double seconds = timer.elapsed_seconds();
+
+  for (uint32_t i = 0; i < kLiveObjects; ++i) {
+    policy.Delete(live[i]);
+  }
+
+  // Every iteration is one allocation and one free.
+  return 2.0 * operations / seconds;
+}
+
+struct HeapPolicy {
+  Particle* New() { return mxnew(Particle, ()); }
+  void Delete(Particle* particle) { mxdelete(particle); }
+};
+
+struct PoolPolicy {
+  explicit PoolPolicy(PoolAllocator<Particle>& pool) : pool_(pool) {}
+  Particle* New() { return mxpoolnew(pool_, Particle, ()); }
+  void Delete(Particle* particle) { mxpooldelete(pool_, particle); }
+
+  PoolAllocator<Particle>& pool_;
+};
+
+template <class Policy>
+void ChurnThread(Policy* policy, double* rate) {
+  *rate = Churn(*policy, kOperations / 4);
+}
+
+template <class Policy>
+double ChurnThreads(Policy* policies, const uint32_t thread_count) {
+  std::vector<std::thread> threads;
+  std::vector<double> rates(thread_count);
+
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.push_back(std::thread(ChurnThread<Policy>, &policies[i],
+                                  &rates[i]));
+  }
+
+  double total = 0.0;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads[i].join();
+    total += rates[i];
+  }
+  return total;
+}
+
+}  // namespace
+
+int main() {
+  HeapPolicy heap;
+  PoolAllocator<Particle> pool(1024);
+  PoolPolicy pooled(pool);
+
+  printf("%-24s %16s\n", "single thread", "operations/s");
+  printf("%-24s %16.0f\n", "mxnew/mxdelete", Churn(heap, kOperations));
+  printf("%-24s %16.0f\n", "PoolAllocator", Churn(pooled, kOperations));
+
+  const uint32_t kThreadCount = 4;
+  HeapPolicy heaps[kThreadCount];
+  PoolAllocator<Particle> shared_pool(1024, true);
+  std::vector<PoolPolicy> shared(kThreadCount, PoolPolicy(shared_pool));
+
+  printf("%-24s %16s\n", "4 threads", "operations/s");
+  printf("%-24s %16.0f\n", "mxnew/mxdelete", ChurnThreads(heaps, kThreadCount));
+  printf("%-24s %16.0f\n", "PoolAllocator (cached)",
+         ChurnThreads(&shared[0], kThreadCount));
+
+  return 0;
+}
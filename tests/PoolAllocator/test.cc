@@ -0,0 +1,169 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <set>
+#include <thread>
+#include <vector>
+#include <mxcore/alignment.h>
+#include <mxcore/memory_tracker.h>
+#include <mxcore/pool_allocator.h>
+
+using namespace mx::core;
+
+namespace {
+
+class Entity {
+ public:
+  Entity(uint32_t id) : id_(id) { ++alive_; }
+  ~Entity() { --alive_; }
+
+  uint32_t id_;
+  float position_[3];
+
+  static int32_t alive_;
+};
+
+int32_t Entity::alive_ = 0;
+
+struct alignas(kCacheLineSize) Counter {
+  uint64_t value_;
+};
+
+void TestFreeList() {
+  FixedBlockPool pool(24, 8, 16);
+  assert(pool.block_size() == 24);
+
+  std::set<void*> blocks;
+  for (uint32_t i = 0; i < 40; ++i) {
+    void* block = pool.Allocate();
+    assert(IsAligned(block, 8));
+    const bool inserted = blocks.insert(block).second;
+    assert(inserted);
+    (void)inserted;
+    (void)block;
+  }
+  assert(pool.page_count() == 3);
+
+  // Freed blocks are handed out again before a new page is allocated.
+  void* block = *blocks.begin();
+  pool.Free(block);
+  void* reused = pool.Allocate();
+  assert(reused == block);
+  (void)reused;
+  for (uint32_t i = 0; i < 8; ++i) {
+    pool.Allocate();
+  }
+  assert(pool.page_count() == 3);
+}
+
+void TestTypedPool() {
+  PoolAllocator<Entity> entities(64);
+  std::vector<Entity*> live;
+
+  for (uint32_t i = 0; i < 100; ++i) {
+    live.push_back(mxpoolnew(entities, Entity, (i)));
+  }
+  assert(Entity::alive_ == 100);
+  assert(live[42]->id_ == 42);
+
+#ifdef MX_MEMORY_TRACKING_ENABLED
+  assert(MemoryTracker::bytes_allocated() >= 100 * sizeof(Entity));
+#endif
+
+  for (uint32_t i = 0; i < live.size(); ++i) {
+    mxpooldelete(entities, live[i]);
+  }
+  assert(Entity::alive_ == 0);
+
+  PoolAllocator<Counter> counters(8, false, kCacheLineSize);
+  Counter* counter = mxpoolnew(counters, Counter, ());
+  assert(IsAligned(counter, kCacheLineSize));
+  assert(counters.pool().block_size() == kCacheLineSize);
+  mxpooldelete(counters, counter);
+}
+
+// Every thread allocates and frees in a loop and occasionally hands blocks
+// over to the next thread, so blocks migrate between thread caches.
+void Churn(FixedBlockPool* pool, std::vector<void*>* handover, uint32_t seed) {
+  std::vector<uint32_t*> live;
+
+  for (uint32_t i = 0; i < 20000; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    if (live.empty() || (seed >> 16) % 3 != 0) {
+      uint32_t* block = reinterpret_cast<uint32_t*>(pool->Allocate());
+      *block = i;
+      live.push_back(block);
+    } else {
+      uint32_t* block = live.back();
+      live.pop_back();
+      pool->Free(block);
+    }
+  }
+
+  handover->assign(live.begin(), live.end());
+}
+
+void TestThreadCaches() {
+  const uint32_t kThreadCount = 8;
+  FixedBlockPool pool(16, 16, 128, true);
+  std::vector<void*> handover[kThreadCount];
+  std::vector<std::thread> threads;
+
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.push_back(std::thread(Churn, &pool, &handover[i], i));
+  }
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads[i].join();
+  }
+
+  // No block may have been handed out twice.
+  std::set<void*> blocks;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    for (uint32_t j = 0; j < handover[i].size(); ++j) {
+      const bool inserted = blocks.insert(handover[i][j]).second;
+      assert(inserted);
+      (void)inserted;
+      pool.Free(handover[i][j]);
+    }
+  }
+
+  printf("%lu live blocks in %u pages\n",
+         static_cast<unsigned long>(blocks.size()), pool.page_count());
+}
+
+}  // namespace
+
+int main() {
+  TestFreeList();
+  TestTypedPool();
+  TestThreadCaches();
+
+  MemoryTracker::Report();
+  return 0;
+}
@@ -0,0 +1,480 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <mxcore/radix_sort.h>
+#include <mxcore/timer.h>
+#include <shade/shading_system_null.h>
+#include <shade/shading_system_recording.h>
+
+using namespace mx::core;
+using namespace mx::shade;
+
+namespace {
+
+const uint32_t kShaders = 32;
+const uint32_t kStates = 256;
+const uint32_t kBuffers = 1024;
+const uint32_t kFrames = 8;
+const uint32_t kMaxSubmitThreads = 4;
+
+// Counts the state changes and geometry binds needed to draw the blocks in
+// submission order.
+uint64_t CountUnsortedChanges(const RenderBlock* scene, const uint32_t count) {
+  uint64_t changes = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (i == 0 || scene[i].state_ != scene[i - 1].state_) {
+      ++changes;
+    }
+    if (i == 0 || scene[i].vertex_buffer_ != scene[i - 1].vertex_buffer_) {
+      ++changes;
+    }
+  }
+  return changes;
+}
+
+// Splits the time spent in EndFrame() into sorting and dispatching.
+class TimedShadingSystem : public ShadingSystemNull {
+ public:
+  TimedShadingSystem()
+      : ShadingSystemNull(kMaxSubmitThreads, 1024 * 1024),
+        sort_(0.0),
+        dispatch_(0.0) {}
+
+  void EndFrame() {
+    timer_.Reset();
+    ShadingSystemNull::EndFrame();
+  }
+
+  double sort_;
+  double dispatch_;
+
+ protected:
+  void BeginDispatch() {
+    sort_ += timer_.elapsed_seconds();
+    timer_.Reset();
+    ShadingSystemNull::BeginDispatch();
+  }
+
+  void Present() {
+    dispatch_ += timer_.elapsed_seconds();
+    ShadingSystemNull::Present();
+  }
+
+ private:
+  Timer timer_;
+};
+
+// Counts the calls a device would receive, like ShadingSystemNull. The hooks
+// are virtual, so the baseline below pays for the same indirect calls.
+class NullBackend {
+ public:
+  NullBackend() {
+    memset(&statistics_, 0, sizeof(statistics_));
+  }
+  virtual ~NullBackend() {}
+
+  virtual void BindShader(const uint32_t shader) {
+    ++statistics_.shader_binds_;
+  }
+  virtual void ApplyState(const RenderState& state) {
+    ++statistics_.state_changes_;
+  }
+  virtual void BindGeometry(const RenderBlock& render_block) {
+    ++statistics_.geometry_binds_;
+  }
+  virtual void Draw(const RenderBlock& render_block,
+                    const DrawConstants* instances,
+                    const uint32_t instance_count) {
+    ++statistics_.draws_;
+    statistics_.instances_ += instance_count;
+  }
+
+  DispatchStatistics statistics_;
+};
+
+bool SameGeometry(const RenderBlock& a, const RenderBlock& b) {
+  return a.vertex_buffer_ == b.vertex_buffer_ &&
+      a.normal_buffer_ == b.normal_buffer_ &&
+      a.index_buffer_ == b.index_buffer_;
+}
+
+bool BuffersExist(const ShadingSystem& shading_system,
+                  const RenderBlock& block) {
+  return (block.vertex_buffer_ == kNullBuffer ||
+          shading_system.GetVertexBuffer(block.vertex_buffer_) != NULL) &&
+      (block.normal_buffer_ == kNullBuffer ||
+       shading_system.GetVertexBuffer(block.normal_buffer_) != NULL) &&
+      (block.index_buffer_ == kNullBuffer ||
+       shading_system.GetIndexBuffer(block.index_buffer_) != NULL);
+}
+
+// The queue layout used before blocks were stored as a structure of arrays:
+// a vector of blocks with a copy of their constants, sorted through items
+// pointing at them. Dispatching follows the pointers and does the same work
+// as ShadingSystem: it skips blocks with destroyed buffers, batches blocks,
+// packs their constants, tracks what is bound and calls the backend. Used as
+// a baseline.
+class BlockVectorQueue {
+ public:
+  struct Item {
+    uint64_t key_;
+    const RenderBlock* block_;
+    uint32_t sequence_;
+  };
+
+  // The vectors never grow, so the pointers into them stay valid.
+  explicit BlockVectorQueue(const uint32_t capacity)
+      : bound_state_(kDefaultState),
+        bound_shader_(0),
+        device_state_valid_(false) {
+    blocks_.reserve(capacity);
+    constants_.reserve(capacity);
+  }
+
+  void Clear() {
+    blocks_.clear();
+    constants_.clear();
+    items_.clear();
+  }
+
+  void Render(const RenderBlock& block, const uint64_t key,
+              const uint32_t sequence) {
+    constants_.push_back(*block.constants_);
+    blocks_.push_back(block);
+    blocks_.back().constants_ = &constants_.back();
+    Item item = { key, &blocks_.back(), sequence };
+    items_.push_back(item);
+  }
+
+  void Sort() {
+    scratch_.resize(items_.size());
+    RadixSort(&items_[0], &scratch_[0], items_.size(), GetKey,
+              &histograms_);
+  }
+
+  // Buffers and states are looked up in shading_system.
+  FrameStatistics Dispatch(const ShadingSystem& shading_system,
+                           NullBackend* backend) {
+    FrameStatistics statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    const uint32_t max_instances = shading_system.max_instances();
+    const size_t count = items_.size();
+    instance_data_.resize(count);
+    const RenderBlock* previous = NULL;
+    size_t first = 0;
+    while (first < count) {
+      const RenderBlock& block = *items_[first].block_;
+      if ((previous == NULL || !SameGeometry(block, *previous)) &&
+          !BuffersExist(shading_system, block)) {
+        instance_data_[first] = *block.constants_;
+        ++statistics.stale_blocks_;
+        ++first;
+        continue;
+      }
+
+      size_t last = first;
+      for (; last < count && last - first < max_instances; ++last) {
+        const RenderBlock& other = *items_[last].block_;
+        if (other.state_ != block.state_ || other.layer_ != block.layer_ ||
+            !SameGeometry(other, block)) {
+          break;
+        }
+        instance_data_[last] = *other.constants_;
+      }
+      const uint32_t instance_count = static_cast<uint32_t>(last - first);
+
+      if (!device_state_valid_ || block.state_ != bound_state_) {
+        const RenderState& state = shading_system.state_cache().Get(
+            block.state_);
+        if (!device_state_valid_ || state.shader_ != bound_shader_) {
+          backend->BindShader(state.shader_);
+          bound_shader_ = state.shader_;
+          ++statistics.shader_binds_;
+        }
+        backend->ApplyState(state);
+        bound_state_ = block.state_;
+        device_state_valid_ = true;
+        ++statistics.state_binds_;
+      } else {
+        ++statistics.state_binds_skipped_;
+      }
+      statistics.state_binds_skipped_ += instance_count - 1;
+
+      if (previous == NULL || !SameGeometry(block, *previous)) {
+        backend->BindGeometry(block);
+        ++statistics.geometry_binds_;
+      } else {
+        ++statistics.geometry_binds_skipped_;
+      }
+      statistics.geometry_binds_skipped_ += instance_count - 1;
+
+      backend->Draw(block, &instance_data_[first], instance_count);
+      ++statistics.draws_;
+      statistics.blocks_ += instance_count;
+      previous = &block;
+      first = last;
+    }
+    return statistics;
+  }
+
+ private:
+  static uint64_t GetKey(const Item& item) { return item.key_; }
+
+  std::vector<RenderBlock> blocks_;
+  std::vector<DrawConstants> constants_;
+  std::vector<Item> items_;
+  std::vector<Item> scratch_;
+  RadixSortHistograms histograms_;
+  std::vector<DrawConstants> instance_data_;
+  StateHandle bound_state_;
+  uint32_t bound_shader_;
+  bool device_state_valid_;
+};
+
+void Submit(ShadingSystem* shading_system, const RenderBlock* scene,
+            const uint32_t begin, const uint32_t end) {
+  for (uint32_t i = begin; i < end; ++i) {
+    shading_system->Render(scene[i], i);
+  }
+}
+
+void SubmitThreaded(ShadingSystem* shading_system, const RenderBlock* scene,
+                    const uint32_t count, const uint32_t thread_count) {
+  if (thread_count == 1) {
+    Submit(shading_system, scene, 0, count);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.push_back(std::thread(Submit, shading_system, scene,
+                                  count * i / thread_count,
+                                  count * (i + 1) / thread_count));
+  }
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads[i].join();
+  }
+}
+
+// Interns the benchmark's states. Every shading system gets the same handles.
+void InternStates(ShadingSystem* shading_system,
+                  std::vector<StateHandle>* handles) {
+  handles->clear();
+  for (uint32_t i = 0; i < kStates; ++i) {
+    RenderState state;
+    memset(&state, 0, sizeof(state));
+    state.diffuse_color_[0] = static_cast<float>(i);
+    state.shader_ = i % kShaders;
+    state.translucent_ = (i % 10 == 0);
+    handles->push_back(shading_system->InternState(state));
+  }
+}
+
+// Creates the benchmark's buffers. Every shading system gets the same
+// handles.
+void CreateBuffers(ShadingSystem* shading_system,
+                   std::vector<BufferHandle>* handles) {
+  handles->clear();
+  for (uint32_t i = 0; i < kBuffers; ++i) {
+    handles->push_back(shading_system->CreateVertexBuffer(
+        Buffer<float>(NULL, 1024 * i, 1024)));
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::vector<StateHandle> states;
+  ShadingSystemNull null;
+  InternStates(&null, &states);
+  std::vector<BufferHandle> buffers;
+  CreateBuffers(&null, &buffers);
+
+  // Random scene, the same for every frame.
+  const uint32_t kMaxBlocks = 1000000;
+  std::vector<RenderBlock> scene(kMaxBlocks);
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < kMaxBlocks; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    StateHandle state = states[(seed >> 8) % kStates];
+    seed = seed * 1664525 + 1013904223;
+    const BufferHandle buffer = buffers[(seed >> 8) % kBuffers];
+    seed = seed * 1664525 + 1013904223;
+    float depth = static_cast<float>(seed >> 8) / (1 << 24);
+    scene[i] = RenderBlock(buffer, kNullBuffer, kNullBuffer, state, i % 3,
+                           depth);
+  }
+
+  printf("%10s %8s %12s %12s %12s %10s %10s %10s %10s\n", "blocks",
+         "threads", "submit ms", "sort ms", "dispatch ms", "draws", "binds",
+         "skipped", "unsorted");
+
+  const uint32_t block_counts[] = { 100000, 250000, 500000, 1000000 };
+  for (uint32_t i = 0; i < sizeof(block_counts) / sizeof(block_counts[0]);
+       ++i) {
+    const uint32_t blocks = block_counts[i];
+
+    const uint64_t unsorted = CountUnsortedChanges(&scene[0], blocks);
+
+    for (uint32_t threads = 1; threads <= kMaxSubmitThreads; threads *= 2) {
+      TimedShadingSystem shading_system;
+      InternStates(&shading_system, &states);
+      CreateBuffers(&shading_system, &buffers);
+      double submit = 0.0;
+
+      for (uint32_t frame = 0; frame < kFrames; ++frame) {
+        Timer timer;
+        shading_system.BeginFrame();
+        SubmitThreaded(&shading_system, &scene[0], blocks, threads);
+        submit += timer.elapsed_seconds();
+        shading_system.EndFrame();
+      }
+
+      const FrameStatistics& statistics = shading_system.statistics();
+      const uint64_t changes =
+          statistics.state_binds_ + statistics.geometry_binds_;
+      const uint64_t skipped =
+          statistics.state_binds_skipped_ + statistics.geometry_binds_skipped_;
+      printf("%10u %8u %12.3f %12.3f %12.3f %10u %10llu %10llu %10llu\n",
+             blocks, threads, 1000.0 * submit / kFrames,
+             1000.0 * shading_system.sort_ / kFrames,
+             1000.0 * shading_system.dispatch_ / kFrames, statistics.draws_,
+             static_cast<unsigned long long>(changes),
+             static_cast<unsigned long long>(skipped),
+             static_cast<unsigned long long>(unsorted));
+    }
+  }
+
+  // A forest of a few meshes, each drawn many times with its own transform.
+  std::vector<DrawConstants> constants(kMaxBlocks);
+  for (uint32_t i = 0; i < kMaxBlocks; ++i) {
+    memset(&constants[i], 0, sizeof(constants[i]));
+    constants[i].transform_[3] = static_cast<float>(i);
+    scene[i] = RenderBlock(buffers[i % 16], kNullBuffer, kNullBuffer,
+                           states[i % 4 + 1], 0, 0.0f, &constants[i]);
+  }
+  printf("\n%10s %10s %12s %12s\n", "instances", "draws", "sort ms",
+         "dispatch ms");
+  const uint32_t max_instances[] = { 1, 16, 256 };
+  for (uint32_t i = 0; i < 3; ++i) {
+    TimedShadingSystem shading_system;
+    InternStates(&shading_system, &states);
+    CreateBuffers(&shading_system, &buffers);
+    shading_system.set_max_instances(max_instances[i]);
+    for (uint32_t frame = 0; frame < kFrames; ++frame) {
+      shading_system.BeginFrame();
+      SubmitThreaded(&shading_system, &scene[0], kMaxBlocks, 1);
+      shading_system.EndFrame();
+    }
+    printf("%10u %10u %12.3f %12.3f\n", max_instances[i],
+           shading_system.statistics().draws_,
+           1000.0 * shading_system.sort_ / kFrames,
+           1000.0 * shading_system.dispatch_ / kFrames);
+  }
+
+  // Compares the structure of arrays queue with the vector of blocks it
+  // replaced, on the random scene with constants for every block.
+  for (uint32_t i = 0; i < kMaxBlocks; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    StateHandle state = states[(seed >> 8) % kStates];
+    seed = seed * 1664525 + 1013904223;
+    const BufferHandle buffer = buffers[(seed >> 8) % kBuffers];
+    seed = seed * 1664525 + 1013904223;
+    float depth = static_cast<float>(seed >> 8) / (1 << 24);
+    scene[i] = RenderBlock(buffer, kNullBuffer, kNullBuffer, state, i % 3,
+                           depth, &constants[i]);
+  }
+
+  printf("\n%10s %12s %12s %12s %10s\n", "layout", "submit ms", "sort ms",
+         "dispatch ms", "draws");
+  {
+    TimedShadingSystem shading_system;
+    InternStates(&shading_system, &states);
+    CreateBuffers(&shading_system, &buffers);
+    double submit = 0.0;
+    for (uint32_t frame = 0; frame < kFrames; ++frame) {
+      Timer timer;
+      shading_system.BeginFrame();
+      SubmitThreaded(&shading_system, &scene[0], kMaxBlocks, 1);
+      submit += timer.elapsed_seconds();
+      shading_system.EndFrame();
+    }
+    printf("%10s %12.3f %12.3f %12.3f %10u\n", "arrays",
+           1000.0 * submit / kFrames, 1000.0 * shading_system.sort_ / kFrames,
+           1000.0 * shading_system.dispatch_ / kFrames,
+           shading_system.statistics().draws_);
+
+    BlockVectorQueue* queue = new BlockVectorQueue(kMaxBlocks);
+    NullBackend* backend = new NullBackend();
+    double sort = 0.0;
+    double dispatch = 0.0;
+    uint32_t draws = 0;
+    submit = 0.0;
+    for (uint32_t frame = 0; frame < kFrames; ++frame) {
+      Timer timer;
+      queue->Clear();
+      for (uint32_t i = 0; i < kMaxBlocks; ++i) {
+        queue->Render(scene[i], shading_system.ComputeSortKey(scene[i]), i);
+      }
+      submit += timer.elapsed_seconds();
+      timer.Reset();
+      queue->Sort();
+      sort += timer.elapsed_seconds();
+      timer.Reset();
+      draws = queue->Dispatch(shading_system, backend).draws_;
+      dispatch += timer.elapsed_seconds();
+    }
+    delete backend;
+    delete queue;
+    printf("%10s %12.3f %12.3f %12.3f %10u\n", "blocks",
+           1000.0 * submit / kFrames, 1000.0 * sort / kFrames,
+           1000.0 * dispatch / kFrames, draws);
+  }
+
+  // Replays a recorded frame, which only measures the backend.
+  ShadingSystemRecording recording(kMaxSubmitThreads, 1024 * 1024);
+  InternStates(&recording, &states);
+  CreateBuffers(&recording, &buffers);
+  recording.BeginFrame();
+  SubmitThreaded(&recording, &scene[0], kMaxBlocks, 1);
+  recording.EndFrame();
+
+  Timer timer;
+  for (uint32_t frame = 0; frame < kFrames; ++frame) {
+    ShadingSystemRecording::Replay(&recording.stream()[0],
+                                   recording.stream().size(), &null);
+  }
+  printf("replaying %u blocks (%lu bytes): %.3f ms\n", kMaxBlocks,
+         static_cast<unsigned long>(recording.stream().size()),
+         1000.0 * timer.elapsed_seconds() / kFrames);
+
+  return 0;
+}
@@ -0,0 +1,246 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mxcore/radix_sort.h>
+#include <shade/shading_system_null.h>
+
+using namespace mx::core;
+using namespace mx::shade;
+
+namespace {
+
+struct Pair {
+  uint64_t key_;
+  uint32_t value_;
+};
+
+uint64_t KeyOf(const Pair& pair) {
+  return pair.key_;
+}
+
+bool Less(const Pair& a, const Pair& b) {
+  return a.key_ < b.key_;
+}
+
+void TestRadixSort() {
+  std::vector<Pair> pairs(10000);
+  uint64_t seed = 1;
+  for (uint32_t i = 0; i < pairs.size(); ++i) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    // Few distinct keys to check stability.
+    pairs[i].key_ = (seed >> 40) % 100 << 48;
+    pairs[i].value_ = i;
+  }
+
+  std::vector<Pair> expected = pairs;
+  std::stable_sort(expected.begin(), expected.end(), Less);
+
+  std::vector<Pair> scratch(pairs.size());
+  RadixSortHistograms* histograms = new RadixSortHistograms();
+  RadixSort(&pairs[0], &scratch[0], pairs.size(), KeyOf, histograms);
+  for (uint32_t i = 0; i < pairs.size(); ++i) {
+    assert(pairs[i].key_ == expected[i].key_);
+    assert(pairs[i].value_ == expected[i].value_);
+  }
+
+  RadixSort<Pair>(NULL, NULL, 0, KeyOf, histograms);
+  delete histograms;
+}
+
+inline RenderBlock GetBlock(const ShadingSystem& shading_system,
+                            const uint32_t index) {
+  return shading_system.GetQueuedBlock(index);
+}
+
+void TestSortKeys() {
+  ShadingSystemNull shading_system;
+  RenderState state = {};
+  state.shader_ = 2;
+  StateHandle opaque[2];
+  opaque[0] = shading_system.InternState(state);
+  state.shader_ = 1;
+  opaque[1] = shading_system.InternState(state);
+  state.shader_ = 0;
+  state.translucent_ = true;
+  StateHandle translucent = shading_system.InternState(state);
+  const BufferHandle buffer =
+      shading_system.CreateVertexBuffer(Buffer<float>());
+
+  shading_system.BeginFrame();
+  shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                    translucent, 0, 0.2f));
+  shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                    opaque[0], 1, 0.1f));
+  shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                    opaque[0], 0, 0.7f));
+  shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                    translucent, 0, 0.9f));
+  shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                    opaque[1], 0, 0.5f));
+  shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                    opaque[0], 0, 0.3f));
+  shading_system.EndFrame();
+
+  // Opaque blocks grouped by shader and front to back, then translucent
+  // blocks back to front, then the next layer.
+  assert(shading_system.render_items().size() == 6);
+  assert(GetBlock(shading_system, 0).state_ == opaque[1]);
+  assert(GetBlock(shading_system, 1).state_ == opaque[0]);
+  assert(GetBlock(shading_system, 1).depth_ == 0.3f);
+  assert(GetBlock(shading_system, 2).depth_ == 0.7f);
+  assert(GetBlock(shading_system, 3).depth_ == 0.9f);
+  assert(GetBlock(shading_system, 4).depth_ == 0.2f);
+  assert(GetBlock(shading_system, 5).layer_ == 1);
+
+  shading_system.BeginFrame();
+  assert(shading_system.render_items().empty());
+  shading_system.EndFrame();
+}
+
+// Submits blocks [begin, end) of the scene.
+void Submit(ShadingSystem* shading_system, const RenderBlock* scene,
+            const uint32_t begin, const uint32_t end) {
+  for (uint32_t i = begin; i < end; ++i) {
+    shading_system->Render(scene[i], i);
+  }
+}
+
+// Submits the scene from thread_count threads and returns the resulting
+// order of blocks.
+std::vector<const RenderBlock*> SubmitThreaded(
+    ShadingSystemNull* shading_system, const std::vector<RenderBlock>& scene,
+    const uint32_t thread_count) {
+  shading_system->BeginFrame();
+
+  std::vector<std::thread> threads;
+  const uint32_t count = static_cast<uint32_t>(scene.size());
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    // Let the later threads start first to vary the merge order.
+    const uint32_t thread = thread_count - 1 - i;
+    threads.push_back(std::thread(Submit, shading_system, &scene[0],
+                                  count * thread / thread_count,
+                                  count * (thread + 1) / thread_count));
+  }
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads[i].join();
+  }
+
+  shading_system->EndFrame();
+
+  std::vector<const RenderBlock*> order;
+  for (uint32_t i = 0; i < shading_system->render_items().size(); ++i) {
+    order.push_back(&scene[shading_system->render_items()[i].sequence_]);
+  }
+  return order;
+}
+
+void TestThreadedSubmission() {
+  ShadingSystemNull shading_system(4, 1024);
+  const BufferHandle buffer =
+      shading_system.CreateVertexBuffer(Buffer<float>());
+  std::vector<RenderBlock> scene;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    scene.push_back(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                kDefaultState));
+  }
+
+  std::vector<const RenderBlock*> reference =
+      SubmitThreaded(&shading_system, scene, 1);
+  assert(reference.size() == scene.size());
+
+  shading_system.set_deterministic(true);
+  reference = SubmitThreaded(&shading_system, scene, 1);
+  for (uint32_t threads = 2; threads <= 4; ++threads) {
+    const std::vector<const RenderBlock*> submitted =
+        SubmitThreaded(&shading_system, scene, threads);
+    assert(submitted == reference);
+    (void)submitted;
+  }
+
+  // All submitted blocks made it into the queue.
+  std::vector<const RenderBlock*> sorted = reference;
+  std::sort(sorted.begin(), sorted.end());
+  for (uint32_t i = 0; i < scene.size(); ++i) {
+    assert(sorted[i] == &scene[i]);
+  }
+}
+
+// More threads than thread_count submit at the same time. The workers wait
+// for each other, so they hold distinct thread indices even on a single core.
+void TestMoreThreadsThanBuckets() {
+  const uint32_t kWorkers = 6;
+  const uint32_t kBlocksPerWorker = 300;
+  ShadingSystemNull shading_system(2, 1024);
+  const BufferHandle buffer =
+      shading_system.CreateVertexBuffer(Buffer<float>());
+  const RenderBlock block(buffer, kNullBuffer, kNullBuffer, kDefaultState);
+
+  for (uint32_t frame = 0; frame < 2; ++frame) {
+    shading_system.BeginFrame();
+    std::atomic<uint32_t> arrived(0);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < kWorkers; ++i) {
+      threads.push_back(std::thread([&shading_system, &arrived, &block, i]() {
+        for (uint32_t j = 0; j < kBlocksPerWorker; ++j) {
+          shading_system.Render(block, i * kBlocksPerWorker + j);
+        }
+        ++arrived;
+        while (arrived.load() < kWorkers) {
+          std::this_thread::yield();
+        }
+      }));
+    }
+    for (uint32_t i = 0; i < kWorkers; ++i) {
+      threads[i].join();
+    }
+    shading_system.EndFrame();
+
+    // Every block made it into the queue exactly once.
+    const std::vector<RenderItem>& items = shading_system.render_items();
+    assert(items.size() == kWorkers * kBlocksPerWorker);
+    std::vector<bool> seen(items.size(), false);
+    for (uint32_t i = 0; i < items.size(); ++i) {
+      assert(!seen[items[i].sequence_]);
+      seen[items[i].sequence_] = true;
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestRadixSort();
+  TestSortKeys();
+  TestThreadedSubmission();
+  TestMoreThreadsThanBuckets();
+  return 0;
+}
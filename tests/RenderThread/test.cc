@@ -0,0 +1,281 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <shade/shading_system_null.h>
+
+using namespace mx::shade;
+
+namespace {
+
+// Null backend whose Present() blocks until the test releases the frame, like
+// a swap waiting for vertical sync. Records the number of blocks drawn in
+// every frame.
+class GatedShadingSystem : public ShadingSystemNull {
+ public:
+  explicit GatedShadingSystem(const uint32_t max_frames_in_flight)
+      : ShadingSystemNull(4, 4096, max_frames_in_flight),
+        released_(0),
+        presented_(0),
+        render_thread_started_(false) {}
+  ~GatedShadingSystem() { StopRenderThread(); }
+
+  void Release(const uint32_t frames) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    released_ += frames;
+    condition_.notify_all();
+  }
+
+  uint32_t presented() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return presented_;
+  }
+
+  const std::vector<uint32_t>& instances() const { return instances_; }
+  bool render_thread_started() const { return render_thread_started_; }
+
+ protected:
+  void BeginRenderThread() { render_thread_started_ = true; }
+
+  void Present() {
+    ShadingSystemNull::Present();
+    instances_.push_back(dispatch_statistics().instances_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (released_ == presented_) {
+      condition_.wait(lock);
+    }
+    ++presented_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  uint32_t released_;
+  uint32_t presented_;
+  std::vector<uint32_t> instances_;
+  bool render_thread_started_;
+};
+
+void CreateBuffers(ShadingSystem* shading_system, BufferHandle* buffers,
+                   const uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) {
+    buffers[i] = shading_system->CreateVertexBuffer(Buffer<float>());
+  }
+}
+
+void SubmitFrame(ShadingSystem* shading_system, const BufferHandle* buffers,
+                 const StateHandle state, const uint32_t count) {
+  shading_system->BeginFrame();
+  for (uint32_t i = 0; i < count; ++i) {
+    shading_system->Render(RenderBlock(buffers[i % 4], kNullBuffer,
+                                       kNullBuffer, state), i);
+  }
+  shading_system->EndFrame();
+}
+
+// Frames dispatched by the render thread match the ones dispatched directly.
+void TestEquivalence() {
+  ShadingSystemNull direct;
+  ShadingSystemNull threaded(8, 64 * 1024, 2);
+  assert(threaded.max_frames_in_flight() == 2);
+
+  RenderState state;
+  memset(&state, 0, sizeof(state));
+  StateHandle states[16];
+  for (uint32_t i = 0; i < 16; ++i) {
+    state.shader_ = i % 3;
+    state.diffuse_color_[0] = static_cast<float>(i);
+    states[i] = direct.InternState(state);
+    const StateHandle threaded_state = threaded.InternState(state);
+    assert(threaded_state == states[i]);
+    (void)threaded_state;
+  }
+  BufferHandle buffers[8];
+  CreateBuffers(&direct, buffers, 8);
+  BufferHandle threaded_buffers[8];
+  CreateBuffers(&threaded, threaded_buffers, 8);
+  assert(memcmp(buffers, threaded_buffers, sizeof(buffers)) == 0);
+
+  for (uint32_t frame = 0; frame < 20; ++frame) {
+    ShadingSystem* systems[2] = { &direct, &threaded };
+    for (uint32_t i = 0; i < 2; ++i) {
+      systems[i]->set_deterministic(true);
+      systems[i]->BeginFrame();
+      for (uint32_t j = 0; j < 500; ++j) {
+        systems[i]->Render(RenderBlock(buffers[(j + frame) % 8], kNullBuffer,
+                                       kNullBuffer, states[j % 16], j % 2),
+                           j);
+      }
+      systems[i]->EndFrame();
+    }
+  }
+
+  threaded.Flush();
+  assert(threaded.frames_in_flight() == 0);
+  assert(threaded.frames() == 20);
+  const FrameStatistics expected = direct.statistics();
+  const FrameStatistics statistics = threaded.statistics();
+  assert(memcmp(&statistics, &expected, sizeof(statistics)) == 0);
+  (void)expected;
+  (void)statistics;
+  assert(threaded.render_items().size() == 500);
+  for (uint32_t i = 0; i < 500; ++i) {
+    assert(threaded.render_items()[i].key_ == direct.render_items()[i].key_);
+    assert(threaded.render_items()[i].sequence_ ==
+           direct.render_items()[i].sequence_);
+  }
+}
+
+// EndFrame() returns while the render thread is still presenting, and only
+// blocks once max_frames_in_flight frames are queued.
+void TestLatency() {
+  GatedShadingSystem shading_system(2);
+  // Buffers can't be created while the render thread is held in Present().
+  BufferHandle buffers[4];
+  CreateBuffers(&shading_system, buffers, 4);
+
+  SubmitFrame(&shading_system, buffers, kDefaultState, 10);
+  SubmitFrame(&shading_system, buffers, kDefaultState, 20);
+  assert(shading_system.frames_in_flight() == 2);
+
+  std::atomic<bool> submitted(false);
+  std::thread submitter([&shading_system, &buffers, &submitted]() {
+    SubmitFrame(&shading_system, buffers, kDefaultState, 30);
+    submitted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  assert(!submitted);
+  assert(shading_system.presented() == 0);
+
+  // Presenting the first frame makes room for the third.
+  shading_system.Release(1);
+  submitter.join();
+  assert(submitted);
+  assert(shading_system.presented() >= 1);
+
+  shading_system.Release(2);
+  shading_system.Flush();
+  assert(shading_system.presented() == 3);
+  assert(shading_system.render_thread_started());
+
+  // Every frame drew its own blocks, although the next frame was already
+  // being submitted.
+  const std::vector<uint32_t>& instances = shading_system.instances();
+  assert(instances.size() == 3);
+  assert(instances[0] == 10 && instances[1] == 20 && instances[2] == 30);
+  (void)instances;
+
+  // The render thread is started again for the next frame.
+  shading_system.StopRenderThread();
+  shading_system.Release(1);
+  SubmitFrame(&shading_system, buffers, kDefaultState, 40);
+  shading_system.Flush();
+  assert(shading_system.instances().back() == 40);
+}
+
+// States can be interned and the device state invalidated while frames are
+// in flight.
+void TestStateChanges() {
+  ShadingSystemNull shading_system(2, 4096, 1);
+  BufferHandle buffers[4];
+  CreateBuffers(&shading_system, buffers, 4);
+
+  RenderState state;
+  memset(&state, 0, sizeof(state));
+  StateHandle last = kDefaultState;
+  for (uint32_t frame = 0; frame < 8; ++frame) {
+    SubmitFrame(&shading_system, buffers, last, 100);
+    // Crosses several chunks of the state cache while the frame is drawn.
+    for (uint32_t i = 0; i < 1000; ++i) {
+      state.diffuse_color_[0] = static_cast<float>(frame * 1000 + i + 1);
+      last = shading_system.InternState(state);
+    }
+  }
+  shading_system.Flush();
+  assert(shading_system.state_cache().size() == 8001);
+  assert(shading_system.statistics().state_binds_ == 1);
+
+  // The same state stays bound across frames until it's invalidated.
+  SubmitFrame(&shading_system, buffers, last, 100);
+  SubmitFrame(&shading_system, buffers, last, 100);
+  shading_system.Flush();
+  assert(shading_system.statistics().state_binds_ == 0);
+
+  shading_system.InvalidateDeviceState();
+  SubmitFrame(&shading_system, buffers, last, 100);
+  shading_system.Flush();
+  assert(shading_system.statistics().state_binds_ == 1);
+  assert(shading_system.statistics().blocks_ == 100);
+}
+
+// Buffers can be created and destroyed while frames are in flight. Blocks
+// whose buffers were destroyed before their frame was dispatched are skipped.
+void TestBufferChanges() {
+  ShadingSystemNull shading_system(2, 4096, 2);
+  BufferHandle buffers[4];
+  CreateBuffers(&shading_system, buffers, 4);
+
+  for (uint32_t frame = 0; frame < 8; ++frame) {
+    SubmitFrame(&shading_system, buffers, kDefaultState, 100);
+    shading_system.DestroyVertexBuffer(buffers[frame % 4]);
+    CreateBuffers(&shading_system, &buffers[frame % 4], 1);
+  }
+  SubmitFrame(&shading_system, buffers, kDefaultState, 100);
+  shading_system.Flush();
+  assert(shading_system.vertex_buffer_count() == 4);
+  assert(shading_system.statistics().blocks_ == 100);
+  assert(shading_system.statistics().stale_blocks_ == 0);
+
+  shading_system.BeginFrame();
+  for (uint32_t i = 0; i < 100; ++i) {
+    shading_system.Render(RenderBlock(buffers[i % 4], kNullBuffer, kNullBuffer,
+                                      kDefaultState), i);
+  }
+  shading_system.DestroyVertexBuffer(buffers[0]);
+  shading_system.EndFrame();
+  shading_system.Flush();
+  assert(shading_system.statistics().blocks_ == 75);
+  assert(shading_system.statistics().stale_blocks_ == 25);
+  assert(shading_system.dispatch_statistics().instances_ == 75);
+}
+
+}  // namespace
+
+int main() {
+  TestEquivalence();
+  TestLatency();
+  TestStateChanges();
+  TestBufferChanges();
+  return 0;
+}
@@ -25,8 +25,10 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <assert.h>
 #include <stdio.h>
 #include <mxcore/aligned_memory.h>
+#include <mxcore/alignment.h>
 #include <mxcore/linear_allocator.h>
 #include <mxcore/scope_stack.h>
 
@@ -41,7 +43,19 @@ class Foo {
 };
 
 struct Bar {
-  float_t b_;
+  float b_;
+};
+
+struct alignas(16) Vector4 {
+  float v_[4];
+};
+
+class alignas(64) JobData {
+ public:
+  JobData() { printf("JobData()\n"); }
+  ~JobData() { printf("~JobData()\n"); }
+ private:
+  int32_t data_[3];
 };
 
 int main() {
@@ -55,6 +69,7 @@ int main() {
     for (int32_t i = 0; i < 10; ++i) {
       foos[i] = outer_scope.NewWithFinalizer<Foo>();
     }
+    (void)foos;
 
     {
       printf("entering inside\n");
@@ -65,10 +80,33 @@ int main() {
       for (int32_t i = 0; i < 10; ++i) {
         bars[i] = inner_scope.NewObject<Bar>();
       }
+      (void)bars;
 
       printf("%p\n", allocator.marker());
       printf("leaving inside\n");
     }
+
+    {
+      ScopeStack aligned_scope(allocator);
+      aligned_scope.NewRaw(3);
+      Vector4* vector = aligned_scope.NewObject<Vector4>();
+      assert(IsAligned(vector, 16));
+
+      aligned_scope.NewRaw(5);
+      JobData* job = aligned_scope.NewWithFinalizer<JobData>();
+      assert(IsAligned(job, 64));
+
+      aligned_scope.NewRaw(1);
+      void* raw = aligned_scope.NewRaw(128, 32);
+      assert(IsAligned(raw, 32));
+
+      Bar* bar = aligned_scope.NewObject<Bar>(16);
+      assert(IsAligned(bar, 16));
+      (void)vector;
+      (void)job;
+      (void)raw;
+      (void)bar;
+    }
     printf("%p\n", allocator.marker());
   }
 
@@ -0,0 +1,250 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include <vector>
+#include <shade/shading_system_null.h>
+
+using namespace mx::shade;
+
+namespace {
+
+void TestBatching(ShadingSystemNull* shading_system, const StateHandle state,
+                  const BufferHandle buffer) {
+  DrawConstants constants[100];
+  memset(constants, 0, sizeof(constants));
+  for (uint32_t i = 0; i < 100; ++i) {
+    constants[i].color_[0] = static_cast<float>(i);
+  }
+
+  // Batches hold at most max_instances() blocks, and the constants are packed
+  // in queue order.
+  shading_system->set_deterministic(true);
+  shading_system->set_max_instances(16);
+  shading_system->BeginFrame();
+  for (uint32_t i = 0; i < 100; ++i) {
+    shading_system->Render(RenderBlock(buffer, kNullBuffer, kNullBuffer, state,
+                                       0, 0.0f, &constants[99 - i]), i);
+  }
+  shading_system->EndFrame();
+  assert(shading_system->statistics().blocks_ == 100);
+  assert(shading_system->statistics().draws_ == 7);
+  assert(shading_system->dispatch_statistics().instances_ == 100);
+  assert(shading_system->instance_data().size() == 100);
+  for (uint32_t i = 0; i < 100; ++i) {
+    assert(shading_system->instance_data()[i].color_[0] == 99 - i);
+  }
+
+  // Blocks in different layers or with different geometry aren't batched.
+  // Blocks without constants get the default ones.
+  const BufferHandle other =
+      shading_system->CreateVertexBuffer(Buffer<float>());
+  shading_system->BeginFrame();
+  for (uint32_t i = 0; i < 8; ++i) {
+    shading_system->Render(RenderBlock(i < 6 ? buffer : other, kNullBuffer,
+                                       kNullBuffer, state, i % 2), i);
+  }
+  shading_system->EndFrame();
+  shading_system->DestroyVertexBuffer(other);
+  assert(shading_system->statistics().draws_ == 4);
+  assert(shading_system->instance_data()[0].transform_[0] == 1.0f);
+  assert(shading_system->instance_data()[0].transform_[1] == 0.0f);
+  assert(shading_system->instance_data()[0].color_[3] == 1.0f);
+
+  shading_system->set_max_instances(1);
+  shading_system->BeginFrame();
+  for (uint32_t i = 0; i < 100; ++i) {
+    shading_system->Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                       state), i);
+  }
+  shading_system->EndFrame();
+  assert(shading_system->statistics().draws_ == 100);
+  assert(shading_system->statistics().geometry_binds_ == 1);
+  assert(shading_system->statistics().geometry_binds_skipped_ == 99);
+}
+
+// Constants are copied on submission, and the contents of transient buffers
+// can live in the frame's arena until the frame has been dispatched. Every
+// frame in flight and the frame being built use their own set of buffers,
+// which are pointed at the new contents every frame.
+void TestFrameMemory(const uint32_t max_frames_in_flight) {
+  ShadingSystemNull shading_system(2, 4096, max_frames_in_flight);
+  shading_system.set_deterministic(true);
+  const uint32_t set_count = max_frames_in_flight + 1;
+  std::vector<BufferHandle> buffers(set_count * 300);
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    buffers[i] = shading_system.CreateVertexBuffer(
+        Buffer<float>(NULL, 0, 9, kStreamUsage));
+  }
+
+  for (uint32_t frame = 0; frame < 4; ++frame) {
+    shading_system.BeginFrame();
+    DrawConstants constants;
+    memset(&constants, 0, sizeof(constants));
+    for (uint32_t i = 0; i < 300; ++i) {
+      const size_t size = 9 * sizeof(float);
+      float* vertices = static_cast<float*>(
+          shading_system.AllocateFrameMemory(size));
+      assert(reinterpret_cast<uintptr_t>(vertices) % 16 == 0);
+      memset(vertices, 0, size);
+      const BufferHandle buffer = buffers[(frame % set_count) * 300 + i];
+      shading_system.GetVertexBuffer(buffer)->data_ = vertices;
+
+      constants.color_[0] = static_cast<float>(frame * 300 + i);
+      shading_system.Render(RenderBlock(buffer, kNullBuffer, kNullBuffer,
+                                        kDefaultState, 0, 0.0f, &constants),
+                            i);
+    }
+    shading_system.EndFrame();
+  }
+
+  shading_system.Flush();
+  assert(shading_system.statistics().blocks_ == 300);
+  const std::vector<DrawConstants>& instances = shading_system.instance_data();
+  for (uint32_t i = 0; i < 300; ++i) {
+    const RenderItem& item = shading_system.render_items()[i];
+    const float expected = static_cast<float>(900 + item.sequence_);
+    assert(instances[i].color_[0] == expected);
+    const RenderBlock block = shading_system.GetQueuedBlock(i);
+    assert(block.constants_->color_[0] == expected);
+    assert(shading_system.GetVertexBuffer(block.vertex_buffer_)->size_ == 9);
+    (void)expected;
+    (void)block;
+  }
+  (void)instances;
+}
+
+}  // namespace
+
+int main() {
+  TestFrameMemory(0);
+  TestFrameMemory(2);
+
+  ShadingSystemNull shading_system;
+  shading_system.Initialize();
+
+  RenderState state;
+  memset(&state, 0, sizeof(state));
+  const StateHandle default_state = shading_system.InternState(state);
+  assert(default_state == kDefaultState);
+  (void)default_state;
+
+  StateHandle states[2];
+  state.diffuse_color_[0] = 0.5f;
+  states[0] = shading_system.InternState(state);
+  state.diffuse_color_[0] = 1.0f;
+  states[1] = shading_system.InternState(state);
+  assert(states[0] != states[1] && states[0] != kDefaultState);
+
+  // Equal states share a handle.
+  RenderState copy = shading_system.state_cache().Get(states[1]);
+  const StateHandle shared = shading_system.InternState(copy);
+  assert(shared == states[1]);
+  assert(shading_system.state_cache().size() == 3);
+  (void)shared;
+
+  BufferHandle buffers[2];
+  buffers[0] = shading_system.CreateVertexBuffer(Buffer<float>());
+  buffers[1] = shading_system.CreateVertexBuffer(Buffer<float>(NULL, 0, 1));
+  assert(buffers[0] != kNullBuffer && buffers[1] != kNullBuffer);
+  assert(shading_system.GetVertexBuffer(buffers[1])->size_ == 1);
+
+  for (uint32_t frame = 0; frame < 3; ++frame) {
+    shading_system.BeginFrame();
+    for (uint32_t i = 0; i < 100; ++i) {
+      shading_system.Render(RenderBlock(buffers[i % 2], kNullBuffer,
+                                        kNullBuffer, states[i % 2]));
+    }
+    shading_system.EndFrame();
+
+    // Sorting groups the blocks by state and buffer, so every state is only
+    // bound once and the blocks sharing it are drawn as instances.
+    const FrameStatistics& statistics = shading_system.statistics();
+    assert(statistics.blocks_ == 100);
+    assert(statistics.draws_ == 2);
+    assert(statistics.state_binds_ == 2);
+    assert(statistics.state_binds_skipped_ == 98);
+    assert(statistics.geometry_binds_ == 2);
+    assert(statistics.geometry_binds_skipped_ == 98);
+    assert(statistics.shader_binds_ == (frame == 0 ? 1 : 0));
+
+    const DispatchStatistics& calls = shading_system.dispatch_statistics();
+    assert(calls.draws_ == 2);
+    assert(calls.instances_ == 100);
+    assert(calls.state_changes_ == 2);
+    assert(calls.geometry_binds_ == 2);
+    assert(shading_system.frames() == frame + 1);
+    (void)statistics;
+    (void)calls;
+  }
+
+  // The state bound at the end of the last frame is still bound.
+  shading_system.BeginFrame();
+  shading_system.Render(RenderBlock(buffers[0], kNullBuffer, kNullBuffer,
+                                    states[1]));
+  shading_system.EndFrame();
+  assert(shading_system.statistics().state_binds_ == 0);
+  assert(shading_system.statistics().state_binds_skipped_ == 1);
+
+  shading_system.InvalidateDeviceState();
+  shading_system.BeginFrame();
+  shading_system.Render(RenderBlock(buffers[0], kNullBuffer, kNullBuffer,
+                                    states[1]));
+  shading_system.EndFrame();
+  assert(shading_system.statistics().state_binds_ == 1);
+  assert(shading_system.statistics().shader_binds_ == 1);
+
+  shading_system.BeginFrame();
+  shading_system.EndFrame();
+  assert(shading_system.statistics().draws_ == 0);
+  assert(shading_system.dispatch_statistics().state_changes_ == 0);
+
+  TestBatching(&shading_system, states[0], buffers[1]);
+
+  // Blocks whose buffers are destroyed before the frame is dispatched are
+  // skipped, and the handle of a destroyed buffer is never valid again.
+  shading_system.BeginFrame();
+  for (uint32_t i = 0; i < 10; ++i) {
+    shading_system.Render(RenderBlock(buffers[i % 2], kNullBuffer,
+                                      kNullBuffer, states[0]));
+  }
+  shading_system.DestroyVertexBuffer(buffers[0]);
+  shading_system.EndFrame();
+  assert(shading_system.statistics().blocks_ == 5);
+  assert(shading_system.statistics().stale_blocks_ == 5);
+  assert(shading_system.GetVertexBuffer(buffers[0]) == NULL);
+  const BufferHandle replacement =
+      shading_system.CreateVertexBuffer(Buffer<float>());
+  assert(replacement != buffers[0]);
+  (void)replacement;
+  assert(shading_system.GetVertexBuffer(buffers[0]) == NULL);
+  assert(shading_system.vertex_buffer_count() == 2);
+
+  shading_system.Dispose();
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <shade/shading_system_null.h>
+#include <shade/shading_system_recording.h>
+
+using namespace mx::shade;
+
+namespace {
+
+struct Scene {
+  Scene() {
+    memset(states_, 0, sizeof(states_));
+    for (uint32_t i = 0; i < 8; ++i) {
+      states_[i].diffuse_color_[0] = 0.1f * i;
+      states_[i].shader_ = i % 3;
+      states_[i].translucent_ = (i == 7);
+      buffers_[i].size_ = 3 * (i + 1);
+    }
+    memset(constants_, 0, sizeof(constants_));
+    for (uint32_t i = 0; i < 16; ++i) {
+      constants_[i].transform_[3] = static_cast<float>(i);
+    }
+  }
+
+  void Submit(ShadingSystem* shading_system) {
+    StateHandle handles[8];
+    BufferHandle buffers[8];
+    for (uint32_t i = 0; i < 8; ++i) {
+      handles[i] = shading_system->InternState(states_[i]);
+      buffers[i] = shading_system->CreateVertexBuffer(buffers_[i]);
+    }
+
+    shading_system->BeginFrame();
+    for (uint32_t i = 0; i < 1000; ++i) {
+      shading_system->Render(RenderBlock(buffers[i % 5], kNullBuffer,
+                                         kNullBuffer, handles[i % 8], i % 2,
+                                         (i % 97) / 97.0f, &constants_[i % 16]),
+                             i);
+    }
+    shading_system->EndFrame();
+
+    for (uint32_t i = 0; i < 8; ++i) {
+      shading_system->DestroyVertexBuffer(buffers[i]);
+    }
+  }
+
+  RenderState states_[8];
+  Buffer<float> buffers_[8];
+  DrawConstants constants_[16];
+};
+
+}  // namespace
+
+int main() {
+  // Two scenes at different addresses record the same stream.
+  Scene* first_scene = new Scene();
+  Scene* second_scene = new Scene();
+
+  ShadingSystemRecording recording;
+  recording.set_deterministic(true);
+  first_scene->Submit(&recording);
+  first_scene->Submit(&recording);
+  std::vector<uint8_t> stream = recording.stream();
+  assert(!stream.empty());
+
+  ShadingSystemRecording second_recording;
+  second_recording.set_deterministic(true);
+  second_scene->Submit(&second_recording);
+  second_scene->Submit(&second_recording);
+  assert(second_recording.stream() == stream);
+
+  // Replaying through the null backend makes the same calls as drawing.
+  ShadingSystemNull null;
+  first_scene->Submit(&null);
+  DispatchStatistics expected = null.dispatch_statistics();
+
+  ShadingSystemNull replayed;
+  bool replayed_stream =
+      ShadingSystemRecording::Replay(&stream[0], stream.size(), &replayed);
+  assert(replayed_stream);
+  assert(replayed.frames() == 2);
+  const DispatchStatistics& calls = replayed.dispatch_statistics();
+  assert(calls.draws_ == expected.draws_);
+  assert(calls.instances_ == expected.instances_);
+  assert(calls.shader_binds_ == expected.shader_binds_);
+  assert(calls.state_changes_ == expected.state_changes_);
+  assert(calls.geometry_binds_ == expected.geometry_binds_);
+  assert(replayed.state_cache().size() == null.state_cache().size());
+  // The buffers created for the replay are destroyed again.
+  assert(replayed.vertex_buffer_count() == 0);
+  (void)expected;
+  (void)calls;
+
+  // Truncated and corrupt streams are rejected. The last commands are a draw
+  // and a present.
+  replayed_stream = ShadingSystemRecording::Replay(
+      &stream[0], stream.size() - 2, &replayed);
+  assert(!replayed_stream);
+  std::vector<uint8_t> corrupt = stream;
+  corrupt[0] = 0xff;
+  replayed_stream =
+      ShadingSystemRecording::Replay(&corrupt[0], corrupt.size(), &replayed);
+  assert(!replayed_stream);
+  (void)replayed_stream;
+
+  // Round trip through a file.
+  const char* path = "ShadingSystemRecording.bin";
+  const bool written = recording.WriteToFile(path);
+  assert(written);
+  ShadingSystemRecording loaded;
+  const bool read = loaded.ReadFromFile(path);
+  assert(read);
+  (void)written;
+  (void)read;
+  assert(loaded.stream() == stream);
+  remove(path);
+
+  recording.ClearStream();
+  assert(recording.stream().empty());
+
+  delete first_scene;
+  delete second_scene;
+  return 0;
+}
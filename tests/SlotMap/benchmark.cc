@@ -0,0 +1,163 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <mxcore/slot_map.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+// About the size of a buffer descriptor.
+struct Resource {
+  float* data_;
+  size_t start_;
+  size_t size_;
+  uint32_t usage_;
+};
+
+const uint32_t kRepetitions = 5;
+
+// Returns the fastest of kRepetitions runs in nanoseconds per element.
+template <typename Function>
+double Measure(Function function, const size_t count, uint64_t* checksum) {
+  double best = 1e30;
+  for (uint32_t i = 0; i < kRepetitions; ++i) {
+    Timer timer;
+    *checksum += function();
+    best = std::min(best, timer.elapsed_seconds());
+  }
+  return best * 1e9 / count;
+}
+
+// Resources allocated one by one between other allocations and referenced
+// through a table of pointers, as render blocks referenced their buffers.
+class PointerTable {
+ public:
+  explicit PointerTable(const size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      Resource* resource = new Resource();
+      resource->size_ = i;
+      resources_.push_back(resource);
+      padding_.push_back(new char[rand() % 256 + 1]);
+    }
+    std::random_shuffle(resources_.begin(), resources_.end());
+  }
+
+  ~PointerTable() {
+    for (size_t i = 0; i < resources_.size(); ++i) {
+      delete resources_[i];
+      delete[] padding_[i];
+    }
+  }
+
+  Resource* get(const size_t i) const { return resources_[i]; }
+
+  uint64_t Iterate() const {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < resources_.size(); ++i) {
+      sum += resources_[i]->size_;
+    }
+    return sum;
+  }
+
+ private:
+  std::vector<Resource*> resources_;
+  std::vector<char*> padding_;
+};
+
+void Run(const size_t count) {
+  uint64_t checksum = 0;
+  PointerTable pointers(count);
+  SlotMap<Resource> map;
+  std::vector<SlotMap<Resource>::Handle> handles;
+
+  // Churns the map first, so its elements are no longer in the order of
+  // their slots.
+  for (size_t i = 0; i < count; ++i) {
+    handles.push_back(map.Insert(*pointers.get(i)));
+  }
+  for (size_t i = 0; i < count / 2; ++i) {
+    const size_t victim = rand() % count;
+    map.Erase(handles[victim]);
+    handles[victim] = map.Insert(*pointers.get(victim));
+  }
+
+  // Lookups go through the handles or pointers in random order.
+  std::vector<uint32_t> order(count);
+  for (size_t i = 0; i < count; ++i) {
+    order[i] = static_cast<uint32_t>(i);
+  }
+  std::random_shuffle(order.begin(), order.end());
+
+  const double pointer_iterate = Measure([&]() {
+    return pointers.Iterate();
+  }, count, &checksum);
+  const double map_iterate = Measure([&]() {
+    uint64_t sum = 0;
+    const Resource* resources = map.data();
+    for (size_t i = 0; i < map.size(); ++i) {
+      sum += resources[i].size_;
+    }
+    return sum;
+  }, count, &checksum);
+  const double pointer_lookup = Measure([&]() {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += pointers.get(order[i])->size_;
+    }
+    return sum;
+  }, count, &checksum);
+  const double map_lookup = Measure([&]() {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += map.Get(handles[order[i]])->size_;
+    }
+    return sum;
+  }, count, &checksum);
+
+  printf("%10zu %10.2f %10.2f %10.2f %10.2f   (%llu)\n", count,
+         pointer_iterate, map_iterate, pointer_lookup, map_lookup,
+         static_cast<unsigned long long>(checksum % 10));
+}
+
+}  // namespace
+
+int main() {
+  srand(42);
+  printf("ns per element, best of %u runs\n", kRepetitions);
+  printf("%10s %10s %10s %10s %10s\n", "elements", "iterate", "packed",
+         "lookup", "handle");
+  Run(10000);
+  Run(100000);
+  Run(1000000);
+  return 0;
+}
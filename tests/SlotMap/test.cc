@@ -0,0 +1,160 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+#include <mxcore/slot_map.h>
+
+using namespace mx::core;
+
+namespace {
+
+typedef SlotMap<uint32_t>::Handle Handle;
+
+void TestBasics() {
+  SlotMap<std::string> map;
+  assert(map.empty());
+  assert(map.Get(SlotMap<std::string>::kNullHandle) == NULL);
+
+  const Handle a = map.Insert("a");
+  const Handle b = map.Insert("b");
+  const Handle c = map.Insert("c");
+  assert(a != SlotMap<std::string>::kNullHandle && a != b && b != c);
+  assert(map.size() == 3);
+  assert(*map.Get(b) == "b");
+
+  // Erasing moves the last element into the hole.
+  bool erased = map.Erase(a);
+  assert(erased);
+  assert(map.size() == 2);
+  assert(map.Get(a) == NULL);
+  assert(!map.Contains(a));
+  assert(*map.Get(b) == "b" && *map.Get(c) == "c");
+  assert(map.data()[0] == "c" && map.handle(0) == c);
+  assert(map.data()[1] == "b" && map.handle(1) == b);
+  erased = map.Erase(a);
+  assert(!erased);
+  (void)erased;
+
+  // The freed slot is reused with a new generation, so the old handle stays
+  // invalid.
+  const Handle d = map.Insert("d");
+  assert((d & (SlotMap<std::string>::kMaxSlots - 1)) ==
+         (a & (SlotMap<std::string>::kMaxSlots - 1)));
+  assert(d != a);
+  assert(map.Get(a) == NULL);
+  assert(*map.Get(d) == "d");
+
+  map.Clear();
+  assert(map.empty() && map.data() == NULL);
+  assert(map.Get(b) == NULL && map.Get(c) == NULL && map.Get(d) == NULL);
+  (void)b;
+  (void)c;
+  (void)d;
+}
+
+// Handles that were never returned don't match free slots.
+void TestForgedHandles() {
+  SlotMap<uint32_t> map;
+  const Handle a = map.Insert(1);
+  map.Erase(a);
+  for (uint32_t generation = 0; generation < 4; ++generation) {
+    const Handle forged = (generation << SlotMap<uint32_t>::kIndexBits) |
+        (a & (SlotMap<uint32_t>::kMaxSlots - 1));
+    assert(map.Get(forged) == NULL);
+    (void)forged;
+  }
+  assert(map.Get(12345) == NULL);
+}
+
+// A slot is retired once its generation runs out instead of wrapping around
+// to handles that were already returned.
+void TestRetirement() {
+  SlotMap<uint32_t> map;
+  const Handle first = map.Insert(0);
+  map.Erase(first);
+  Handle handle = SlotMap<uint32_t>::kNullHandle;
+  for (uint32_t i = 1; i < (1 << SlotMap<uint32_t>::kGenerationBits) - 1;
+       ++i) {
+    handle = map.Insert(i);
+    assert((handle & (SlotMap<uint32_t>::kMaxSlots - 1)) == 0);
+    map.Erase(handle);
+  }
+  handle = map.Insert(0);
+  assert((handle & (SlotMap<uint32_t>::kMaxSlots - 1)) == 1);
+  assert(map.Get(first) == NULL);
+}
+
+// Compares random inserts and erases against a std::map.
+void TestRandom() {
+  SlotMap<uint32_t> map;
+  std::map<Handle, uint32_t> expected;
+  std::vector<Handle> erased;
+  srand(42);
+
+  for (uint32_t i = 0; i < 100000; ++i) {
+    if (expected.empty() || rand() % 3 != 0) {
+      const Handle handle = map.Insert(i);
+      assert(expected.count(handle) == 0);
+      expected[handle] = i;
+    } else {
+      std::map<Handle, uint32_t>::iterator it = expected.begin();
+      std::advance(it, rand() % expected.size());
+      const bool result = map.Erase(it->first);
+      assert(result);
+      (void)result;
+      erased.push_back(it->first);
+      expected.erase(it);
+    }
+  }
+
+  assert(map.size() == expected.size());
+  for (std::map<Handle, uint32_t>::const_iterator it = expected.begin();
+       it != expected.end(); ++it) {
+    assert(*map.Get(it->first) == it->second);
+  }
+  for (size_t i = 0; i < map.size(); ++i) {
+    assert(expected[map.handle(i)] == map.data()[i]);
+  }
+  for (size_t i = 0; i < erased.size(); ++i) {
+    assert(map.Get(erased[i]) == NULL);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestBasics();
+  TestForgedHandles();
+  TestRetirement();
+  TestRandom();
+  return 0;
+}
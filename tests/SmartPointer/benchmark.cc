@@ -0,0 +1,227 @@
+// Copyright 2011 Christoph Lang. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Christoph Lang nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <mxcore/intrusive_pointer.h>
+#include <mxcore/smart_pointer.h>
+#include <mxcore/timer.h>
+
+using namespace mx::core;
+
+namespace {
+
+const uint32_t kObjects = 4096;
+const uint32_t kCopies = 64 * 1024;
+const uint32_t kRounds = 64;
+
+struct Node : public RefCounted {
+  float data_[8];
+};
+
+// Owns an array of pointers constructed in place, so that copies and moves
+// can be timed without container overhead.
+template <class Pointer>
+class PointerArray {
+ public:
+  explicit PointerArray(const uint32_t count)
+      : pointers_(static_cast<Pointer*>(malloc(sizeof(Pointer) * count))),
+        count_(0) {}
+
+  ~PointerArray() {
+    Clear();
+    free(pointers_);
+  }
+
+  template <class Argument>
+  void Add(Argument& argument) {
+    new (&pointers_[count_++]) Pointer(argument);
+  }
+
+  void Move(Pointer& pointer) {
+    new (&pointers_[count_++]) Pointer(std::move(pointer));
+  }
+
+  void Clear() {
+    for (uint32_t i = 0; i < count_; ++i) {
+      pointers_[i].~Pointer();
+    }
+    count_ = 0;
+  }
+
+  Pointer& operator[](const uint32_t index) {
+    return pointers_[index];
+  }
+
+ private:
+  Pointer* pointers_;
+  uint32_t count_;
+};
+
+// Creates pointers to kObjects distinct objects.
+template <class Pointer>
+void CreateObjects(PointerArray<Pointer>* objects) {
+  for (uint32_t i = 0; i < kObjects; ++i) {
+    Node* node = new Node();
+    objects->Add(node);
+  }
+}
+
+// Copies pseudo-randomly chosen owners and destroys the copies again.
+// Returns copy and destroy operations per second.
+template <class Pointer>
+double CopyDestroy(PointerArray<Pointer>& objects, uint32_t seed) {
+  PointerArray<Pointer> copies(kCopies);
+
+  Timer timer;
+  for (uint32_t round = 0; round < kRounds; ++round) {
+    for (uint32_t i = 0; i < kCopies; ++i) {
+      seed = seed * 1664525 + 1013904223;
+      copies.Add(objects[(seed >> 8) % kObjects]);
+    }
+    copies.Clear();
+  }
+  return 2.0 * kRounds * kCopies / timer.elapsed_seconds();
+}
+
+// Moves copies into a second array and destroys the moved-from pointers.
+// Returns moves per second.
+template <class Pointer>
+double Move(PointerArray<Pointer>& objects) {
+  PointerArray<Pointer> copies(kCopies);
+  PointerArray<Pointer> moved(kCopies);
+
+  double seconds = 0.0;
+  for (uint32_t round = 0; round < kRounds; ++round) {
+    for (uint32_t i = 0; i < kCopies; ++i) {
+      copies.Add(objects[i % kObjects]);
+    }
+
+    Timer timer;
+    for (uint32_t i = 0; i < kCopies; ++i) {
+      moved.Move(copies[i]);
+    }
+    copies.Clear();
+    seconds += timer.elapsed_seconds();
+    moved.Clear();
+  }
+  return kRounds * kCopies / seconds;
+}
+
+// Appends copies to a vector without reserving memory, so every reallocation
+// moves all pointers. Returns appended pointers per second.
+template <class Pointer>
+double VectorGrowth(PointerArray<Pointer>& objects) {
+  Timer timer;
+  for (uint32_t round = 0; round < kRounds; ++round) {
+    std::vector<Pointer> pointers;
+    for (uint32_t i = 0; i < kCopies; ++i) {
+      pointers.push_back(objects[i % kObjects]);
+    }
+  }
+  return kRounds * kCopies / timer.elapsed_seconds();
+}
+
+template <class Pointer>
+void CopyDestroyThread(PointerArray<Pointer>* objects, const uint32_t seed,
+                       double* rate) {
+  *rate = CopyDestroy(*objects, seed);
+}
+
+// Runs CopyDestroy on several threads, either on a set of objects shared by
+// all threads or on a set of objects per thread.
+template <class Pointer>
+double CopyDestroyThreads(PointerArray<Pointer>** objects,
+                          const uint32_t thread_count) {
+  std::vector<std::thread> threads;
+  std::vector<double> rates(thread_count);
+
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.push_back(std::thread(CopyDestroyThread<Pointer>, objects[i],
+                                  i + 1, &rates[i]));
+  }
+
+  double total = 0.0;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads[i].join();
+    total += rates[i];
+  }
+  return total;
+}
+
+}  // namespace
+
+int main() {
+  typedef SmartPointer<Node> Linked;
+  typedef IntrusivePointer<Node> Intrusive;
+
+  PointerArray<Linked> linked(kObjects);
+  PointerArray<Intrusive> intrusive(kObjects);
+  CreateObjects(&linked);
+  CreateObjects(&intrusive);
+
+  printf("%-32s %16s %16s\n", "single thread", "SmartPointer",
+         "IntrusivePointer");
+  printf("%-32s %16.0f %16.0f\n", "copy + destroy/s",
+         CopyDestroy(linked, 1), CopyDestroy(intrusive, 1));
+  printf("%-32s %16.0f %16.0f\n", "move/s", Move(linked), Move(intrusive));
+  printf("%-32s %16.0f %16.0f\n", "vector push_back/s", VectorGrowth(linked),
+         VectorGrowth(intrusive));
+
+  const uint32_t kMaxThreads = 8;
+  PointerArray<Linked>* linked_objects[kMaxThreads];
+  PointerArray<Intrusive>* intrusive_objects[kMaxThreads];
+  PointerArray<Intrusive>* shared_objects[kMaxThreads];
+  for (uint32_t i = 0; i < kMaxThreads; ++i) {
+    linked_objects[i] = new PointerArray<Linked>(kObjects);
+    intrusive_objects[i] = new PointerArray<Intrusive>(kObjects);
+    CreateObjects(linked_objects[i]);
+    CreateObjects(intrusive_objects[i]);
+    shared_objects[i] = &intrusive;
+  }
+
+  // SmartPointer isn't thread-safe, so it can only be measured with objects
+  // private to each thread.
+  printf("%-32s %16s %16s %16s\n", "copy + destroy/s", "SmartPointer",
+         "IntrusivePointer", "shared");
+  for (uint32_t threads = 1; threads <= kMaxThreads; threads *= 2) {
+    printf("%-2u %-29s %16.0f %16.0f %16.0f\n", threads, "threads",
+           CopyDestroyThreads(linked_objects, threads),
+           CopyDestroyThreads(intrusive_objects, threads),
+           CopyDestroyThreads(shared_objects, threads));
+  }
+
+  for (uint32_t i = 0; i < kMaxThreads; ++i) {
+    delete linked_objects[i];
+    delete intrusive_objects[i];
+  }
+  return 0;
+}
@@ -25,7 +25,14 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <assert.h>
 #include <stdio.h>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <mxcore/intrusive_pointer.h>
+#include <mxcore/memory_tracker.h>
+#include <mxcore/pool_allocator.h>
 #include <mxcore/smart_pointer.h>
 
 using namespace mx::core;
@@ -52,7 +59,273 @@ void function1() {
   function2(b);
 }
 
+class Bar : public RefCounted {
+ public:
+  Bar() {
+    ++instances;
+  }
+
+  ~Bar() {
+    --instances;
+  }
+
+  static int instances;
+};
+
+int Bar::instances = 0;
+
+void TestSmartPointerCopies() {
+  {
+    SmartPointer<Bar> a(new Bar());
+    SmartPointer<Bar> b(a);
+    {
+      SmartPointer<Bar> c(b);
+      SmartPointer<Bar> d(a);
+      SmartPointer<Bar> e(c);
+    }
+    assert(Bar::instances == 1);
+  }
+  assert(Bar::instances == 0);
+}
+
+void TestSmartPointerMove() {
+  {
+    SmartPointer<Bar> a(new Bar());
+    SmartPointer<Bar> b(a);
+
+    // The moved-to pointer takes over the place of the moved-from pointer.
+    SmartPointer<Bar> c(std::move(b));
+    assert(b.get() == NULL && c == a);
+
+    SmartPointer<Bar> d(new Bar());
+    assert(Bar::instances == 2);
+    d = std::move(c);
+    assert(Bar::instances == 1 && c.get() == NULL && d == a);
+
+    const SmartPointer<Bar>& constant = a;
+    SmartPointer<Bar> e;
+    e = constant;
+    assert(e == a);
+
+    // Reallocations move the elements.
+    std::vector<SmartPointer<Bar> > pointers;
+    for (int i = 0; i < 100; ++i) {
+      pointers.push_back(a);
+    }
+    pointers.clear();
+    assert(Bar::instances == 1);
+  }
+  assert(Bar::instances == 0);
+}
+
+struct CountingDeleter {
+  void operator()(Bar* bar) const {
+    ++deleted;
+    delete bar;
+  }
+
+  static int deleted;
+};
+
+int CountingDeleter::deleted = 0;
+
+void TestDeleters() {
+  // Stateless deleters don't add to the size.
+  assert(sizeof(SmartPointer<Bar>) == 3 * sizeof(void*));
+  assert(sizeof(SmartPointer<Bar, CountingDeleter>) == 3 * sizeof(void*));
+
+  {
+    SmartPointer<Bar, CountingDeleter> a(new Bar());
+    SmartPointer<Bar, CountingDeleter> b(a);
+  }
+  assert(CountingDeleter::deleted == 1 && Bar::instances == 0);
+
+  {
+    SmartPointer<Bar, TrackedDeleter<Bar> > a(mxnew(Bar, ()));
+    SmartPointer<Bar, TrackedDeleter<Bar> > b(a);
+  }
+  assert(Bar::instances == 0);
+
+  PoolAllocator<Bar> pool(16);
+  {
+    typedef SmartPointer<Bar, PoolDeleter<Bar> > PooledBar;
+    PooledBar a(mxpoolnew(pool, Bar, ()), PoolDeleter<Bar>(&pool));
+    PooledBar b(a);
+    PooledBar c;
+    c = b;
+    assert(c.deleter().pool() == &pool);
+  }
+  assert(Bar::instances == 0);
+}
+
+class Mesh {
+ public:
+  Mesh() {
+    ++instances;
+  }
+
+  ~Mesh() {
+    --instances;
+  }
+
+  static int instances;
+};
+
+int Mesh::instances = 0;
+
+// Keeps meshes for as long as someone else uses them.
+class MeshCache {
+ public:
+  SmartPointer<Mesh> Get(const int id) {
+    SmartPointer<Mesh> mesh = meshes_[id].Lock();
+    if (mesh.get() == NULL) {
+      mesh = SmartPointer<Mesh>(new Mesh());
+      meshes_[id] = mesh;
+    }
+    return mesh;
+  }
+
+ private:
+  WeakPointer<Mesh> meshes_[4];
+};
+
+void TestWeakPointer() {
+  WeakPointer<Bar> empty;
+  assert(empty.expired() && empty.Lock().get() == NULL);
+
+  {
+    SmartPointer<Bar> a(new Bar());
+    WeakPointer<Bar> weak(a);
+    assert(!weak.expired());
+    {
+      SmartPointer<Bar> b = weak.Lock();
+      assert(b == a);
+      WeakPointer<Bar> copy(weak);
+      WeakPointer<Bar> moved(std::move(copy));
+      assert(copy.expired() && !moved.expired());
+    }
+
+    // Releasing a strong reference between two weak ones.
+    WeakPointer<Bar> before(a);
+    SmartPointer<Bar> b(a);
+    WeakPointer<Bar> after(b);
+    SmartPointer<Bar> c(b);
+    b = SmartPointer<Bar>();
+    assert(!weak.expired() && Bar::instances == 1);
+
+    a = SmartPointer<Bar>();
+    assert(!weak.expired() && !before.expired() && !after.expired());
+    c = SmartPointer<Bar>();
+    assert(weak.expired() && before.expired() && after.expired());
+    assert(Bar::instances == 0);
+    assert(weak.Lock().get() == NULL);
+  }
+
+  // Weak references may outlive the object and be reassigned.
+  WeakPointer<Bar> weak;
+  {
+    SmartPointer<Bar> a(new Bar());
+    weak = a;
+    SmartPointer<Bar> b(new Bar());
+    weak = b;
+    assert(weak.Lock() == b);
+  }
+  assert(weak.expired() && Bar::instances == 0);
+
+  MeshCache cache;
+  {
+    SmartPointer<Mesh> a = cache.Get(0);
+    SmartPointer<Mesh> b = cache.Get(0);
+    SmartPointer<Mesh> c = cache.Get(1);
+    assert(a == b && a != c && Mesh::instances == 2);
+  }
+  assert(Mesh::instances == 0);
+  SmartPointer<Mesh> d = cache.Get(0);
+  assert(Mesh::instances == 1);
+
+  // Copied and moved weak references hand the deleter on to Lock(), so the
+  // last owner releases the object through it.
+  PoolAllocator<Bar> pool(16);
+  {
+    typedef SmartPointer<Bar, PoolDeleter<Bar> > PooledBar;
+    typedef WeakPointer<Bar, PoolDeleter<Bar> > WeakBar;
+    PooledBar a(mxpoolnew(pool, Bar, ()), PoolDeleter<Bar>(&pool));
+    WeakBar weak(a);
+    WeakBar copy(weak);
+    WeakBar moved(std::move(weak));
+    WeakBar assigned;
+    assigned = copy;
+    WeakBar move_assigned;
+    move_assigned = std::move(assigned);
+    assert(copy.Lock().deleter().pool() == &pool);
+    assert(moved.Lock().deleter().pool() == &pool);
+    assert(move_assigned.Lock().deleter().pool() == &pool);
+
+    PooledBar b = move_assigned.Lock();
+    a = PooledBar();
+    assert(Bar::instances == 1);
+    b = PooledBar();
+    assert(Bar::instances == 0 && copy.expired() && moved.expired());
+  }
+}
+
+void TestIntrusivePointer() {
+  {
+    IntrusivePointer<Bar> a(new Bar());
+    assert(a->reference_count() == 1);
+
+    IntrusivePointer<Bar> b(a);
+    assert(a == b && a->reference_count() == 2);
+
+    // Moves transfer the reference without touching the count.
+    IntrusivePointer<Bar> c(std::move(b));
+    assert(b.get() == NULL && a->reference_count() == 2);
+
+    c = c;
+    assert(a->reference_count() == 2);
+
+    IntrusivePointer<Bar> d(new Bar());
+    assert(Bar::instances == 2);
+    d = std::move(c);
+    assert(Bar::instances == 1 && c.get() == NULL);
+    assert(a->reference_count() == 2);
+
+    d.Reset();
+    assert(a->reference_count() == 1);
+  }
+  assert(Bar::instances == 0);
+}
+
+void CopyIntrusivePointer(IntrusivePointer<Bar>* shared) {
+  for (int i = 0; i < 100000; ++i) {
+    IntrusivePointer<Bar> copy(*shared);
+    IntrusivePointer<Bar> moved(std::move(copy));
+  }
+}
+
+void TestIntrusivePointerThreads() {
+  IntrusivePointer<Bar> shared(new Bar());
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread(CopyIntrusivePointer, &shared));
+  }
+  for (int i = 0; i < 4; ++i) {
+    threads[i].join();
+  }
+
+  assert(shared->reference_count() == 1);
+  shared.Reset();
+  assert(Bar::instances == 0);
+}
+
 int main() {
   function1();
+  TestSmartPointerCopies();
+  TestSmartPointerMove();
+  TestDeleters();
+  TestWeakPointer();
+  TestIntrusivePointer();
+  TestIntrusivePointerThreads();
   return 0;
 }